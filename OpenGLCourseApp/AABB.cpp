@@ -0,0 +1,64 @@
+#include "AABB.h"
+
+#include <cfloat>
+
+AABB::AABB() :
+	min(glm::vec3(FLT_MAX)),
+	max(glm::vec3(-FLT_MAX))
+{}
+
+AABB::AABB(glm::vec3 minCorner, glm::vec3 maxCorner) :
+	min(minCorner),
+	max(maxCorner)
+{}
+
+bool AABB::IsEmpty() const
+{
+	return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+void AABB::AddPoint(glm::vec3 point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::AddBox(const AABB& box)
+{
+	if (box.IsEmpty())
+	{
+		return;
+	}
+
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+glm::vec3 AABB::GetCenter() const
+{
+	return (min + max) * 0.5f;
+}
+
+glm::vec3 AABB::GetExtents() const
+{
+	return (max - min) * 0.5f;
+}
+
+AABB AABB::Transform(const glm::mat4& transform) const
+{
+	if (IsEmpty())
+	{
+		return *this;
+	}
+
+	// Center moves with the transform, the extents along each new axis are the sum of the absolute
+	// contributions of the old ones (Arvo)
+	const glm::vec3 center(transform * glm::vec4(GetCenter(), 1.0f));
+	const glm::vec3 extents = GetExtents();
+
+	const glm::mat3 absolute(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])),
+		glm::abs(glm::vec3(transform[2])));
+	const glm::vec3 newExtents = absolute * extents;
+
+	return AABB(center - newExtents, center + newExtents);
+}
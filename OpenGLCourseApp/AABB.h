@@ -0,0 +1,24 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box, empty (min > max) until the first point is added
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB();
+	AABB(glm::vec3 minCorner, glm::vec3 maxCorner);
+
+	bool IsEmpty() const;
+
+	void AddPoint(glm::vec3 point);
+	void AddBox(const AABB &box);
+
+	glm::vec3 GetCenter() const;
+	glm::vec3 GetExtents() const;
+
+	// Bounds of this box after the transform, a bit larger than the transformed box itself
+	AABB Transform(const glm::mat4 &transform) const;
+};
@@ -0,0 +1,130 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+CameraPath::CameraPath() = default;
+
+void CameraPath::AddKeyframe(glm::vec3 position, GLfloat yaw, GLfloat pitch)
+{
+	keyframes.push_back({ position, yaw, pitch });
+}
+
+void CameraPath::Apply(Camera* camera, GLfloat t) const
+{
+	if (keyframes.empty())
+	{
+		return;
+	}
+
+	if (keyframes.size() == 1)
+	{
+		camera->setPose(keyframes[0].position, keyframes[0].yaw, keyframes[0].pitch);
+		return;
+	}
+
+	t = std::min(std::max(t, 0.0f), 1.0f);
+
+	const GLfloat segment = t * static_cast<GLfloat>(keyframes.size() - 1);
+	const size_t first = std::min(static_cast<size_t>(segment), keyframes.size() - 2);
+	const GLfloat blend = segment - static_cast<GLfloat>(first);
+
+	const Keyframe &from = keyframes[first];
+	const Keyframe &to = keyframes[first + 1];
+
+	camera->setPose(from.position + (to.position - from.position) * blend,
+		from.yaw + (to.yaw - from.yaw) * blend,
+		from.pitch + (to.pitch - from.pitch) * blend);
+}
+
+FrameTimer::FrameTimer() :
+	queries{},
+	frameCount(0)
+{}
+
+void FrameTimer::Init()
+{
+	glGenQueries(QUERY_COUNT, queries);
+}
+
+void FrameTimer::BeginFrame()
+{
+	// The query slot is about to be reused, so its result from QUERY_COUNT frames ago has to be read first
+	if (frameCount >= QUERY_COUNT)
+	{
+		CollectQuery(frameCount - QUERY_COUNT);
+	}
+
+	frameStart = std::chrono::high_resolution_clock::now();
+	glBeginQuery(GL_TIME_ELAPSED, queries[frameCount % QUERY_COUNT]);
+}
+
+void FrameTimer::EndFrame()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+
+	const auto frameEnd = std::chrono::high_resolution_clock::now();
+	cpuTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+
+	frameCount++;
+}
+
+void FrameTimer::Finish()
+{
+	const unsigned first = frameCount > QUERY_COUNT ? frameCount - QUERY_COUNT : 0;
+	for (unsigned frame = first; frame < frameCount; frame++)
+	{
+		CollectQuery(frame);
+	}
+}
+
+void FrameTimer::PrintReport() const
+{
+	printf("Frames: %u\n", frameCount);
+	printf("%-8s %10s %10s %10s %10s %10s\n", "(ms)", "mean", "p50", "p95", "p99", "max");
+	PrintStats("CPU", cpuTimes);
+	PrintStats("GPU", gpuTimes);
+}
+
+FrameTimer::~FrameTimer()
+{
+	if (queries[0])
+	{
+		glDeleteQueries(QUERY_COUNT, queries);
+	}
+}
+
+void FrameTimer::CollectQuery(unsigned frame)
+{
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(queries[frame % QUERY_COUNT], GL_QUERY_RESULT, &elapsed);
+	gpuTimes.push_back(static_cast<double>(elapsed) / 1.0e6);
+}
+
+void FrameTimer::PrintStats(const char* label, std::vector<double> samples)
+{
+	if (samples.empty())
+	{
+		printf("%-8s %10s\n", label, "n/a");
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for (double sample : samples)
+	{
+		sum += sample;
+	}
+
+	// Nearest-rank percentiles
+	auto percentile = [&samples](double p)
+	{
+		const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(samples.size())));
+		return samples[std::max<size_t>(rank, 1) - 1];
+	};
+
+	printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f\n", label,
+		sum / static_cast<double>(samples.size()), percentile(50.0), percentile(95.0), percentile(99.0), samples.back());
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <chrono>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+// Scripted camera movement, so every benchmark run renders exactly the same frames
+class CameraPath
+{
+public:
+	CameraPath();
+
+	void AddKeyframe(glm::vec3 position, GLfloat yaw, GLfloat pitch);
+
+	// Moves the camera to the point t (0 to 1) along the path, keyframes are evenly spaced in t
+	void Apply(Camera *camera, GLfloat t) const;
+
+private:
+	struct Keyframe
+	{
+		glm::vec3 position;
+		GLfloat yaw, pitch;
+	};
+
+	std::vector<Keyframe> keyframes;
+};
+
+// Records CPU and GPU time per frame. GPU time comes from timer queries that are read back a few
+// frames late so the benchmark doesn't stall the pipeline waiting for them
+class FrameTimer
+{
+public:
+	FrameTimer();
+
+	void Init();
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Waits for the outstanding queries, must be called before PrintReport
+	void Finish();
+
+	void PrintReport() const;
+
+	~FrameTimer();
+
+private:
+	static constexpr unsigned QUERY_COUNT = 4;
+
+	GLuint queries[QUERY_COUNT];
+	unsigned frameCount;
+
+	std::chrono::high_resolution_clock::time_point frameStart;
+
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;
+
+	void CollectQuery(unsigned frame);
+	static void PrintStats(const char *label, std::vector<double> samples);
+};
@@ -0,0 +1,318 @@
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	GLfloat GetSurfaceArea(const AABB& box)
+	{
+		if (box.IsEmpty())
+		{
+			return 0.0f;
+		}
+
+		const glm::vec3 size = box.max - box.min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+}
+
+bool BoundingSphere::IntersectsBox(const AABB& box) const
+{
+	const glm::vec3 closest = glm::clamp(center, box.min, box.max);
+	const glm::vec3 offset = closest - center;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+BoundingCone::BoundingCone() :
+	BoundingCone(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), 45.0f, 1.0f)
+{}
+
+BoundingCone::BoundingCone(glm::vec3 coneApex, glm::vec3 coneDirection, GLfloat halfAngle, GLfloat coneRange) :
+	apex(coneApex),
+	direction(coneDirection),
+	cosAngle(cosf(glm::radians(halfAngle))),
+	sinAngle(sinf(glm::radians(halfAngle))),
+	range(coneRange)
+{}
+
+bool BoundingCone::IntersectsBox(const AABB& box) const
+{
+	const glm::vec3 center = box.GetCenter();
+	const GLfloat radius = glm::length(box.GetExtents());
+
+	// Distance along the axis, and from the sphere's center to the cone's side (negative inside)
+	const glm::vec3 offset = center - apex;
+	const GLfloat along = glm::dot(offset, direction);
+	const GLfloat across = sqrtf(std::max(glm::dot(offset, offset) - along * along, 0.0f));
+	const GLfloat sideDistance = cosAngle * across - sinAngle * along;
+
+	return sideDistance <= radius && along <= range + radius && along >= -radius;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{}
+
+void BoundingVolumeHierarchy::Build(const AABB* objectBounds, GLuint objectCount)
+{
+	bounds.assign(objectBounds, objectBounds + objectCount);
+	objects.resize(objectCount);
+	for (GLuint i = 0; i < objectCount; i++)
+	{
+		objects[i] = i;
+	}
+
+	nodes.clear();
+	if (objectCount == 0)
+	{
+		return;
+	}
+
+	// A binary tree with leaves of one object at least has at most 2n - 1 nodes
+	nodes.reserve(2 * objectCount - 1);
+	nodes.push_back(Node());
+	BuildNode(0, 0, objectCount);
+}
+
+void BoundingVolumeHierarchy::Refit(const AABB* objectBounds)
+{
+	bounds.assign(objectBounds, objectBounds + bounds.size());
+
+	// Children come after their parents, so going backwards they are done first
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		Node &node = nodes[i];
+		node.bounds = AABB();
+		if (node.count > 0)
+		{
+			for (GLuint j = node.first; j < node.first + node.count; j++)
+			{
+				node.bounds.AddBox(bounds[objects[j]]);
+			}
+		}
+		else
+		{
+			node.bounds.AddBox(nodes[node.first].bounds);
+			node.bounds.AddBox(nodes[node.first + 1].bounds);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::Query(const Frustum* frusta, GLuint frustumCount, std::vector<VolumeHit>& hits) const
+{
+	QueryVolumes(frusta, frustumCount, hits);
+}
+
+void BoundingVolumeHierarchy::Query(const BoundingSphere* spheres, GLuint sphereCount, std::vector<VolumeHit>& hits) const
+{
+	QueryVolumes(spheres, sphereCount, hits);
+}
+
+void BoundingVolumeHierarchy::Query(const BoundingCone* cones, GLuint coneCount, std::vector<VolumeHit>& hits) const
+{
+	QueryVolumes(cones, coneCount, hits);
+}
+
+GLuint BoundingVolumeHierarchy::GetObjectCount() const
+{
+	return static_cast<GLuint>(bounds.size());
+}
+
+const AABB& BoundingVolumeHierarchy::GetObjectBounds(GLuint object) const
+{
+	return bounds[object];
+}
+
+void BoundingVolumeHierarchy::BuildNode(GLuint node, GLuint first, GLuint count)
+{
+	AABB nodeBounds;
+	for (GLuint i = first; i < first + count; i++)
+	{
+		nodeBounds.AddBox(bounds[objects[i]]);
+	}
+	nodes[node].bounds = nodeBounds;
+	nodes[node].first = first;
+	nodes[node].count = count;
+
+	int axis;
+	GLfloat position;
+	GLuint leftCount = 0;
+	if (FindSplit(first, count, nodeBounds, axis, position))
+	{
+		const auto middle = std::partition(objects.begin() + first, objects.begin() + first + count,
+			[&](GLuint object) { return bounds[object].GetCenter()[axis] < position; });
+		leftCount = static_cast<GLuint>(middle - (objects.begin() + first));
+	}
+	else if (count <= MAX_LEAF_OBJECTS)
+	{
+		return;
+	}
+
+	// Too many objects for a leaf and nothing to tell them apart by, any halves will do
+	if (leftCount == 0 || leftCount == count)
+	{
+		leftCount = count / 2;
+	}
+
+	const GLuint left = static_cast<GLuint>(nodes.size());
+	nodes.push_back(Node());
+	nodes.push_back(Node());
+	nodes[node].first = left;
+	nodes[node].count = 0;
+
+	BuildNode(left, first, leftCount);
+	BuildNode(left + 1, first + leftCount, count - leftCount);
+}
+
+bool BoundingVolumeHierarchy::FindSplit(GLuint first, GLuint count, const AABB& nodeBounds, int& axis, GLfloat& position) const
+{
+	if (count <= 1)
+	{
+		return false;
+	}
+
+	AABB centers;
+	for (GLuint i = first; i < first + count; i++)
+	{
+		centers.AddPoint(bounds[objects[i]].GetCenter());
+	}
+
+	// Objects are binned by their centers, and every boundary between bins is tried as a split. The cost of a side
+	// is its surface area times its object count, relative to that of not splitting at all
+	GLfloat bestCost = FLT_MAX;
+	for (int binAxis = 0; binAxis < 3; binAxis++)
+	{
+		const GLfloat extent = centers.max[binAxis] - centers.min[binAxis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		AABB binBounds[SAH_BINS];
+		GLuint binCounts[SAH_BINS] = {};
+		const GLfloat scale = SAH_BINS / extent;
+		for (GLuint i = first; i < first + count; i++)
+		{
+			const AABB &box = bounds[objects[i]];
+			const int bin = std::min(static_cast<int>((box.GetCenter()[binAxis] - centers.min[binAxis]) * scale), SAH_BINS - 1);
+			binBounds[bin].AddBox(box);
+			binCounts[bin]++;
+		}
+
+		// Right sides swept from the end first, then the left sides meet them
+		GLfloat rightAreas[SAH_BINS];
+		GLuint rightCounts[SAH_BINS];
+		AABB right;
+		GLuint rightCount = 0;
+		for (int bin = SAH_BINS - 1; bin > 0; bin--)
+		{
+			right.AddBox(binBounds[bin]);
+			rightCount += binCounts[bin];
+			rightAreas[bin] = GetSurfaceArea(right);
+			rightCounts[bin] = rightCount;
+		}
+
+		AABB left;
+		GLuint leftCount = 0;
+		for (int bin = 0; bin < SAH_BINS - 1; bin++)
+		{
+			left.AddBox(binBounds[bin]);
+			leftCount += binCounts[bin];
+			if (leftCount == 0 || rightCounts[bin + 1] == 0)
+			{
+				continue;
+			}
+
+			const GLfloat cost = GetSurfaceArea(left) * leftCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				axis = binAxis;
+				position = centers.min[binAxis] + extent * (bin + 1) / SAH_BINS;
+			}
+		}
+	}
+
+	if (bestCost == FLT_MAX)
+	{
+		return false;
+	}
+
+	// Splitting has to pay for the extra node test, leaves too big to keep are split anyway
+	return bestCost < GetSurfaceArea(nodeBounds) * count || count > MAX_LEAF_OBJECTS;
+}
+
+template<typename Volume>
+void BoundingVolumeHierarchy::QueryVolumes(const Volume* volumes, GLuint volumeCount, std::vector<VolumeHit>& hits) const
+{
+	if (nodes.empty() || volumeCount == 0)
+	{
+		return;
+	}
+	volumeCount = std::min(volumeCount, MAX_QUERY_VOLUMES);
+
+	struct StackEntry
+	{
+		GLuint node;
+		GLuint mask;
+	};
+
+	// Volumes are dropped from the mask as soon as a node is outside of them, so they aren't tested below it
+	std::vector<StackEntry> stack;
+	stack.reserve(64);
+	StackEntry root;
+	root.node = 0;
+	root.mask = volumeCount >= MAX_QUERY_VOLUMES ? 0xFFFFFFFFu : (1u << volumeCount) - 1;
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		const StackEntry entry = stack.back();
+		stack.pop_back();
+		const Node &node = nodes[entry.node];
+
+		GLuint mask = 0;
+		for (GLuint volume = 0; volume < volumeCount; volume++)
+		{
+			if ((entry.mask & (1u << volume)) && volumes[volume].IntersectsBox(node.bounds))
+			{
+				mask |= 1u << volume;
+			}
+		}
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			StackEntry child;
+			child.mask = mask;
+			child.node = node.first + 1;
+			stack.push_back(child);
+			child.node = node.first;
+			stack.push_back(child);
+			continue;
+		}
+
+		for (GLuint i = node.first; i < node.first + node.count; i++)
+		{
+			VolumeHit hit;
+			hit.object = objects[i];
+			hit.volumeMask = 0;
+			// A leaf of one object has the object's bounds, which were just tested
+			for (GLuint volume = 0; volume < volumeCount; volume++)
+			{
+				if ((mask & (1u << volume)) && (node.count == 1 || volumes[volume].IntersectsBox(bounds[hit.object])))
+				{
+					hit.volumeMask |= 1u << volume;
+				}
+			}
+			if (hit.volumeMask != 0)
+			{
+				hits.push_back(hit);
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "Frustum.h"
+
+// Range of a point light
+struct BoundingSphere
+{
+	glm::vec3 center;
+	GLfloat radius;
+
+	bool IntersectsBox(const AABB &box) const;
+};
+
+// Lit volume of a spot light: apex at the light, axis along its direction, cut off at range
+struct BoundingCone
+{
+	glm::vec3 apex;
+	glm::vec3 direction;
+	GLfloat cosAngle, sinAngle;
+	GLfloat range;
+
+	BoundingCone();
+	// direction has to be normalized, halfAngle is in degrees
+	BoundingCone(glm::vec3 apex, glm::vec3 direction, GLfloat halfAngle, GLfloat range);
+
+	// Tests the box's bounding sphere, so it errs on the side of intersecting
+	bool IntersectsBox(const AABB &box) const;
+};
+
+// An object inside at least one of the volumes of a query, bit i of volumeMask for volume i
+struct VolumeHit
+{
+	GLuint object;
+	GLuint volumeMask;
+};
+
+// Tree of boxes over a set of objects, built with the surface area heuristic for objects that don't move and
+// refit in place for those that do. Queries only descend into nodes one of their volumes intersects, so they cost
+// about the log of the object count plus what they find. Objects are the indices of the bounds passed to Build
+class BoundingVolumeHierarchy
+{
+public:
+	// Queries test up to this many volumes at once, one mask bit each
+	static constexpr GLuint MAX_QUERY_VOLUMES = 32;
+
+	BoundingVolumeHierarchy();
+
+	void Build(const AABB *objectBounds, GLuint objectCount);
+	// New bounds of the same objects as Build, the tree keeps its shape so it gets looser as they move apart
+	void Refit(const AABB *objectBounds);
+
+	// Appends every object intersecting one of the volumes to hits
+	void Query(const Frustum *frusta, GLuint frustumCount, std::vector<VolumeHit> &hits) const;
+	void Query(const BoundingSphere *spheres, GLuint sphereCount, std::vector<VolumeHit> &hits) const;
+	void Query(const BoundingCone *cones, GLuint coneCount, std::vector<VolumeHit> &hits) const;
+
+	GLuint GetObjectCount() const;
+	const AABB &GetObjectBounds(GLuint object) const;
+
+private:
+	// Leaves have count objects from first in objects, inner nodes have count 0 and their children at first and
+	// first + 1. Children always come after their parent
+	struct Node
+	{
+		AABB bounds;
+		GLuint first;
+		GLuint count;
+	};
+
+	static constexpr GLuint MAX_LEAF_OBJECTS = 4;
+	static constexpr int SAH_BINS = 12;
+
+	std::vector<Node> nodes;
+	// Object indices, grouped by leaf
+	std::vector<GLuint> objects;
+	std::vector<AABB> bounds;
+
+	void BuildNode(GLuint node, GLuint first, GLuint count);
+	// Where to split the objects of a node, false if a leaf is cheaper
+	bool FindSplit(GLuint first, GLuint count, const AABB &nodeBounds, int &axis, GLfloat &position) const;
+
+	template<typename Volume>
+	void QueryVolumes(const Volume *volumes, GLuint volumeCount, std::vector<VolumeHit> &hits) const;
+};
@@ -2,6 +2,8 @@
 
 #include <GLFW/glfw3.h>
 
+static_assert(sizeof(CameraData) == 144, "CameraData doesn't match the std140 layout");
+
 
 Camera::Camera() = default;
 
@@ -74,6 +76,15 @@ void Camera::mouseControl(GLfloat xChange, GLfloat yChange)
 	update();
 }
 
+void Camera::setPose(glm::vec3 newPosition, GLfloat newYaw, GLfloat newPitch)
+{
+	position = newPosition;
+	yaw = newYaw;
+	pitch = newPitch;
+
+	update();
+}
+
 glm::vec3 Camera::getCameraPosition() const
 {
 	return position;
@@ -89,6 +100,15 @@ glm::mat4 Camera::calculateViewMatrix() const
 	return glm::lookAt(position, position + front, up);
 }
 
+CameraData Camera::getCameraData(const glm::mat4& projection) const
+{
+	CameraData data;
+	data.projection = projection;
+	data.view = calculateViewMatrix();
+	data.position = glm::vec4(position, 1.0f);
+	return data;
+}
+
 Camera::~Camera()
 {
 	
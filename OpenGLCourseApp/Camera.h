@@ -4,6 +4,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// Layout of the Camera uniform block (std140)
+struct CameraData
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec4 position;
+};
+
 class Camera
 {
 public:
@@ -12,11 +20,13 @@ public:
 
 	void keyControl(const bool *keys, GLfloat deltaTime);
 	void mouseControl(GLfloat xChange, GLfloat yChange);
+	void setPose(glm::vec3 newPosition, GLfloat newYaw, GLfloat newPitch);
 
 	glm::vec3 getCameraPosition() const;
 	glm::vec3 getCameraDirection() const;
 
 	glm::mat4 calculateViewMatrix() const;
+	CameraData getCameraData(const glm::mat4 &projection) const;
 
 	~Camera();
 
@@ -3,7 +3,20 @@
 
 #include "stb_image.h"
 
-constexpr int MAX_POINT_LIGHTS = 3;
-constexpr int MAX_SPOT_LIGHTS = 3;
+// Point and spot lights are shaded through the light clusters, so these only bound the light buffers
+constexpr int MAX_POINT_LIGHTS = 1024;
+constexpr int MAX_SPOT_LIGHTS = 1024;
+
+// Only a few lights get shadow maps
+constexpr int MAX_OMNI_SHADOWS = 3;
+constexpr int MAX_SPOT_SHADOWS = 3;
+
+// Instance matrices streamed per frame, summed over all passes
+constexpr int MAX_INSTANCES_PER_FRAME = 65536;
+
+// Uniform block binding points, the blocks are filled once per frame and shared by every program
+constexpr int CAMERA_BLOCK_BINDING = 0;
+constexpr int DIRECTIONAL_LIGHT_BLOCK_BINDING = 1;
+constexpr int OMNI_SHADOW_BLOCK_BINDING = 2;
 
 #endif
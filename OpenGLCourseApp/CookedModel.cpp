@@ -0,0 +1,381 @@
+#include "CookedModel.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace
+{
+	const char COOKED_MAGIC[4] = { 'O', 'G', 'L', 'M' };
+}
+
+static_assert(sizeof(CookedMesh) == 88, "CookedMesh is written to disk as is");
+static_assert(sizeof(CookedNode) == 76, "CookedNode is written to disk as is");
+static_assert(sizeof(Meshlet) == 40, "Meshlet is written to disk as is");
+
+CookedModel::CookedModel(VertexFormat vertexFormat) :
+	meshes(nullptr),
+	nodes(nullptr),
+	materials(nullptr),
+	meshlets(nullptr),
+	vertices(nullptr),
+	indices(nullptr),
+	meshCount(0),
+	nodeCount(0),
+	materialCount(0),
+	format(vertexFormat),
+	vertexSize(VertexLayout::GetVertexSize(vertexFormat))
+{}
+
+std::string CookedModel::GetCookedFileName(const std::string& sourceFileName)
+{
+	return sourceFileName + ".cooked";
+}
+
+bool CookedModel::Open(const std::string& cookedFileName, const std::string& sourceFileName)
+{
+	if (!file.Open(cookedFileName))
+	{
+		return false;
+	}
+
+	const GLubyte *data = static_cast<const GLubyte*>(file.GetData());
+	const size_t size = file.GetSize();
+
+	Header header;
+	if (size < sizeof(header))
+	{
+		file.Close();
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) != 0 || header.version != VERSION ||
+		header.vertexFormat != static_cast<uint32_t>(format))
+	{
+		file.Close();
+		return false;
+	}
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (GetSourceStamp(sourceFileName, sourceSize, sourceTime) &&
+		(sourceSize != header.sourceSize || sourceTime != header.sourceTime))
+	{
+		file.Close();
+		return false;
+	}
+
+	// A file cut short by a failed write is rejected here rather than read past its end
+	const size_t meshOffset = sizeof(Header);
+	const size_t nodeOffset = meshOffset + sizeof(CookedMesh) * header.meshCount;
+	const size_t materialOffset = nodeOffset + sizeof(CookedNode) * header.nodeCount;
+	const size_t meshletOffset = materialOffset + sizeof(Material) * header.materialCount;
+	const size_t vertexOffset = meshletOffset + sizeof(Meshlet) * header.meshletCount;
+	const size_t indexOffset = vertexOffset + static_cast<size_t>(vertexSize) * header.vertexCount;
+	if (size != indexOffset + sizeof(unsigned int) * header.indexCount)
+	{
+		file.Close();
+		return false;
+	}
+
+	meshes = reinterpret_cast<const CookedMesh*>(data + meshOffset);
+	nodes = reinterpret_cast<const CookedNode*>(data + nodeOffset);
+	materials = reinterpret_cast<const Material*>(data + materialOffset);
+	meshlets = reinterpret_cast<const Meshlet*>(data + meshletOffset);
+	vertices = data + vertexOffset;
+	indices = reinterpret_cast<const unsigned int*>(data + indexOffset);
+	meshCount = header.meshCount;
+	nodeCount = header.nodeCount;
+	materialCount = header.materialCount;
+
+	for (size_t i = 0; i < meshCount; i++)
+	{
+		const CookedMesh &mesh = meshes[i];
+		bool valid = static_cast<uint64_t>(mesh.firstVertex) + mesh.vertexCount <= header.vertexCount &&
+			static_cast<uint64_t>(mesh.firstIndex) + mesh.indexCount <= header.indexCount &&
+			mesh.lodCount >= 1 && mesh.lodCount <= Mesh::MAX_LODS &&
+			mesh.lodIndexCount[0] <= mesh.indexCount &&
+			static_cast<uint64_t>(mesh.firstMeshlet) + mesh.meshletCount <= header.meshletCount;
+		// Meshlets are built from the full detail triangles, the LODs appended after them have none
+		for (uint32_t j = 0; valid && j < mesh.meshletCount; j++)
+		{
+			const Meshlet &meshlet = meshlets[mesh.firstMeshlet + j];
+			valid = static_cast<uint64_t>(meshlet.firstIndex) + meshlet.indexCount <= mesh.lodIndexCount[0];
+		}
+
+		if (!valid)
+		{
+			file.Close();
+			meshCount = 0;
+			nodeCount = 0;
+			materialCount = 0;
+			return false;
+		}
+	}
+
+	// Every parent has to be on the path to the node before, as TransformHierarchy needs them
+	std::vector<int32_t> path;
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		const CookedNode &node = nodes[i];
+		while (!path.empty() && path.back() != node.parent)
+		{
+			path.pop_back();
+		}
+
+		if ((node.parent != -1 && path.empty()) || static_cast<uint64_t>(node.firstMesh) + node.meshCount > meshCount)
+		{
+			file.Close();
+			meshCount = 0;
+			nodeCount = 0;
+			materialCount = 0;
+			return false;
+		}
+		path.push_back(static_cast<int32_t>(i));
+	}
+
+	return true;
+}
+
+bool CookedModel::Write(const std::string& cookedFileName, const std::string& sourceFileName) const
+{
+	Header header;
+	memcpy(header.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+	header.version = VERSION;
+	if (!GetSourceStamp(sourceFileName, header.sourceSize, header.sourceTime))
+	{
+		header.sourceSize = 0;
+		header.sourceTime = 0;
+	}
+	header.meshCount = static_cast<uint32_t>(meshList.size());
+	header.materialCount = static_cast<uint32_t>(materialList.size());
+	header.vertexCount = static_cast<uint32_t>(vertexData.size() / vertexSize);
+	header.indexCount = static_cast<uint32_t>(indexData.size());
+	header.vertexFormat = static_cast<uint32_t>(format);
+	header.meshletCount = static_cast<uint32_t>(meshletList.size());
+	header.nodeCount = static_cast<uint32_t>(nodeList.size());
+	header.padding = 0;
+
+	// Written next to the old file and swapped in, so a crash halfway never leaves a broken cooked file behind
+	const std::string tempFileName = cookedFileName + ".tmp";
+	FILE *out = fopen(tempFileName.c_str(), "wb");
+	if (!out)
+	{
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+	written = written && fwrite(meshList.data(), sizeof(CookedMesh), meshList.size(), out) == meshList.size();
+	written = written && fwrite(nodeList.data(), sizeof(CookedNode), nodeList.size(), out) == nodeList.size();
+	written = written && fwrite(materialList.data(), sizeof(Material), materialList.size(), out) == materialList.size();
+	written = written && fwrite(meshletList.data(), sizeof(Meshlet), meshletList.size(), out) == meshletList.size();
+	written = written && fwrite(vertexData.data(), 1, vertexData.size(), out) == vertexData.size();
+	written = written && fwrite(indexData.data(), sizeof(unsigned int), indexData.size(), out) == indexData.size();
+	written = fclose(out) == 0 && written;
+
+	if (!written)
+	{
+		remove(tempFileName.c_str());
+		return false;
+	}
+
+	// rename doesn't replace existing files on Windows
+	remove(cookedFileName.c_str());
+	return rename(tempFileName.c_str(), cookedFileName.c_str()) == 0;
+}
+
+void CookedModel::AddMesh(const GLfloat* meshVertices, GLsizei numOfVertices, const unsigned int* meshIndices,
+	GLsizei numOfIndices, unsigned materialIndex, const MeshLod* lods, size_t lodCount, const Meshlet* meshMeshlets,
+	size_t meshletCount)
+{
+	const GLsizei vertexCount = numOfVertices / VertexLayout::FLOATS_PER_VERTEX;
+
+	CookedMesh mesh;
+	mesh.firstVertex = static_cast<uint32_t>(vertexData.size() / vertexSize);
+	mesh.vertexCount = static_cast<uint32_t>(vertexCount);
+	mesh.firstIndex = static_cast<uint32_t>(indexData.size());
+	mesh.indexCount = static_cast<uint32_t>(numOfIndices);
+	mesh.materialIndex = materialIndex;
+
+	// Levels are stored back to back, so only their sizes are needed
+	memset(mesh.lodIndexCount, 0, sizeof(mesh.lodIndexCount));
+	memset(mesh.lodError, 0, sizeof(mesh.lodError));
+	mesh.lodCount = 0;
+	for (size_t i = 0; lods && i < lodCount && i < Mesh::MAX_LODS; i++)
+	{
+		mesh.lodIndexCount[i] = static_cast<uint32_t>(lods[i].indexCount);
+		mesh.lodError[i] = lods[i].error;
+		mesh.lodCount++;
+	}
+	if (mesh.lodCount == 0)
+	{
+		mesh.lodIndexCount[0] = mesh.indexCount;
+		mesh.lodCount = 1;
+	}
+
+	mesh.firstMeshlet = static_cast<uint32_t>(meshletList.size());
+	mesh.meshletCount = meshMeshlets ? static_cast<uint32_t>(meshletCount) : 0;
+	if (meshMeshlets)
+	{
+		meshletList.insert(meshletList.end(), meshMeshlets, meshMeshlets + meshletCount);
+	}
+
+	AABB bounds;
+	for (GLsizei i = 0; i + 2 < numOfVertices; i += VertexLayout::FLOATS_PER_VERTEX)
+	{
+		bounds.AddPoint(glm::vec3(meshVertices[i], meshVertices[i + 1], meshVertices[i + 2]));
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		mesh.boundsMin[i] = bounds.min[i];
+		mesh.boundsMax[i] = bounds.max[i];
+	}
+
+	// Quantized formats are encoded against the bounds, which are stored with the mesh for decoding
+	const size_t encodedOffset = vertexData.size();
+	vertexData.resize(encodedOffset + static_cast<size_t>(vertexCount) * vertexSize);
+	VertexLayout::Encode(format, meshVertices, vertexCount, bounds, vertexData.data() + encodedOffset);
+	indexData.insert(indexData.end(), meshIndices, meshIndices + numOfIndices);
+	meshList.push_back(mesh);
+
+	UseBuiltData();
+}
+
+void CookedModel::AddNode(int32_t parent, const glm::mat4& transform, uint32_t meshCount)
+{
+	CookedNode node;
+	node.parent = parent;
+	node.firstMesh = static_cast<uint32_t>(meshList.size()) - meshCount;
+	node.meshCount = meshCount;
+	memcpy(node.transform, &transform[0][0], sizeof(node.transform));
+	nodeList.push_back(node);
+
+	UseBuiltData();
+}
+
+void CookedModel::AddMaterial(const std::string& textureName)
+{
+	Material material;
+	memset(material.textureName, 0, sizeof(material.textureName));
+	if (textureName.size() >= TEXTURE_NAME_SIZE)
+	{
+		printf("Texture name too long to cook, using the plain texture: %s\n", textureName.c_str());
+	}
+	else
+	{
+		memcpy(material.textureName, textureName.c_str(), textureName.size());
+	}
+	materialList.push_back(material);
+
+	UseBuiltData();
+}
+
+size_t CookedModel::GetMeshCount() const
+{
+	return meshCount;
+}
+
+const CookedMesh& CookedModel::GetMesh(size_t mesh) const
+{
+	return meshes[mesh];
+}
+
+const void* CookedModel::GetVertices(const CookedMesh& mesh) const
+{
+	return vertices + static_cast<size_t>(mesh.firstVertex) * vertexSize;
+}
+
+const unsigned int* CookedModel::GetIndices(const CookedMesh& mesh) const
+{
+	return indices + mesh.firstIndex;
+}
+
+AABB CookedModel::GetBounds(const CookedMesh& mesh)
+{
+	return AABB(glm::vec3(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]),
+		glm::vec3(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]));
+}
+
+size_t CookedModel::GetLods(const CookedMesh& mesh, MeshLod* lods)
+{
+	GLuint firstIndex = 0;
+	size_t lodCount = 0;
+	for (uint32_t i = 0; i < mesh.lodCount && i < Mesh::MAX_LODS; i++)
+	{
+		// A damaged table must not reach past the mesh's indices
+		if (static_cast<uint64_t>(firstIndex) + mesh.lodIndexCount[i] > mesh.indexCount)
+		{
+			break;
+		}
+
+		lods[lodCount].firstIndex = firstIndex;
+		lods[lodCount].indexCount = static_cast<GLsizei>(mesh.lodIndexCount[i]);
+		lods[lodCount].error = mesh.lodError[i];
+		firstIndex += mesh.lodIndexCount[i];
+		lodCount++;
+	}
+	return lodCount;
+}
+
+const Meshlet* CookedModel::GetMeshlets(const CookedMesh& mesh) const
+{
+	return meshlets + mesh.firstMeshlet;
+}
+
+size_t CookedModel::GetNodeCount() const
+{
+	return nodeCount;
+}
+
+const CookedNode& CookedModel::GetNode(size_t node) const
+{
+	return nodes[node];
+}
+
+glm::mat4 CookedModel::GetTransform(const CookedNode& node)
+{
+	glm::mat4 transform;
+	memcpy(&transform[0][0], node.transform, sizeof(node.transform));
+	return transform;
+}
+
+size_t CookedModel::GetMaterialCount() const
+{
+	return materialCount;
+}
+
+std::string CookedModel::GetTextureName(size_t material) const
+{
+	const char *name = materials[material].textureName;
+	return std::string(name, strnlen(name, TEXTURE_NAME_SIZE));
+}
+
+bool CookedModel::GetSourceStamp(const std::string& sourceFileName, uint64_t& size, int64_t& time)
+{
+	struct stat sourceStat;
+	if (stat(sourceFileName.c_str(), &sourceStat) != 0)
+	{
+		return false;
+	}
+
+	size = static_cast<uint64_t>(sourceStat.st_size);
+	time = static_cast<int64_t>(sourceStat.st_mtime);
+	return true;
+}
+
+void CookedModel::UseBuiltData()
+{
+	file.Close();
+
+	meshes = meshList.data();
+	nodes = nodeList.data();
+	materials = materialList.data();
+	meshlets = meshletList.data();
+	vertices = vertexData.data();
+	indices = indexData.data();
+	meshCount = meshList.size();
+	nodeCount = nodeList.size();
+	materialCount = materialList.size();
+}
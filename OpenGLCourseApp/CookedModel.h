@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "VertexFormat.h"
+
+// One mesh of a cooked model, the ranges index the vertices and indices shared by all meshes. The index range holds
+// every level of detail in order, each one lodIndexCount indices long
+struct CookedMesh
+{
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t materialIndex;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t lodCount;
+	uint32_t lodIndexCount[Mesh::MAX_LODS];
+	float lodError[Mesh::MAX_LODS];
+	// Range of the model's meshlet table, meshlet index ranges are relative to the mesh's first index
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+// One node of the model's tree, depth first so parents come before children. The node's meshes are the range
+// [firstMesh, firstMesh + meshCount) of the mesh table
+struct CookedNode
+{
+	int32_t parent;
+	uint32_t firstMesh;
+	uint32_t meshCount;
+	// Relative to the parent, column major
+	float transform[16];
+};
+
+// A model in the layout the renderer uses, written once from what Assimp imports and mapped straight from disk
+// after that. The file is a header, the mesh table, the node table, the material table, the meshlet table, then the
+// vertices of all meshes encoded in the model's vertex format and their 32 bit indices, exactly as glBufferData
+// takes them
+class CookedModel
+{
+public:
+	static constexpr uint32_t VERSION = 7;
+	static constexpr size_t TEXTURE_NAME_SIZE = 128;
+
+	explicit CookedModel(VertexFormat format);
+
+	static std::string GetCookedFileName(const std::string &sourceFileName);
+
+	// Fails if the cooked file is missing, truncated, of another version or vertex format, or was cooked from a
+	// different version of the source. Without the source file around, any valid cooked file is used
+	bool Open(const std::string &cookedFileName, const std::string &sourceFileName);
+	bool Write(const std::string &cookedFileName, const std::string &sourceFileName) const;
+
+	// Building a model to write, numOfVertices counts floats like Mesh::CreateMesh. The vertices are encoded here.
+	// indices and lods are laid out like for Mesh::CreateEncodedMesh
+	void AddMesh(const GLfloat *vertices, GLsizei numOfVertices, const unsigned int *indices, GLsizei numOfIndices,
+		unsigned materialIndex, const MeshLod *lods = nullptr, size_t lodCount = 0, const Meshlet *meshlets = nullptr,
+		size_t meshletCount = 0);
+	// Parent is -1 or an earlier node on the path to the last one added, the node holds the meshCount meshes added
+	// last
+	void AddNode(int32_t parent, const glm::mat4 &transform, uint32_t meshCount);
+	// Empty name for materials without a diffuse texture
+	void AddMaterial(const std::string &textureName);
+
+	size_t GetMeshCount() const;
+	const CookedMesh &GetMesh(size_t mesh) const;
+	const void *GetVertices(const CookedMesh &mesh) const;
+	const unsigned int *GetIndices(const CookedMesh &mesh) const;
+	static AABB GetBounds(const CookedMesh &mesh);
+	// Fills lods with Mesh::MAX_LODS entries at most and returns how many there are
+	static size_t GetLods(const CookedMesh &mesh, MeshLod *lods);
+	const Meshlet *GetMeshlets(const CookedMesh &mesh) const;
+
+	size_t GetNodeCount() const;
+	const CookedNode &GetNode(size_t node) const;
+	static glm::mat4 GetTransform(const CookedNode &node);
+
+	size_t GetMaterialCount() const;
+	std::string GetTextureName(size_t material) const;
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		// Size and modification time of the source when it was cooked, a mismatch means the cooked file is stale
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint32_t meshCount;
+		uint32_t materialCount;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t vertexFormat;
+		uint32_t meshletCount;
+		uint32_t nodeCount;
+		uint32_t padding;
+	};
+
+	struct Material
+	{
+		char textureName[TEXTURE_NAME_SIZE];
+	};
+
+	static bool GetSourceStamp(const std::string &sourceFileName, uint64_t &size, int64_t &time);
+
+	// Either points into the mapped file, or into the vectors below while building
+	const CookedMesh *meshes;
+	const CookedNode *nodes;
+	const Material *materials;
+	const Meshlet *meshlets;
+	const GLubyte *vertices;
+	const unsigned int *indices;
+	size_t meshCount, nodeCount, materialCount;
+
+	VertexFormat format;
+	GLsizei vertexSize;
+
+	MappedFile file;
+
+	std::vector<CookedMesh> meshList;
+	std::vector<CookedNode> nodeList;
+	std::vector<Material> materialList;
+	std::vector<Meshlet> meshletList;
+	std::vector<GLubyte> vertexData;
+	std::vector<unsigned int> indexData;
+
+	void UseBuiltData();
+};
@@ -1,5 +1,7 @@
 #include "DirectionalLight.h"
 
+static_assert(sizeof(DirectionalLightData) == 96, "DirectionalLightData doesn't match the std140 layout");
+
 DirectionalLight::DirectionalLight() :
 	Light(),
 	direction(glm::vec3(0.0f, -1.0f, 0.0f))
@@ -14,17 +16,23 @@ DirectionalLight::DirectionalLight(GLuint shadowWidth, GLuint shadowHeight, GLfl
 	lightProj = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 0.1f, 100.0f);
 }
 
-void DirectionalLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-	GLuint diffuseIntensityLocation, GLuint directionLocation) const
+DirectionalLightData DirectionalLight::GetLightData() const
 {
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
-	glUniform3f(ambientColorLocation, color.x, color.y, color.z);
+	DirectionalLightData data;
+	data.color = color;
+	data.ambientIntensity = ambientIntensity;
+	data.direction = direction;
+	data.diffuseIntensity = diffuseIntensity;
+	data.transform = CalculateLightTransform();
+	return data;
+}
 
-	glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+glm::vec3 DirectionalLight::GetDirection() const
+{
+	return direction;
 }
 
-glm::mat4 DirectionalLight::CalculateLightTransform()
+glm::mat4 DirectionalLight::CalculateLightTransform() const
 {
 	return lightProj * glm::lookAt(-direction, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 }
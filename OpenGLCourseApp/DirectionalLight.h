@@ -1,5 +1,16 @@
 #pragma once
 #include "Light.h"
+
+// Layout of the DirectionalLight uniform block (std140)
+struct DirectionalLightData
+{
+	glm::vec3 color;
+	GLfloat ambientIntensity;
+	glm::vec3 direction;
+	GLfloat diffuseIntensity;
+	glm::mat4 transform;
+};
+
 class DirectionalLight :
     public Light
 {
@@ -11,10 +22,10 @@ public:
 		GLfloat aIntensity, GLfloat dIntensity, 
 		GLfloat xDir, GLfloat yDir, GLfloat zDir);
 
-	void UseLight(GLuint ambientIntensityLocation, GLuint colorLocation,
-					GLuint diffuseIntensityLocation, GLuint directionLocation) const;
+	DirectionalLightData GetLightData() const;
+	glm::vec3 GetDirection() const;
 
-	glm::mat4 CalculateLightTransform();
+	glm::mat4 CalculateLightTransform() const;
 private:
 	glm::vec3 direction;
 };
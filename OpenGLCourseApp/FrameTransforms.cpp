@@ -0,0 +1,90 @@
+#include "FrameTransforms.h"
+
+#include <cstring>
+
+#include <emmintrin.h>
+
+namespace
+{
+	// (a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0) of the xyz lanes
+	__m128 Cross(__m128 a, __m128 b)
+	{
+		const __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+
+	__m128 Dot3(__m128 a, __m128 b)
+	{
+		const __m128 product = _mm_mul_ps(a, b);
+		const __m128 y = _mm_shuffle_ps(product, product, _MM_SHUFFLE(1, 1, 1, 1));
+		const __m128 z = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 2, 2, 2));
+		const __m128 x = _mm_shuffle_ps(product, product, _MM_SHUFFLE(0, 0, 0, 0));
+		return _mm_add_ps(_mm_add_ps(x, y), z);
+	}
+}
+
+FrameTransforms::FrameTransforms()
+{}
+
+void FrameTransforms::Update(const TransformHierarchy& hierarchy)
+{
+	// New nodes are always dirty, so they are in the updated ranges too
+	worlds.resize(hierarchy.GetNodeCount());
+	normals.resize(hierarchy.GetNodeCount());
+
+	for (const TransformRange &range : hierarchy.GetUpdatedRanges())
+	{
+		memcpy(&worlds[range.first], hierarchy.GetWorlds() + range.first, sizeof(glm::mat4) * range.count);
+		DeriveNormals(range.first, range.first + range.count);
+	}
+}
+
+void FrameTransforms::DeriveNormals(GLuint first, GLuint end)
+{
+	// For the columns a, b and c of the upper 3x3, the inverse transpose is (b x c, c x a, a x b) / det, with
+	// det = a . (b x c). The w lanes of the loaded columns drop out of the cross products
+	for (GLuint i = first; i < end; i++)
+	{
+		const GLfloat *world = &worlds[i][0][0];
+		const __m128 a = _mm_loadu_ps(world);
+		const __m128 b = _mm_loadu_ps(world + 4);
+		const __m128 c = _mm_loadu_ps(world + 8);
+
+		const __m128 bc = Cross(b, c);
+		const __m128 ca = Cross(c, a);
+		const __m128 ab = Cross(a, b);
+		const __m128 determinant = Dot3(a, bc);
+		// Singular matrices flatten everything anyway, their normals are left unscaled instead of infinite
+		const __m128 valid = _mm_cmpneq_ps(determinant, _mm_setzero_ps());
+		const __m128 scale = _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1.0f), determinant)),
+			_mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+
+		GLfloat columns[12];
+		_mm_storeu_ps(columns, _mm_mul_ps(bc, scale));
+		_mm_storeu_ps(columns + 4, _mm_mul_ps(ca, scale));
+		_mm_storeu_ps(columns + 8, _mm_mul_ps(ab, scale));
+
+		GLfloat *normal = &normals[i][0][0];
+		for (int column = 0; column < 3; column++)
+		{
+			memcpy(normal + column * 3, columns + column * 4, sizeof(GLfloat) * 3);
+		}
+	}
+}
+
+const glm::mat4* FrameTransforms::GetWorlds(GLuint firstNode) const
+{
+	return &worlds[firstNode];
+}
+
+const glm::mat3* FrameTransforms::GetNormals(GLuint firstNode) const
+{
+	return &normals[firstNode];
+}
+
+GLuint FrameTransforms::GetCount() const
+{
+	return static_cast<GLuint>(worlds.size());
+}
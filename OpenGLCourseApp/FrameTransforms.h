@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "TransformHierarchy.h"
+
+// World and normal matrices of every node of the scene's hierarchy for one frame, in contiguous arrays indexed by
+// the node. The scene update refreshes them once at the start of the frame, every pass after that only reads them,
+// so animation advances once per frame however many passes draw the scene
+class FrameTransforms
+{
+public:
+	FrameTransforms();
+
+	// Copies the world matrices the hierarchy's last Update recomputed and derives their normal matrices, the
+	// rest are still those of earlier frames
+	void Update(const TransformHierarchy &hierarchy);
+
+	// Consecutive nodes are an instance array
+	const glm::mat4 *GetWorlds(GLuint firstNode) const;
+	const glm::mat3 *GetNormals(GLuint firstNode) const;
+	GLuint GetCount() const;
+
+private:
+	std::vector<glm::mat4> worlds;
+	// Inverse transpose of the upper 3x3 of the world matrix, for normals under non-uniform scale
+	std::vector<glm::mat3> normals;
+
+	void DeriveNormals(GLuint first, GLuint end);
+};
@@ -0,0 +1,100 @@
+#include "Frustum.h"
+
+#include <emmintrin.h>
+
+Frustum::Frustum() :
+	Frustum(glm::mat4(1.0f))
+{}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+	// glm is column major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]) (Gribb & Hartmann)
+	const glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	const glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	const glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	const glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	// Left, right, bottom, top, near, far. Only the sign of the distance matters, so no normalization
+	const glm::vec4 planes[PLANE_COUNT] = {
+		row3 + row0, row3 - row0,
+		row3 + row1, row3 - row1,
+		row3 + row2, row3 - row2,
+		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+	};
+
+	for (int i = 0; i < PLANE_COUNT; i++)
+	{
+		planeX[i] = planes[i].x;
+		planeY[i] = planes[i].y;
+		planeZ[i] = planes[i].z;
+		planeW[i] = planes[i].w;
+	}
+}
+
+bool Frustum::IntersectsBox(const AABB& box) const
+{
+	if (box.IsEmpty())
+	{
+		return false;
+	}
+
+	const glm::vec3 center = box.GetCenter();
+	const glm::vec3 extents = box.GetExtents();
+
+	const __m128 centerX = _mm_set1_ps(center.x);
+	const __m128 centerY = _mm_set1_ps(center.y);
+	const __m128 centerZ = _mm_set1_ps(center.z);
+	const __m128 extentX = _mm_set1_ps(extents.x);
+	const __m128 extentY = _mm_set1_ps(extents.y);
+	const __m128 extentZ = _mm_set1_ps(extents.z);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for (int i = 0; i < PLANE_COUNT; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(planeX + i);
+		const __m128 y = _mm_loadu_ps(planeY + i);
+		const __m128 z = _mm_loadu_ps(planeZ + i);
+		const __m128 w = _mm_loadu_ps(planeW + i);
+
+		// Signed distance of the center plus the box's projected radius onto the plane normal
+		const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, centerX), _mm_mul_ps(y, centerY)),
+			_mm_add_ps(_mm_mul_ps(z, centerZ), w));
+		const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, x), extentX),
+			_mm_mul_ps(_mm_andnot_ps(signMask, y), extentY)), _mm_mul_ps(_mm_andnot_ps(signMask, z), extentZ));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Frustum::IntersectsSphere(glm::vec3 center, GLfloat radius) const
+{
+	const __m128 centerX = _mm_set1_ps(center.x);
+	const __m128 centerY = _mm_set1_ps(center.y);
+	const __m128 centerZ = _mm_set1_ps(center.z);
+	const __m128 sphereRadius = _mm_set1_ps(radius);
+
+	for (int i = 0; i < PLANE_COUNT; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(planeX + i);
+		const __m128 y = _mm_loadu_ps(planeY + i);
+		const __m128 z = _mm_loadu_ps(planeZ + i);
+		const __m128 w = _mm_loadu_ps(planeW + i);
+
+		// The planes aren't normalized, so the radius is scaled by the length of their normals instead
+		const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, centerX), _mm_mul_ps(y, centerY)),
+			_mm_add_ps(_mm_mul_ps(z, centerZ), w));
+		const __m128 normalLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, _mm_mul_ps(sphereRadius, normalLength)), _mm_setzero_ps())) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
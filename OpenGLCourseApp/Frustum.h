@@ -0,0 +1,32 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// Draw counts of the frustum culling, accumulated over all passes until reset
+struct CullingStats
+{
+	unsigned long long submitted;
+	unsigned long long culled;
+};
+
+// Six clip planes extracted from a projection * view matrix, works for both perspective and orthographic
+// projections. The planes are kept as structure of arrays so SSE tests four planes at a time
+class Frustum
+{
+public:
+	Frustum();
+	explicit Frustum(const glm::mat4 &viewProjection);
+
+	// False only if the box is completely outside one of the planes
+	bool IntersectsBox(const AABB &box) const;
+	// False only if the sphere is completely outside one of the planes
+	bool IntersectsSphere(glm::vec3 center, GLfloat radius) const;
+
+private:
+	// Padded to eight planes with ones that accept everything, so two SSE iterations cover all six
+	static constexpr int PLANE_COUNT = 8;
+
+	GLfloat planeX[PLANE_COUNT], planeY[PLANE_COUNT], planeZ[PLANE_COUNT], planeW[PLANE_COUNT];
+};
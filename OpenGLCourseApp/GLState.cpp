@@ -0,0 +1,113 @@
+#include "GLState.h"
+
+GLuint GLState::program = GLState::UNKNOWN;
+GLuint GLState::vertexArray = GLState::UNKNOWN;
+GLuint GLState::framebuffer = GLState::UNKNOWN;
+GLuint GLState::activeUnit = GLState::UNKNOWN;
+GLenum GLState::textureTargets[MAX_TEXTURE_UNITS] = {};
+GLuint GLState::textures[MAX_TEXTURE_UNITS] = {};
+GLint GLState::viewport[4] = { -1, -1, -1, -1 };
+GLStateCounters GLState::counters = {};
+
+void GLState::UseProgram(GLuint newProgram)
+{
+	if (Changed(program != newProgram))
+	{
+		glUseProgram(newProgram);
+		program = newProgram;
+	}
+}
+
+void GLState::BindVertexArray(GLuint newVertexArray)
+{
+	if (Changed(vertexArray != newVertexArray))
+	{
+		glBindVertexArray(newVertexArray);
+		vertexArray = newVertexArray;
+	}
+}
+
+void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	// Units past the cache are always bound
+	const bool cached = unit < MAX_TEXTURE_UNITS;
+	if (!Changed(!cached || textureTargets[unit] != target || textures[unit] != texture))
+	{
+		return;
+	}
+
+	if (Changed(activeUnit != unit))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+	}
+
+	glBindTexture(target, texture);
+
+	// Binding another target leaves the old one bound too, which only costs a redundant bind later
+	if (cached)
+	{
+		textureTargets[unit] = target;
+		textures[unit] = texture;
+	}
+}
+
+void GLState::BindFramebuffer(GLuint newFramebuffer)
+{
+	if (Changed(framebuffer != newFramebuffer))
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, newFramebuffer);
+		framebuffer = newFramebuffer;
+	}
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (Changed(viewport[0] != x || viewport[1] != y || viewport[2] != width || viewport[3] != height))
+	{
+		glViewport(x, y, width, height);
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+	}
+}
+
+void GLState::Invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	framebuffer = UNKNOWN;
+	activeUnit = UNKNOWN;
+
+	for (GLuint i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		textureTargets[i] = 0;
+		textures[i] = UNKNOWN;
+	}
+
+	viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+}
+
+const GLStateCounters& GLState::GetCounters()
+{
+	return counters;
+}
+
+void GLState::ResetCounters()
+{
+	counters = GLStateCounters();
+}
+
+bool GLState::Changed(bool changed)
+{
+	if (changed)
+	{
+		counters.issued++;
+	}
+	else
+	{
+		counters.elided++;
+	}
+	return changed;
+}
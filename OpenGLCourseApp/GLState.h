@@ -0,0 +1,46 @@
+#pragma once
+#include <GL/glew.h>
+
+// Calls that reached the driver and calls that were skipped because they wouldn't have changed anything
+struct GLStateCounters
+{
+	unsigned long long issued;
+	unsigned long long elided;
+};
+
+// Shadow copy of the bindings that change between draws: program, VAO, texture units, framebuffer and
+// viewport. Calls that would set what is already bound are skipped. Everything that changes these has to go
+// through here, and deleting a bound object has to Invalidate, otherwise the cache goes stale
+class GLState
+{
+public:
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vertexArray);
+	// unit is the index of the texture unit, not GL_TEXTURE0 + index
+	static void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	// Binds both the draw and the read framebuffer
+	static void BindFramebuffer(GLuint framebuffer);
+	static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// Forgets all cached bindings, the next call of each kind is always issued
+	static void Invalidate();
+
+	static const GLStateCounters &GetCounters();
+	static void ResetCounters();
+
+private:
+	static constexpr GLuint MAX_TEXTURE_UNITS = 16;
+
+	// Unknown is different from every real binding, object names are never this large
+	static constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+
+	static GLuint program, vertexArray, framebuffer, activeUnit;
+	static GLenum textureTargets[MAX_TEXTURE_UNITS];
+	static GLuint textures[MAX_TEXTURE_UNITS];
+	static GLint viewport[4];
+
+	static GLStateCounters counters;
+
+	// Counts the call and returns whether it has to be issued
+	static bool Changed(bool changed);
+};
@@ -0,0 +1,460 @@
+#include "GeometryPool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+
+static_assert(sizeof(InstanceData) == 136, "InstanceData is read by the vertex attribute formats set in Init");
+
+GeometryPool::GeometryPool() :
+	VAO(0),
+	VBO(0),
+	IBO(0),
+	positionVAO(0),
+	positionVBO(0),
+	format(VertexFormat::Float),
+	vertexSize(0),
+	positionSize(0),
+	vertexCapacity(0),
+	indexCapacity(0)
+{}
+
+void GeometryPool::Init(VertexFormat vertexFormat, GLsizei initialVertexCapacity, GLsizei initialIndexCapacity, bool positionStream)
+{
+	format = vertexFormat;
+	vertexSize = VertexLayout::GetVertexSize(format);
+	positionSize = VertexLayout::GetPositionSize(format);
+
+	glGenVertexArrays(1, &VAO);
+	GLState::BindVertexArray(VAO);
+
+	// Position, uv and normal, all from the pool's vertex buffer
+	VertexLayout::SetAttributeFormats(format, VERTEX_BINDING);
+	SetInstanceFormats();
+
+	if (positionStream)
+	{
+		// Same vertex binding and instance attributes, positions come from their own buffer. Reallocate gives
+		// it the buffers
+		glGenVertexArrays(1, &positionVAO);
+		GLState::BindVertexArray(positionVAO);
+		VertexLayout::SetPositionFormat(format, VERTEX_BINDING);
+		SetInstanceFormats();
+	}
+
+	Reallocate(initialVertexCapacity, initialIndexCapacity);
+}
+
+void GeometryPool::SetInstanceFormats()
+{
+	// Model matrix, one column per attribute, advancing once per instance
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glVertexAttribFormat(INSTANCE_ATTRIBUTE + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4) * i);
+		glVertexAttribBinding(INSTANCE_ATTRIBUTE + i, INSTANCE_BINDING);
+		glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + i);
+	}
+	for (GLuint i = 0; i < 3; i++)
+	{
+		glVertexAttribFormat(NORMAL_MATRIX_ATTRIBUTE + i, 3, GL_FLOAT, GL_FALSE,
+			static_cast<GLuint>(offsetof(InstanceData, normalMatrix) + sizeof(glm::vec3) * i));
+		glVertexAttribBinding(NORMAL_MATRIX_ATTRIBUTE + i, INSTANCE_BINDING);
+		glEnableVertexAttribArray(NORMAL_MATRIX_ATTRIBUTE + i);
+	}
+
+	// Position decode, material and face mask of the instance's draw
+	glVertexAttribFormat(VertexLayout::POSITION_SCALE_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, offsetof(InstanceData, positionScale));
+	glVertexAttribFormat(VertexLayout::POSITION_OFFSET_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, offsetof(InstanceData, positionOffset));
+	glVertexAttribFormat(MATERIAL_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, offsetof(InstanceData, material));
+	glVertexAttribIFormat(FACE_MASK_ATTRIBUTE, 1, GL_INT, offsetof(InstanceData, faceMask));
+	const GLuint drawAttributes[] = { VertexLayout::POSITION_SCALE_ATTRIBUTE, VertexLayout::POSITION_OFFSET_ATTRIBUTE,
+		MATERIAL_ATTRIBUTE, FACE_MASK_ATTRIBUTE };
+	for (GLuint attribute : drawAttributes)
+	{
+		glVertexAttribBinding(attribute, INSTANCE_BINDING);
+		glEnableVertexAttribArray(attribute);
+	}
+	glVertexBindingDivisor(INSTANCE_BINDING, 1);
+}
+
+GLuint GeometryPool::Allocate(const void* vertices, GLsizei vertexCount, const unsigned int* indices, GLsizei numOfIndices)
+{
+	const GLenum indexType = GetIndexType(vertexCount);
+	const GLsizei indexWords = GetIndexWords(indexType, numOfIndices);
+
+	GLuint firstVertex, firstIndexWord;
+	bool fits = TakeRange(freeVertices, vertexCount, firstVertex);
+	if (fits && !TakeRange(freeIndices, indexWords, firstIndexWord))
+	{
+		ReturnRange(freeVertices, firstVertex, vertexCount);
+		fits = false;
+	}
+
+	if (!fits)
+	{
+		// Growing also compacts, so everything free is one range at the end afterwards
+		Reallocate(std::max(vertexCapacity * 2, vertexCapacity + vertexCount), std::max(indexCapacity * 2, indexCapacity + indexWords));
+		if (!TakeRange(freeVertices, vertexCount, firstVertex) || !TakeRange(freeIndices, indexWords, firstIndexWord))
+		{
+			throw std::runtime_error("Geometry pool failed to grow");
+		}
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(firstVertex) * vertexSize, vertexCount * vertexSize, vertices);
+	if (positionVBO != 0)
+	{
+		positionScratch.resize(static_cast<size_t>(vertexCount) * positionSize);
+		VertexLayout::ExtractPositions(format, vertices, vertexCount, positionScratch.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, positionVBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(firstVertex) * positionSize, vertexCount * positionSize,
+			positionScratch.data());
+	}
+	// Not through GL_ELEMENT_ARRAY_BUFFER, that would change the index buffer of whatever VAO is bound
+	const GLsizei indexSize = GetIndexSize(indexType);
+	const void *indexData = indices;
+	if (indexType != GL_UNSIGNED_INT)
+	{
+		indexScratch.resize(static_cast<size_t>(numOfIndices) * indexSize);
+		for (GLsizei i = 0; i < numOfIndices; i++)
+		{
+			if (indexType == GL_UNSIGNED_BYTE)
+			{
+				indexScratch[i] = static_cast<GLubyte>(indices[i]);
+			}
+			else
+			{
+				const GLushort index = static_cast<GLushort>(indices[i]);
+				memcpy(&indexScratch[i * sizeof(GLushort)], &index, sizeof(index));
+			}
+		}
+		indexData = indexScratch.data();
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(firstIndexWord) * sizeof(GLuint), numOfIndices * indexSize, indexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	GeometryAllocation allocation;
+	allocation.baseVertex = static_cast<GLint>(firstVertex);
+	allocation.vertexCount = vertexCount;
+	allocation.indexType = indexType;
+	allocation.indexOffset = firstIndexWord * sizeof(GLuint);
+	allocation.indexCount = numOfIndices;
+	allocation.live = true;
+
+	if (!freeHandles.empty())
+	{
+		const GLuint handle = freeHandles.back();
+		freeHandles.pop_back();
+		allocations[handle] = allocation;
+		return handle;
+	}
+
+	allocations.push_back(allocation);
+	return static_cast<GLuint>(allocations.size() - 1);
+}
+
+void GeometryPool::Free(GLuint allocation)
+{
+	GeometryAllocation &freed = allocations[allocation];
+	if (!freed.live)
+	{
+		return;
+	}
+
+	ReturnRange(freeVertices, static_cast<GLuint>(freed.baseVertex), freed.vertexCount);
+	ReturnRange(freeIndices, freed.indexOffset / sizeof(GLuint), GetIndexWords(freed.indexType, freed.indexCount));
+	freed.live = false;
+	freeHandles.push_back(allocation);
+}
+
+void GeometryPool::Compact()
+{
+	Reallocate(vertexCapacity, indexCapacity);
+}
+
+void GeometryPool::Bind() const
+{
+	GLState::BindVertexArray(VAO);
+}
+
+void GeometryPool::BindInstances(GLuint buffer, GLintptr offset, bool positionOnly) const
+{
+	GLState::BindVertexArray(positionOnly && positionVAO != 0 ? positionVAO : VAO);
+	glBindVertexBuffer(INSTANCE_BINDING, buffer, offset, sizeof(InstanceData));
+}
+
+void GeometryPool::Draw(GLuint allocation, GLsizei instanceCount, GLuint firstIndex, GLsizei indexCount) const
+{
+	const GeometryAllocation &range = allocations[allocation];
+	const uintptr_t offset = range.indexOffset + static_cast<uintptr_t>(firstIndex) * GetIndexSize(range.indexType);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, range.indexType,
+		reinterpret_cast<void*>(offset), instanceCount, range.baseVertex);
+}
+
+DrawElementsIndirectCommand GeometryPool::MakeDrawCommand(GLuint allocation, GLuint firstIndex, GLsizei indexCount,
+	GLsizei instanceCount, GLuint baseInstance) const
+{
+	// Index offsets are multiples of 4 bytes, so they are whole indices of every type
+	const GeometryAllocation &range = allocations[allocation];
+
+	DrawElementsIndirectCommand command;
+	command.count = static_cast<GLuint>(indexCount);
+	command.instanceCount = static_cast<GLuint>(instanceCount);
+	command.firstIndex = range.indexOffset / GetIndexSize(range.indexType) + firstIndex;
+	command.baseVertex = range.baseVertex;
+	command.baseInstance = baseInstance;
+	return command;
+}
+
+void GeometryPool::MultiDrawIndirect(GLenum indexType, GLintptr commandOffset, GLsizei drawCount) const
+{
+	glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, reinterpret_cast<const void*>(commandOffset), drawCount,
+		sizeof(DrawElementsIndirectCommand));
+}
+
+const GeometryAllocation& GeometryPool::GetAllocation(GLuint allocation) const
+{
+	return allocations[allocation];
+}
+
+GLuint GeometryPool::GetVertexArrayId() const
+{
+	return VAO;
+}
+
+VertexFormat GeometryPool::GetFormat() const
+{
+	return format;
+}
+
+bool GeometryPool::HasPositionStream() const
+{
+	return positionVAO != 0;
+}
+
+GLenum GeometryPool::GetIndexType(GLsizei vertexCount)
+{
+	if (vertexCount <= 0x100)
+	{
+		return GL_UNSIGNED_BYTE;
+	}
+	if (vertexCount <= 0x10000)
+	{
+		return GL_UNSIGNED_SHORT;
+	}
+	return GL_UNSIGNED_INT;
+}
+
+GLsizei GeometryPool::GetIndexSize(GLenum indexType)
+{
+	switch (indexType)
+	{
+	case GL_UNSIGNED_BYTE:
+		return sizeof(GLubyte);
+	case GL_UNSIGNED_SHORT:
+		return sizeof(GLushort);
+	default:
+		return sizeof(GLuint);
+	}
+}
+
+GLsizei GeometryPool::GetIndexWords(GLenum indexType, GLsizei indexCount)
+{
+	return (indexCount * GetIndexSize(indexType) + sizeof(GLuint) - 1) / sizeof(GLuint);
+}
+
+void GeometryPool::ClearPool()
+{
+	if (IBO != 0)
+	{
+		glDeleteBuffers(1, &IBO);
+		IBO = 0;
+	}
+	if (VBO != 0)
+	{
+		glDeleteBuffers(1, &VBO);
+		VBO = 0;
+	}
+	if (positionVBO != 0)
+	{
+		glDeleteBuffers(1, &positionVBO);
+		positionVBO = 0;
+	}
+	if (positionVAO != 0)
+	{
+		glDeleteVertexArrays(1, &positionVAO);
+		positionVAO = 0;
+	}
+	if (VAO != 0)
+	{
+		glDeleteVertexArrays(1, &VAO);
+		VAO = 0;
+		GLState::Invalidate();
+	}
+
+	vertexCapacity = 0;
+	indexCapacity = 0;
+	allocations.clear();
+	freeHandles.clear();
+	freeVertices.clear();
+	freeIndices.clear();
+}
+
+GeometryPool::~GeometryPool()
+{
+	ClearPool();
+}
+
+bool GeometryPool::TakeRange(std::vector<FreeRange>& freeList, GLsizei count, GLuint& first)
+{
+	for (size_t i = 0; i < freeList.size(); i++)
+	{
+		if (freeList[i].count >= count)
+		{
+			first = freeList[i].first;
+			freeList[i].first += count;
+			freeList[i].count -= count;
+			if (freeList[i].count == 0)
+			{
+				freeList.erase(freeList.begin() + i);
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void GeometryPool::ReturnRange(std::vector<FreeRange>& freeList, GLuint first, GLsizei count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	auto next = std::lower_bound(freeList.begin(), freeList.end(), first,
+		[](const FreeRange &range, GLuint value) { return range.first < value; });
+
+	// Merge with the range before and after, if they touch
+	if (next != freeList.begin())
+	{
+		auto previous = next - 1;
+		if (previous->first + previous->count == first)
+		{
+			previous->count += count;
+			if (next != freeList.end() && previous->first + previous->count == next->first)
+			{
+				previous->count += next->count;
+				freeList.erase(next);
+			}
+			return;
+		}
+	}
+
+	if (next != freeList.end() && first + count == next->first)
+	{
+		next->first = first;
+		next->count += count;
+		return;
+	}
+
+	FreeRange range;
+	range.first = first;
+	range.count = count;
+	freeList.insert(next, range);
+}
+
+void GeometryPool::Reallocate(GLsizei newVertexCapacity, GLsizei newIndexCapacity)
+{
+	GLuint newVBO, newIBO;
+	glGenBuffers(1, &newVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newVertexCapacity) * vertexSize, nullptr, GL_STATIC_DRAW);
+	glGenBuffers(1, &newIBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newIBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newIndexCapacity) * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+	GLuint newPositionVBO = 0;
+	if (positionVAO != 0)
+	{
+		glGenBuffers(1, &newPositionVBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newPositionVBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newVertexCapacity) * positionSize, nullptr, GL_STATIC_DRAW);
+	}
+
+	// GPU side copies of every live range, in allocation order
+	GLuint nextVertex = 0, nextIndexWord = 0;
+	for (size_t i = 0; i < allocations.size(); i++)
+	{
+		GeometryAllocation &allocation = allocations[i];
+		if (!allocation.live)
+		{
+			continue;
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.baseVertex) * vertexSize,
+			static_cast<GLintptr>(nextVertex) * vertexSize, allocation.vertexCount * vertexSize);
+		if (newPositionVBO != 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, positionVBO);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, newPositionVBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.baseVertex) * positionSize,
+				static_cast<GLintptr>(nextVertex) * positionSize, allocation.vertexCount * positionSize);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, IBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newIBO);
+		const GLsizei indexWords = GetIndexWords(allocation.indexType, allocation.indexCount);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.indexOffset,
+			static_cast<GLintptr>(nextIndexWord) * sizeof(GLuint), indexWords * sizeof(GLuint));
+
+		allocation.baseVertex = static_cast<GLint>(nextVertex);
+		allocation.indexOffset = nextIndexWord * sizeof(GLuint);
+		nextVertex += allocation.vertexCount;
+		nextIndexWord += indexWords;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (VBO != 0)
+	{
+		glDeleteBuffers(1, &VBO);
+	}
+	if (IBO != 0)
+	{
+		glDeleteBuffers(1, &IBO);
+	}
+	if (positionVBO != 0)
+	{
+		glDeleteBuffers(1, &positionVBO);
+	}
+	VBO = newVBO;
+	IBO = newIBO;
+	positionVBO = newPositionVBO;
+	vertexCapacity = newVertexCapacity;
+	indexCapacity = newIndexCapacity;
+
+	freeVertices.clear();
+	freeIndices.clear();
+	ReturnRange(freeVertices, nextVertex, vertexCapacity - nextVertex);
+	ReturnRange(freeIndices, nextIndexWord, indexCapacity - nextIndexWord);
+
+	GLState::BindVertexArray(VAO);
+	glBindVertexBuffer(VERTEX_BINDING, VBO, 0, vertexSize);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	if (positionVAO != 0)
+	{
+		GLState::BindVertexArray(positionVAO);
+		glBindVertexBuffer(VERTEX_BINDING, positionVBO, 0, positionSize);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	}
+}
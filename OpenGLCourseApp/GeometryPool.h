@@ -0,0 +1,141 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+
+// Where one mesh lives in the pool's buffers. Indices are relative to the mesh, baseVertex is added by the draw.
+// Each mesh gets the smallest index type that can address its vertices
+struct GeometryAllocation
+{
+	GLint baseVertex;
+	GLsizei vertexCount;
+	GLenum indexType;
+	// In bytes, always a multiple of 4
+	GLuint indexOffset;
+	GLsizei indexCount;
+	bool live;
+};
+
+// Per instance data read from GeometryPool::INSTANCE_BINDING. Everything that used to be set per draw as uniforms
+// or constant attributes is here, so draws of different meshes and materials fit in one multi-draw
+struct InstanceData
+{
+	glm::mat4 model;
+	// Inverse transpose of the model matrix's upper 3x3, computed on the CPU once per object and frame
+	glm::mat3 normalMatrix;
+	// Undoes the position quantization of the mesh's vertex format
+	glm::vec3 positionScale;
+	glm::vec3 positionOffset;
+	// Specular intensity and shininess
+	glm::vec2 material;
+	// Omnidirectional shadow faces the instance is drawn to
+	GLint faceMask;
+};
+
+// Layout glMultiDrawElementsIndirect reads, firstIndex is in indices of the draw's index type from the start of
+// the pool's index buffer
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Vertex and index data of all meshes with the same vertex layout, sub-allocated out of one vertex buffer and
+// one index buffer behind a single VAO, so switching meshes doesn't switch any GL state. Ranges are handed out
+// first fit (index ranges in 4 byte words, so every index type stays aligned), freed ranges are merged with
+// their neighbours, and Compact (or growing, when a range doesn't fit) packs all live ranges to the front of new
+// buffers. Allocation handles stay the same across both
+// With a position stream the pool also keeps a packed copy of every vertex's position at the same vertex index,
+// behind a second VAO that shares the index buffer, for passes that only write depth
+class GeometryPool
+{
+public:
+	static constexpr GLuint VERTEX_BINDING = 0;
+	// The per-instance model matrix takes the four attribute locations starting here, fed from its own binding
+	// along with the position decode attributes of VertexLayout and the two below
+	static constexpr GLuint INSTANCE_ATTRIBUTE = 3;
+	static constexpr GLuint INSTANCE_BINDING = 3;
+	static constexpr GLuint MATERIAL_ATTRIBUTE = 9;
+	static constexpr GLuint FACE_MASK_ATTRIBUTE = 10;
+	// Three attribute locations, one per column
+	static constexpr GLuint NORMAL_MATRIX_ATTRIBUTE = 11;
+
+	static constexpr GLuint INVALID_ALLOCATION = 0xFFFFFFFF;
+
+	GeometryPool();
+
+	// Capacities are in vertices and 32 bit indices
+	void Init(VertexFormat format, GLsizei vertexCapacity, GLsizei indexCapacity, bool positionStream = false);
+
+	// Copies the mesh into the pool, the vertices have to be encoded in the pool's format already. Indices are
+	// narrowed to 8 or 16 bits when the mesh has few enough vertices
+	GLuint Allocate(const void *vertices, GLsizei vertexCount, const unsigned int *indices, GLsizei numOfIndices);
+	void Free(GLuint allocation);
+	// Moves every live range to the front of the buffers, closing the holes left by Free
+	void Compact();
+
+	void Bind() const;
+	// Binds the pool with instances read from an array of InstanceData at offset in buffer. positionOnly binds
+	// the position stream's VAO instead, if the pool has one, which feeds only attribute 0 of the vertex
+	void BindInstances(GLuint buffer, GLintptr offset, bool positionOnly = false) const;
+	// Instanced draw of indexCount indices starting at firstIndex within the allocation's indices, the pool has to
+	// be bound with its instances
+	void Draw(GLuint allocation, GLsizei instanceCount, GLuint firstIndex, GLsizei indexCount) const;
+	// Command for the same draw, its instances start at baseInstance in the bound instance array
+	DrawElementsIndirectCommand MakeDrawCommand(GLuint allocation, GLuint firstIndex, GLsizei indexCount, GLsizei instanceCount,
+		GLuint baseInstance) const;
+	// drawCount commands from commandOffset in the bound GL_DRAW_INDIRECT_BUFFER, all of allocations with indexType
+	void MultiDrawIndirect(GLenum indexType, GLintptr commandOffset, GLsizei drawCount) const;
+
+	const GeometryAllocation &GetAllocation(GLuint allocation) const;
+	GLuint GetVertexArrayId() const;
+	VertexFormat GetFormat() const;
+	bool HasPositionStream() const;
+
+	// Smallest of GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT and GL_UNSIGNED_INT that indexes vertexCount vertices
+	static GLenum GetIndexType(GLsizei vertexCount);
+	static GLsizei GetIndexSize(GLenum indexType);
+
+	void ClearPool();
+
+	~GeometryPool();
+
+private:
+	struct FreeRange
+	{
+		GLuint first;
+		GLsizei count;
+	};
+
+	GLuint VAO, VBO, IBO;
+	// Position stream, 0 without one
+	GLuint positionVAO, positionVBO;
+	VertexFormat format;
+	GLsizei vertexSize, positionSize;
+	// indexCapacity is in 4 byte words
+	GLsizei vertexCapacity, indexCapacity;
+
+	std::vector<GeometryAllocation> allocations;
+	// Handles of freed allocations, reused before new ones are added
+	std::vector<GLuint> freeHandles;
+	// Sorted by first, never adjacent to each other
+	std::vector<FreeRange> freeVertices, freeIndices;
+
+	// Narrowed copies of the indices of the mesh being uploaded, and its packed positions
+	std::vector<GLubyte> indexScratch, positionScratch;
+
+	static GLsizei GetIndexWords(GLenum indexType, GLsizei indexCount);
+	static bool TakeRange(std::vector<FreeRange> &freeList, GLsizei count, GLuint &first);
+	static void ReturnRange(std::vector<FreeRange> &freeList, GLuint first, GLsizei count);
+	// Instance attribute formats of the bound VAO
+	static void SetInstanceFormats();
+
+	// Copies all live ranges, packed, into new buffers of the given capacities
+	void Reallocate(GLsizei newVertexCapacity, GLsizei newIndexCapacity);
+};
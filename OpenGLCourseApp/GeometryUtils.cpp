@@ -0,0 +1,568 @@
+#include "GeometryUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Below this many items per thread, starting threads costs more than it saves
+	constexpr size_t MIN_ITEMS_PER_THREAD = 16 * 1024;
+
+	// Runs function(begin, end) over [0, count) split into one chunk per thread, chunks start at multiples of 8
+	// so the SIMD loops only have a tail in the last chunk
+	template <typename Function>
+	void ParallelFor(size_t count, Function function)
+	{
+		const size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		const size_t workers = std::min(hardwareThreads, (count + MIN_ITEMS_PER_THREAD - 1) / MIN_ITEMS_PER_THREAD);
+		if (workers <= 1)
+		{
+			function(size_t(0), count);
+			return;
+		}
+
+		const size_t chunk = ((count + workers - 1) / workers + 7) & ~size_t(7);
+		std::vector<std::thread> threads;
+		for (size_t begin = chunk; begin < count; begin += chunk)
+		{
+			threads.emplace_back(function, begin, std::min(begin + chunk, count));
+		}
+		function(size_t(0), std::min(chunk, count));
+
+		for (size_t i = 0; i < threads.size(); i++)
+		{
+			threads[i].join();
+		}
+	}
+
+	// Corners of every vertex (triangle * 3 + corner), in increasing order, as offsets into one array
+	void BuildVertexCorners(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+		std::vector<unsigned>& offsets, std::vector<unsigned>& corners)
+	{
+		offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			offsets[indices[i] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+
+		std::vector<unsigned> filled(offsets.begin(), offsets.end() - 1);
+		corners.resize(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			corners[filled[indices[i]]++] = static_cast<unsigned>(i);
+		}
+	}
+
+	// The scalar path, also used for the tails of the SIMD loops. The SIMD versions do the same operations in
+	// the same order, so both give the same bits
+	void FaceNormal(const GeometryStreams& streams, const unsigned int* triangle, bool normalize, GLfloat* outX, GLfloat* outY, GLfloat* outZ)
+	{
+		const GLfloat *px = streams.positionX.data(), *py = streams.positionY.data(), *pz = streams.positionZ.data();
+
+		const GLfloat e1x = px[triangle[1]] - px[triangle[0]];
+		const GLfloat e1y = py[triangle[1]] - py[triangle[0]];
+		const GLfloat e1z = pz[triangle[1]] - pz[triangle[0]];
+		const GLfloat e2x = px[triangle[2]] - px[triangle[0]];
+		const GLfloat e2y = py[triangle[2]] - py[triangle[0]];
+		const GLfloat e2z = pz[triangle[2]] - pz[triangle[0]];
+
+		GLfloat nx = e1y * e2z - e1z * e2y;
+		GLfloat ny = e1z * e2x - e1x * e2z;
+		GLfloat nz = e1x * e2y - e1y * e2x;
+
+		if (normalize)
+		{
+			const GLfloat length = std::sqrt(nx * nx + ny * ny + nz * nz);
+			nx = length > 0.0f ? nx / length : 0.0f;
+			ny = length > 0.0f ? ny / length : 0.0f;
+			nz = length > 0.0f ? nz / length : 0.0f;
+		}
+
+		*outX = nx;
+		*outY = ny;
+		*outZ = nz;
+	}
+
+	__m128 Gather4(const GLfloat* stream, const unsigned int* indices, size_t triangle, size_t corner)
+	{
+		return _mm_set_ps(stream[indices[(triangle + 3) * 3 + corner]], stream[indices[(triangle + 2) * 3 + corner]],
+			stream[indices[(triangle + 1) * 3 + corner]], stream[indices[triangle * 3 + corner]]);
+	}
+
+#ifdef __AVX__
+	__m256 Gather8(const GLfloat* stream, const unsigned int* indices, size_t triangle, size_t corner)
+	{
+		return _mm256_set_m128(Gather4(stream, indices, triangle + 4, corner), Gather4(stream, indices, triangle, corner));
+	}
+#endif
+
+	// Face normals of triangles [begin, end), unit length or scaled by twice the area
+	void FaceNormals(const GeometryStreams& streams, const unsigned int* indices, size_t begin, size_t end, bool normalize,
+		GLfloat* outX, GLfloat* outY, GLfloat* outZ)
+	{
+		const GLfloat *px = streams.positionX.data(), *py = streams.positionY.data(), *pz = streams.positionZ.data();
+
+		size_t t = begin;
+#ifdef __AVX__
+		for (; t + 8 <= end; t += 8)
+		{
+			const __m256 ax = Gather8(px, indices, t, 0), ay = Gather8(py, indices, t, 0), az = Gather8(pz, indices, t, 0);
+			const __m256 e1x = _mm256_sub_ps(Gather8(px, indices, t, 1), ax);
+			const __m256 e1y = _mm256_sub_ps(Gather8(py, indices, t, 1), ay);
+			const __m256 e1z = _mm256_sub_ps(Gather8(pz, indices, t, 1), az);
+			const __m256 e2x = _mm256_sub_ps(Gather8(px, indices, t, 2), ax);
+			const __m256 e2y = _mm256_sub_ps(Gather8(py, indices, t, 2), ay);
+			const __m256 e2z = _mm256_sub_ps(Gather8(pz, indices, t, 2), az);
+
+			__m256 nx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+			__m256 ny = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+			__m256 nz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+
+			if (normalize)
+			{
+				const __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+				const __m256 nonZero = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+				nx = _mm256_and_ps(nonZero, _mm256_div_ps(nx, length));
+				ny = _mm256_and_ps(nonZero, _mm256_div_ps(ny, length));
+				nz = _mm256_and_ps(nonZero, _mm256_div_ps(nz, length));
+			}
+
+			_mm256_storeu_ps(outX + t, nx);
+			_mm256_storeu_ps(outY + t, ny);
+			_mm256_storeu_ps(outZ + t, nz);
+		}
+#endif
+		for (; t + 4 <= end; t += 4)
+		{
+			const __m128 ax = Gather4(px, indices, t, 0), ay = Gather4(py, indices, t, 0), az = Gather4(pz, indices, t, 0);
+			const __m128 e1x = _mm_sub_ps(Gather4(px, indices, t, 1), ax);
+			const __m128 e1y = _mm_sub_ps(Gather4(py, indices, t, 1), ay);
+			const __m128 e1z = _mm_sub_ps(Gather4(pz, indices, t, 1), az);
+			const __m128 e2x = _mm_sub_ps(Gather4(px, indices, t, 2), ax);
+			const __m128 e2y = _mm_sub_ps(Gather4(py, indices, t, 2), ay);
+			const __m128 e2z = _mm_sub_ps(Gather4(pz, indices, t, 2), az);
+
+			__m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+			__m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+			__m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+			if (normalize)
+			{
+				const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+				const __m128 nonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+				nx = _mm_and_ps(nonZero, _mm_div_ps(nx, length));
+				ny = _mm_and_ps(nonZero, _mm_div_ps(ny, length));
+				nz = _mm_and_ps(nonZero, _mm_div_ps(nz, length));
+			}
+
+			_mm_storeu_ps(outX + t, nx);
+			_mm_storeu_ps(outY + t, ny);
+			_mm_storeu_ps(outZ + t, nz);
+		}
+		for (; t < end; t++)
+		{
+			FaceNormal(streams, indices + t * 3, normalize, outX + t, outY + t, outZ + t);
+		}
+	}
+
+	// Angle at each corner of the triangle, between its two edges
+	void CornerAngles(const GeometryStreams& streams, const unsigned int* triangle, GLfloat* angles)
+	{
+		const GLfloat *px = streams.positionX.data(), *py = streams.positionY.data(), *pz = streams.positionZ.data();
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			const unsigned a = triangle[k], b = triangle[(k + 1) % 3], c = triangle[(k + 2) % 3];
+			const GLfloat e1x = px[b] - px[a], e1y = py[b] - py[a], e1z = pz[b] - pz[a];
+			const GLfloat e2x = px[c] - px[a], e2y = py[c] - py[a], e2z = pz[c] - pz[a];
+
+			const GLfloat lengths = std::sqrt((e1x * e1x + e1y * e1y + e1z * e1z) * (e2x * e2x + e2y * e2y + e2z * e2z));
+			const GLfloat cosine = lengths > 0.0f ? (e1x * e2x + e1y * e2y + e1z * e2z) / lengths : 1.0f;
+			angles[k] = std::acos(std::min(std::max(cosine, -1.0f), 1.0f));
+		}
+	}
+
+	// Normalizes the vectors [begin, end) of three streams, zero length vectors stay zero
+	void NormalizeStreams(GLfloat* x, GLfloat* y, GLfloat* z, size_t begin, size_t end)
+	{
+		size_t v = begin;
+		for (; v + 4 <= end; v += 4)
+		{
+			const __m128 vx = _mm_loadu_ps(x + v), vy = _mm_loadu_ps(y + v), vz = _mm_loadu_ps(z + v);
+			const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+			const __m128 nonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+			_mm_storeu_ps(x + v, _mm_and_ps(nonZero, _mm_div_ps(vx, length)));
+			_mm_storeu_ps(y + v, _mm_and_ps(nonZero, _mm_div_ps(vy, length)));
+			_mm_storeu_ps(z + v, _mm_and_ps(nonZero, _mm_div_ps(vz, length)));
+		}
+		for (; v < end; v++)
+		{
+			const GLfloat length = std::sqrt(x[v] * x[v] + y[v] * y[v] + z[v] * z[v]);
+			x[v] = length > 0.0f ? x[v] / length : 0.0f;
+			y[v] = length > 0.0f ? y[v] / length : 0.0f;
+			z[v] = length > 0.0f ? z[v] / length : 0.0f;
+		}
+	}
+
+	int64_t GetCell(GLfloat value, GLfloat epsilon)
+	{
+		return static_cast<int64_t>(std::floor(value / epsilon));
+	}
+
+	uint64_t HashCell(int64_t x, int64_t y, int64_t z)
+	{
+		return (static_cast<uint64_t>(x) * 73856093u) ^ (static_cast<uint64_t>(y) * 19349663u) ^
+			(static_cast<uint64_t>(z) * 83492791u);
+	}
+
+	// A vertex and a lower numbered vertex all of whose attributes are within epsilon of it
+	struct WeldMatch
+	{
+		unsigned vertex;
+		unsigned target;
+	};
+
+	bool StreamMatches(const std::vector<GLfloat>& stream, unsigned a, unsigned b, GLfloat epsilon)
+	{
+		return stream.empty() || std::fabs(stream[a] - stream[b]) <= epsilon;
+	}
+}
+
+size_t GeometryStreams::GetVertexCount() const
+{
+	return positionX.size();
+}
+
+void GeometryStreams::Deinterleave(const GLfloat* vertices, size_t vertexCount, size_t stride, int positionOffset,
+	int texCoordOffset, int normalOffset)
+{
+	std::vector<GLfloat>* streams[8] = { &positionX, &positionY, &positionZ, &texCoordU, &texCoordV, &normalX, &normalY, &normalZ };
+	const int offsets[8] = { positionOffset, positionOffset + 1, positionOffset + 2, texCoordOffset, texCoordOffset + 1,
+		normalOffset, normalOffset + 1, normalOffset + 2 };
+	const bool present[8] = { positionOffset >= 0, positionOffset >= 0, positionOffset >= 0, texCoordOffset >= 0,
+		texCoordOffset >= 0, normalOffset >= 0, normalOffset >= 0, normalOffset >= 0 };
+
+	for (size_t s = 0; s < 8; s++)
+	{
+		streams[s]->clear();
+		if (!present[s])
+		{
+			continue;
+		}
+
+		streams[s]->resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			(*streams[s])[v] = vertices[v * stride + offsets[s]];
+		}
+	}
+}
+
+void GeometryStreams::InterleaveNormals(GLfloat* vertices, size_t stride, size_t normalOffset) const
+{
+	for (size_t v = 0; v < normalX.size(); v++)
+	{
+		vertices[v * stride + normalOffset] = normalX[v];
+		vertices[v * stride + normalOffset + 1] = normalY[v];
+		vertices[v * stride + normalOffset + 2] = normalZ[v];
+	}
+}
+
+void GeometryUtils::CalculateNormals(GeometryStreams& streams, const unsigned int* indices, size_t indexCount, NormalWeighting weighting)
+{
+	const size_t vertexCount = streams.GetVertexCount();
+	const size_t triangleCount = indexCount / 3;
+
+	std::vector<GLfloat> faceX(triangleCount), faceY(triangleCount), faceZ(triangleCount);
+	std::vector<GLfloat> angles(weighting == NormalWeighting::Angle ? triangleCount * 3 : 0);
+	ParallelFor(triangleCount, [&](size_t begin, size_t end)
+	{
+		FaceNormals(streams, indices, begin, end, weighting != NormalWeighting::Area, faceX.data(), faceY.data(), faceZ.data());
+		if (weighting == NormalWeighting::Angle)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				CornerAngles(streams, indices + t * 3, &angles[t * 3]);
+			}
+		}
+	});
+
+	// Each vertex sums its own corners, in triangle order, so there are no write conflicts between threads
+	std::vector<unsigned> offsets, corners;
+	BuildVertexCorners(indices, triangleCount * 3, vertexCount, offsets, corners);
+
+	streams.normalX.resize(vertexCount);
+	streams.normalY.resize(vertexCount);
+	streams.normalZ.resize(vertexCount);
+	ParallelFor(vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			GLfloat x = 0.0f, y = 0.0f, z = 0.0f;
+			for (unsigned j = offsets[v]; j < offsets[v + 1]; j++)
+			{
+				const unsigned corner = corners[j];
+				const unsigned triangle = corner / 3;
+				const GLfloat weight = weighting == NormalWeighting::Angle ? angles[corner] : 1.0f;
+				x += faceX[triangle] * weight;
+				y += faceY[triangle] * weight;
+				z += faceZ[triangle] * weight;
+			}
+			streams.normalX[v] = x;
+			streams.normalY[v] = y;
+			streams.normalZ[v] = z;
+		}
+
+		NormalizeStreams(streams.normalX.data(), streams.normalY.data(), streams.normalZ.data(), begin, end);
+	});
+}
+
+void GeometryUtils::CalculateNormals(const unsigned int* indices, size_t indexCount, GLfloat* vertices, size_t vertexCount,
+	size_t stride, size_t normalOffset, NormalWeighting weighting)
+{
+	GeometryStreams streams;
+	streams.Deinterleave(vertices, vertexCount, stride, 0, -1, -1);
+	CalculateNormals(streams, indices, indexCount, weighting);
+	streams.InterleaveNormals(vertices, stride, normalOffset);
+}
+
+void GeometryUtils::CalculateTangents(GeometryStreams& streams, const unsigned int* indices, size_t indexCount)
+{
+	const size_t vertexCount = streams.GetVertexCount();
+	const size_t triangleCount = indexCount / 3;
+
+	const GLfloat *px = streams.positionX.data(), *py = streams.positionY.data(), *pz = streams.positionZ.data();
+	const GLfloat *u = streams.texCoordU.data(), *v = streams.texCoordV.data();
+
+	// Direction of increasing u and increasing v across each triangle
+	std::vector<GLfloat> triangleTangents(triangleCount * 6);
+	ParallelFor(triangleCount, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			const unsigned *triangle = indices + t * 3;
+			const GLfloat e1x = px[triangle[1]] - px[triangle[0]], e1y = py[triangle[1]] - py[triangle[0]], e1z = pz[triangle[1]] - pz[triangle[0]];
+			const GLfloat e2x = px[triangle[2]] - px[triangle[0]], e2y = py[triangle[2]] - py[triangle[0]], e2z = pz[triangle[2]] - pz[triangle[0]];
+			const GLfloat du1 = u[triangle[1]] - u[triangle[0]], dv1 = v[triangle[1]] - v[triangle[0]];
+			const GLfloat du2 = u[triangle[2]] - u[triangle[0]], dv2 = v[triangle[2]] - v[triangle[0]];
+
+			GLfloat *out = &triangleTangents[t * 6];
+			const GLfloat determinant = du1 * dv2 - du2 * dv1;
+			if (std::fabs(determinant) <= 1e-20f)
+			{
+				// No usable uv mapping on this triangle, it doesn't contribute
+				std::fill(out, out + 6, 0.0f);
+				continue;
+			}
+
+			const GLfloat scale = 1.0f / determinant;
+			out[0] = (e1x * dv2 - e2x * dv1) * scale;
+			out[1] = (e1y * dv2 - e2y * dv1) * scale;
+			out[2] = (e1z * dv2 - e2z * dv1) * scale;
+			out[3] = (e2x * du1 - e1x * du2) * scale;
+			out[4] = (e2y * du1 - e1y * du2) * scale;
+			out[5] = (e2z * du1 - e1z * du2) * scale;
+		}
+	});
+
+	std::vector<unsigned> offsets, corners;
+	BuildVertexCorners(indices, triangleCount * 3, vertexCount, offsets, corners);
+
+	streams.tangentX.resize(vertexCount);
+	streams.tangentY.resize(vertexCount);
+	streams.tangentZ.resize(vertexCount);
+	streams.tangentW.resize(vertexCount);
+	ParallelFor(vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			GLfloat sum[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			for (unsigned j = offsets[i]; j < offsets[i + 1]; j++)
+			{
+				const GLfloat *tangents = &triangleTangents[(corners[j] / 3) * 6];
+				for (size_t k = 0; k < 6; k++)
+				{
+					sum[k] += tangents[k];
+				}
+			}
+
+			// Gram-Schmidt against the normal, falling back to any perpendicular when there is nothing left
+			const GLfloat nx = streams.normalX[i], ny = streams.normalY[i], nz = streams.normalZ[i];
+			const GLfloat projection = nx * sum[0] + ny * sum[1] + nz * sum[2];
+			GLfloat tx = sum[0] - nx * projection, ty = sum[1] - ny * projection, tz = sum[2] - nz * projection;
+			if (tx * tx + ty * ty + tz * tz <= 1e-20f)
+			{
+				const bool useX = std::fabs(nx) < 0.9f;
+				tx = useX ? 1.0f - nx * nx : -ny * nx;
+				ty = useX ? -nx * ny : 1.0f - ny * ny;
+				tz = useX ? -nx * nz : -ny * nz;
+			}
+			streams.tangentX[i] = tx;
+			streams.tangentY[i] = ty;
+			streams.tangentZ[i] = tz;
+
+			// Whether cross(normal, tangent) points along the summed bitangent or against it
+			const GLfloat cx = ny * tz - nz * ty, cy = nz * tx - nx * tz, cz = nx * ty - ny * tx;
+			streams.tangentW[i] = cx * sum[3] + cy * sum[4] + cz * sum[5] < 0.0f ? -1.0f : 1.0f;
+		}
+
+		NormalizeStreams(streams.tangentX.data(), streams.tangentY.data(), streams.tangentZ.data(), begin, end);
+	});
+}
+
+size_t GeometryUtils::WeldVertices(GeometryStreams& streams, std::vector<unsigned int>& indices, GLfloat epsilon)
+{
+	const size_t vertexCount = streams.GetVertexCount();
+
+	// Cells twice epsilon wide: whatever is within epsilon of a vertex is in its cell or, along each axis, in the
+	// neighbour on the side of the half the vertex is in, so eight cells hold every candidate
+	const GLfloat cellSize = 2.0f * epsilon;
+
+	// Hash of the position cell of every vertex, then vertices sorted by hash so every cell is one run
+	std::vector<std::pair<uint64_t, unsigned>> cells(vertexCount);
+	ParallelFor(vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const uint64_t hash = HashCell(GetCell(streams.positionX[v], cellSize), GetCell(streams.positionY[v], cellSize),
+				GetCell(streams.positionZ[v], cellSize));
+			cells[v] = std::make_pair(hash, static_cast<unsigned>(v));
+		}
+	});
+	std::sort(cells.begin(), cells.end());
+
+	std::vector<GLfloat>* attributes[] = { &streams.positionX, &streams.positionY, &streams.positionZ, &streams.texCoordU,
+		&streams.texCoordV, &streams.normalX, &streams.normalY, &streams.normalZ, &streams.tangentX, &streams.tangentY,
+		&streams.tangentZ, &streams.tangentW };
+
+	// Every chunk of vertices finds the lower numbered vertices each of its vertices matches, in increasing order
+	std::mutex chunkMutex;
+	std::vector<std::pair<size_t, std::vector<WeldMatch>>> chunkMatches;
+	ParallelFor(vertexCount, [&](size_t begin, size_t end)
+	{
+		std::vector<WeldMatch> found;
+		std::vector<unsigned> candidates;
+		for (size_t v = begin; v < end; v++)
+		{
+			const GLfloat position[3] = { streams.positionX[v], streams.positionY[v], streams.positionZ[v] };
+			int64_t cell[3], step[3];
+			for (size_t axis = 0; axis < 3; axis++)
+			{
+				const GLfloat scaled = position[axis] / cellSize;
+				cell[axis] = GetCell(position[axis], cellSize);
+				step[axis] = scaled - std::floor(scaled) < 0.5f ? -1 : 1;
+			}
+
+			candidates.clear();
+			for (int corner = 0; corner < 8; corner++)
+			{
+				const uint64_t hash = HashCell(cell[0] + ((corner & 1) ? step[0] : 0), cell[1] + ((corner & 2) ? step[1] : 0),
+					cell[2] + ((corner & 4) ? step[2] : 0));
+
+				// Runs are sorted by index too, only the vertices before this one are of interest
+				for (auto it = std::lower_bound(cells.begin(), cells.end(), std::make_pair(hash, 0u));
+					it != cells.end() && it->first == hash && it->second < v; ++it)
+				{
+					bool matches = true;
+					for (size_t s = 0; matches && s < sizeof(attributes) / sizeof(attributes[0]); s++)
+					{
+						matches = StreamMatches(*attributes[s], static_cast<unsigned>(v), it->second, epsilon);
+					}
+					if (matches)
+					{
+						candidates.push_back(it->second);
+					}
+				}
+			}
+
+			// Hash collisions can visit a run twice
+			std::sort(candidates.begin(), candidates.end());
+			candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+			for (unsigned candidate : candidates)
+			{
+				WeldMatch match;
+				match.vertex = static_cast<unsigned>(v);
+				match.target = candidate;
+				found.push_back(match);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(chunkMutex);
+		chunkMatches.emplace_back(begin, std::move(found));
+	});
+	std::sort(chunkMatches.begin(), chunkMatches.end(),
+		[](const std::pair<size_t, std::vector<WeldMatch>>& a, const std::pair<size_t, std::vector<WeldMatch>>& b) { return a.first < b.first; });
+
+	// What's left is cheap and in vertex order: every vertex maps to the lowest numbered vertex it matches that
+	// wasn't welded itself, exactly like comparing against every earlier vertex would
+	std::vector<unsigned> remap(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		remap[v] = static_cast<unsigned>(v);
+	}
+	for (const auto &chunk : chunkMatches)
+	{
+		for (const WeldMatch &match : chunk.second)
+		{
+			if (remap[match.vertex] == match.vertex && remap[match.target] == match.target)
+			{
+				remap[match.vertex] = match.target;
+			}
+		}
+	}
+
+	// Kept vertices stay in their order, the others take the new index of the vertex they were welded to
+	std::vector<unsigned> newIndex(vertexCount);
+	size_t weldedCount = 0;
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] == v)
+		{
+			newIndex[v] = static_cast<unsigned>(weldedCount++);
+		}
+		else
+		{
+			newIndex[v] = newIndex[remap[v]];
+		}
+	}
+
+	for (size_t s = 0; s < sizeof(attributes) / sizeof(attributes[0]); s++)
+	{
+		std::vector<GLfloat> &stream = *attributes[s];
+		if (stream.empty())
+		{
+			continue;
+		}
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			if (remap[v] == v)
+			{
+				stream[newIndex[v]] = stream[v];
+			}
+		}
+		stream.resize(weldedCount);
+	}
+
+	ParallelFor(indices.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			indices[i] = newIndex[indices[i]];
+		}
+	});
+
+	return weldedCount;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+
+// Vertex attributes with one array per component, the layout the SIMD kernels load from. Attributes a mesh
+// doesn't have are left empty
+struct GeometryStreams
+{
+	std::vector<GLfloat> positionX, positionY, positionZ;
+	std::vector<GLfloat> texCoordU, texCoordV;
+	std::vector<GLfloat> normalX, normalY, normalZ;
+	// w is the handedness of the bitangent, bitangent = cross(normal, tangent) * w
+	std::vector<GLfloat> tangentX, tangentY, tangentZ, tangentW;
+
+	size_t GetVertexCount() const;
+
+	// Copies from interleaved vertices, stride and offsets in floats, a negative offset skips the attribute
+	void Deinterleave(const GLfloat *vertices, size_t vertexCount, size_t stride, int positionOffset, int texCoordOffset,
+		int normalOffset);
+	void InterleaveNormals(GLfloat *vertices, size_t stride, size_t normalOffset) const;
+};
+
+enum class NormalWeighting
+{
+	// Every face adds its unit normal, what main.cpp's calculateNormals used to do
+	Face,
+	// Faces add their normal scaled by their area
+	Area,
+	// Faces add their unit normal scaled by the angle of the corner at the vertex
+	Angle
+};
+
+// Normals, tangents and welding for indexed triangle lists. Per triangle work runs in SSE (AVX when compiled
+// for it) over chunks of triangles spread across threads, and every vertex then sums its triangles in index
+// order, so the results are the same as the scalar path's whatever the thread count or instruction set
+class GeometryUtils
+{
+public:
+	// Overwrites the normal streams with smooth vertex normals
+	static void CalculateNormals(GeometryStreams &streams, const unsigned int *indices, size_t indexCount, NormalWeighting weighting);
+	// Same on interleaved vertices, vertexCount in vertices, stride and normalOffset in floats
+	static void CalculateNormals(const unsigned int *indices, size_t indexCount, GLfloat *vertices, size_t vertexCount,
+		size_t stride, size_t normalOffset, NormalWeighting weighting);
+
+	// Per vertex tangents from the uv gradients (Lengyel), orthogonalized against the normals. Needs positions,
+	// uvs and normals
+	static void CalculateTangents(GeometryStreams &streams, const unsigned int *indices, size_t indexCount);
+
+	// Merges vertices whose attributes, position included, are all within epsilon of each other. Every vertex goes
+	// to the lowest numbered vertex it matches that isn't merged itself, for any thread count. Rewrites the indices,
+	// compacts the streams and returns the new vertex count
+	static size_t WeldVertices(GeometryStreams &streams, std::vector<unsigned int> &indices, GLfloat epsilon);
+};
@@ -3,17 +3,23 @@
 Light::Light() :
 	color(glm::vec3(1.0f)),
 	ambientIntensity(1.0f),
-	diffuseIntensity(0.0f)
+	diffuseIntensity(0.0f),
+	shadowMap(nullptr)
 {}
 
 Light::Light(GLuint shadowWidth, GLuint shadowHeight, GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity,
 	GLfloat dIntensity) :
 	color(glm::vec3(red, green, blue)),
 	ambientIntensity(aIntensity),
-	diffuseIntensity(dIntensity)
+	diffuseIntensity(dIntensity),
+	shadowMap(nullptr)
 {
-	shadowMap = new ShadowMap();
-	shadowMap->Init(shadowWidth, shadowHeight);
+	// Lights that render into a shared shadow map (omnidirectional lights) pass a size of 0
+	if (shadowWidth > 0 && shadowHeight > 0)
+	{
+		shadowMap = new ShadowMap();
+		shadowMap->Init(shadowWidth, shadowHeight);
+	}
 }
 
 
@@ -22,3 +28,8 @@ ShadowMap* Light::GetShadowMap() const
 	return shadowMap;
 }
 
+const glm::mat4& Light::GetProjection() const
+{
+	return lightProj;
+}
+
@@ -16,6 +16,7 @@ public:
 		GLfloat aIntensity, GLfloat dIntensity);
 
 	ShadowMap *GetShadowMap() const;
+	const glm::mat4 &GetProjection() const;
 
 protected:
 	glm::vec3 color;
@@ -0,0 +1,273 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+// The storage buffers are filled straight from these, so they have to match the std430 structs in shader.frag
+static_assert(sizeof(PointLightData) == 64, "PointLightData doesn't match the std430 layout");
+static_assert(sizeof(SpotLightData) == 64, "SpotLightData doesn't match the std430 layout");
+
+LightClusters::LightClusters() :
+	nearPlane(0.1f),
+	farPlane(100.0f),
+	tileWidth(1.0f),
+	tileHeight(1.0f),
+	depthScale(0.0f),
+	depthBias(0.0f)
+{}
+
+void LightClusters::BuildGrid(GLfloat fovY, GLfloat aspect, GLfloat near, GLfloat far, GLint screenWidth, GLint screenHeight)
+{
+	nearPlane = near;
+	farPlane = far;
+
+	tileWidth = static_cast<GLfloat>(screenWidth) / static_cast<GLfloat>(CLUSTER_X);
+	tileHeight = static_cast<GLfloat>(screenHeight) / static_cast<GLfloat>(CLUSTER_Y);
+
+	// slice = log(depth) * depthScale + depthBias, so that slice 0 starts at the near and slice CLUSTER_Z at the far plane
+	const GLfloat logRatio = logf(farPlane / nearPlane);
+	depthScale = static_cast<GLfloat>(CLUSTER_Z) / logRatio;
+	depthBias = -static_cast<GLfloat>(CLUSTER_Z) * logf(nearPlane) / logRatio;
+
+	const GLfloat tanHalfFov = tanf(fovY * 0.5f);
+
+	bounds.resize(CLUSTER_COUNT);
+
+	for (GLuint z = 0; z < CLUSTER_Z; z++)
+	{
+		const GLfloat sliceNear = nearPlane * powf(farPlane / nearPlane, static_cast<GLfloat>(z) / CLUSTER_Z);
+		const GLfloat sliceFar = nearPlane * powf(farPlane / nearPlane, static_cast<GLfloat>(z + 1) / CLUSTER_Z);
+
+		for (GLuint y = 0; y < CLUSTER_Y; y++)
+		{
+			const GLfloat ndcY[] = { -1.0f + 2.0f * y / CLUSTER_Y, -1.0f + 2.0f * (y + 1) / CLUSTER_Y };
+
+			for (GLuint x = 0; x < CLUSTER_X; x++)
+			{
+				const GLfloat ndcX[] = { -1.0f + 2.0f * x / CLUSTER_X, -1.0f + 2.0f * (x + 1) / CLUSTER_X };
+
+				ClusterBounds &cluster = bounds[x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y];
+				cluster.min = glm::vec3(INFINITY);
+				cluster.max = glm::vec3(-INFINITY);
+
+				// The tile's frustum slice is bounded by its 8 corners
+				for (GLfloat depth : { sliceNear, sliceFar })
+				{
+					for (GLfloat cornerX : ndcX)
+					{
+						for (GLfloat cornerY : ndcY)
+						{
+							const glm::vec3 corner(cornerX * depth * tanHalfFov * aspect, cornerY * depth * tanHalfFov, -depth);
+							cluster.min = glm::min(cluster.min, corner);
+							cluster.max = glm::max(cluster.max, corner);
+						}
+					}
+				}
+
+				cluster.center = (cluster.min + cluster.max) * 0.5f;
+				cluster.radius = glm::length(cluster.max - cluster.center);
+			}
+		}
+	}
+}
+
+void LightClusters::Update(const glm::mat4& view, const PointLight* pLights, GLuint pointLightCount,
+	const SpotLight* sLights, GLuint spotLightCount, RingBuffer* ring)
+{
+	pointLightCount = std::min<GLuint>(pointLightCount, MAX_POINT_LIGHTS);
+	spotLightCount = std::min<GLuint>(spotLightCount, MAX_SPOT_LIGHTS);
+
+	pointReferences.clear();
+	spotReferences.clear();
+
+	// The light data is written sequentially, straight into the mapped buffer
+	PointLightData *pointLightData = static_cast<PointLightData*>(
+		AllocateStorage(ring, POINT_LIGHT_BINDING, pointLightCount * sizeof(PointLightData)));
+	SpotLightData *spotLightData = static_cast<SpotLightData*>(
+		AllocateStorage(ring, SPOT_LIGHT_BINDING, spotLightCount * sizeof(SpotLightData)));
+
+	for (GLuint i = 0; i < pointLightCount; i++)
+	{
+		pointLightData[i] = pLights[i].GetLightData();
+
+		const GLfloat range = pLights[i].CalculateRange();
+		if (range > 0.0f)
+		{
+			const glm::vec3 center(view * glm::vec4(pLights[i].GetPosition(), 1.0f));
+			BinLight(center, range, nullptr, i, pointReferences);
+		}
+	}
+
+	for (GLuint i = 0; i < spotLightCount; i++)
+	{
+		spotLightData[i] = sLights[i].GetLightData();
+
+		const GLfloat range = sLights[i].CalculateRange();
+		if (!sLights[i].IsOn() || range <= 0.0f)
+		{
+			continue;
+		}
+
+		Cone cone;
+		cone.apex = glm::vec3(view * glm::vec4(sLights[i].GetPosition(), 1.0f));
+		cone.direction = glm::normalize(glm::vec3(view * glm::vec4(sLights[i].GetDirection(), 0.0f)));
+		cone.range = range;
+
+		const GLfloat angle = glm::radians(sLights[i].GetEdge());
+		cone.cosAngle = cosf(angle);
+		cone.sinAngle = sinf(angle);
+
+		// Smallest sphere around the cone: wide cones are bounded by their base disc, narrow ones by the
+		// sphere through the apex and the base rim
+		glm::vec3 center;
+		GLfloat radius;
+		if (angle > glm::radians(45.0f))
+		{
+			center = cone.apex + cone.direction * (cone.cosAngle * range);
+			radius = cone.sinAngle * range;
+		}
+		else
+		{
+			center = cone.apex + cone.direction * (range / (2.0f * cone.cosAngle));
+			radius = range / (2.0f * cone.cosAngle);
+		}
+
+#ifndef NDEBUG
+		// A sphere missing the apex or the rim leaves out clusters the light reaches
+		const glm::vec3 up = std::fabs(cone.direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		const glm::vec3 side = glm::normalize(glm::cross(cone.direction, up));
+		const glm::vec3 rim = cone.apex + (cone.direction * cone.cosAngle + side * cone.sinAngle) * range;
+		assert(glm::distance(cone.apex, center) <= radius * 1.001f);
+		assert(glm::distance(rim, center) <= radius * 1.001f);
+#endif
+
+		BinLight(center, radius, &cone, i, spotReferences);
+	}
+
+	// Count, then turn the counts into offsets, then scatter the light indices: points first, then spots
+	clusterData.assign(CLUSTER_COUNT, glm::uvec4(0));
+	for (const ClusterLight &reference : pointReferences)
+	{
+		clusterData[reference.cluster].y++;
+	}
+	for (const ClusterLight &reference : spotReferences)
+	{
+		clusterData[reference.cluster].z++;
+	}
+
+	GLuint offset = 0;
+	for (glm::uvec4 &cluster : clusterData)
+	{
+		cluster.y = std::min(cluster.y, MAX_LIGHTS_PER_CLUSTER);
+		cluster.z = std::min(cluster.z, MAX_LIGHTS_PER_CLUSTER - cluster.y);
+		cluster.x = offset;
+		offset += cluster.y + cluster.z;
+	}
+
+	lightIndices.resize(offset);
+	for (const ClusterLight &reference : pointReferences)
+	{
+		glm::uvec4 &cluster = clusterData[reference.cluster];
+		if (cluster.w < cluster.y)
+		{
+			lightIndices[cluster.x + cluster.w++] = reference.light;
+		}
+	}
+	for (const ClusterLight &reference : spotReferences)
+	{
+		glm::uvec4 &cluster = clusterData[reference.cluster];
+		if (cluster.w < cluster.y + cluster.z)
+		{
+			lightIndices[cluster.x + cluster.w++] = reference.light;
+		}
+	}
+
+	// Built in cached memory first, the mapping is write-combined and the scatter above writes all over it
+	memcpy(AllocateStorage(ring, CLUSTER_BINDING, clusterData.size() * sizeof(glm::uvec4)),
+		clusterData.data(), clusterData.size() * sizeof(glm::uvec4));
+	memcpy(AllocateStorage(ring, LIGHT_INDEX_BINDING, lightIndices.size() * sizeof(GLuint)),
+		lightIndices.data(), lightIndices.size() * sizeof(GLuint));
+}
+
+void LightClusters::UseClusters(GLuint dimensionsLocation, GLuint tileSizeLocation, GLuint depthParamsLocation) const
+{
+	glUniform3ui(dimensionsLocation, CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+	glUniform2f(tileSizeLocation, tileWidth, tileHeight);
+	glUniform2f(depthParamsLocation, depthScale, depthBias);
+}
+
+GLuint LightClusters::GetLightReferenceCount() const
+{
+	return lightIndices.size();
+}
+
+LightClusters::~LightClusters() = default;
+
+GLuint LightClusters::DepthToSlice(GLfloat depth) const
+{
+	if (depth <= nearPlane)
+	{
+		return 0;
+	}
+
+	const GLfloat slice = logf(depth) * depthScale + depthBias;
+	return std::min(static_cast<GLuint>(slice), CLUSTER_Z - 1);
+}
+
+void LightClusters::BinLight(glm::vec3 center, GLfloat radius, const Cone* cone, GLuint light,
+	std::vector<ClusterLight>& references) const
+{
+	// View space looks down -z
+	const GLfloat depth = -center.z;
+	if (depth + radius < nearPlane || depth - radius > farPlane)
+	{
+		return;
+	}
+
+	const GLuint firstSlice = DepthToSlice(depth - radius);
+	const GLuint lastSlice = DepthToSlice(depth + radius);
+
+	for (GLuint z = firstSlice; z <= lastSlice; z++)
+	{
+		for (GLuint tile = 0; tile < CLUSTER_X * CLUSTER_Y; tile++)
+		{
+			const GLuint index = tile + z * CLUSTER_X * CLUSTER_Y;
+			const ClusterBounds &cluster = bounds[index];
+
+			const glm::vec3 closest = glm::clamp(center, cluster.min, cluster.max);
+			const glm::vec3 offset = closest - center;
+			if (glm::dot(offset, offset) > radius * radius)
+			{
+				continue;
+			}
+
+			if (cone)
+			{
+				// Cone against the cluster's bounding sphere: outside the cone's side, past its base or behind its apex
+				const glm::vec3 toCluster = cluster.center - cone->apex;
+				const GLfloat lengthSq = glm::dot(toCluster, toCluster);
+				const GLfloat alongAxis = glm::dot(toCluster, cone->direction);
+				const GLfloat sideDistance = cone->cosAngle * sqrtf(std::max(lengthSq - alongAxis * alongAxis, 0.0f)) - alongAxis * cone->sinAngle;
+
+				if (sideDistance > cluster.radius || alongAxis > cluster.radius + cone->range || alongAxis < -cluster.radius)
+				{
+					continue;
+				}
+			}
+
+			references.push_back({ index, light });
+		}
+	}
+}
+
+void *LightClusters::AllocateStorage(RingBuffer* ring, GLuint binding, GLsizeiptr size)
+{
+	size = std::max<GLsizeiptr>(size, 16);
+
+	GLintptr offset;
+	void *data = ring->Allocate(GL_SHADER_STORAGE_BUFFER, size, offset);
+	ring->BindRange(GL_SHADER_STORAGE_BUFFER, binding, offset, size);
+	return data;
+}
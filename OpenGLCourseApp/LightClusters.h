@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "RingBuffer.h"
+
+// Froxel grid for clustered forward shading. The view frustum is split into screen tiles and exponentially
+// spaced depth slices, every light is binned into the clusters its volume touches each frame, and the
+// fragment shader only shades the lights listed for its own cluster
+class LightClusters
+{
+public:
+	static constexpr GLuint CLUSTER_X = 16;
+	static constexpr GLuint CLUSTER_Y = 9;
+	static constexpr GLuint CLUSTER_Z = 24;
+	static constexpr GLuint CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+	// Lights past this in a cluster are dropped, which bounds the light index buffer
+	static constexpr GLuint MAX_LIGHTS_PER_CLUSTER = 256;
+
+	// Upper bound of the data Update writes into the frame ring buffer, without alignment padding
+	static constexpr GLsizeiptr MAX_FRAME_DATA_SIZE = MAX_POINT_LIGHTS * sizeof(PointLightData) +
+		MAX_SPOT_LIGHTS * sizeof(SpotLightData) +
+		CLUSTER_COUNT * (sizeof(glm::uvec4) + MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint));
+
+	// Storage buffer binding points used by shader.frag
+	static constexpr GLuint POINT_LIGHT_BINDING = 0;
+	static constexpr GLuint SPOT_LIGHT_BINDING = 1;
+	static constexpr GLuint CLUSTER_BINDING = 2;
+	static constexpr GLuint LIGHT_INDEX_BINDING = 3;
+
+	LightClusters();
+
+	// Rebuilds the view space bounds of every cluster, only needed when the projection changes
+	void BuildGrid(GLfloat fovY, GLfloat aspect, GLfloat nearPlane, GLfloat farPlane, GLint screenWidth, GLint screenHeight);
+
+	// Bins the lights into the clusters, writes the light and cluster buffers into this frame's region of
+	// the ring buffer and binds them to their storage buffer binding points
+	void Update(const glm::mat4 &view, const PointLight *pLights, GLuint pointLightCount,
+		const SpotLight *sLights, GLuint spotLightCount, RingBuffer *ring);
+
+	void UseClusters(GLuint dimensionsLocation, GLuint tileSizeLocation, GLuint depthParamsLocation) const;
+
+	// Number of (cluster, light) pairs of the last update
+	GLuint GetLightReferenceCount() const;
+
+	~LightClusters();
+
+private:
+	struct ClusterBounds
+	{
+		glm::vec3 min, max;
+		glm::vec3 center;
+		GLfloat radius;
+	};
+
+	struct ClusterLight
+	{
+		GLuint cluster;
+		GLuint light;
+	};
+
+	struct Cone
+	{
+		glm::vec3 apex;
+		glm::vec3 direction;
+		GLfloat range;
+		GLfloat cosAngle, sinAngle;
+	};
+
+	GLfloat nearPlane, farPlane;
+	GLfloat tileWidth, tileHeight;
+	GLfloat depthScale, depthBias;
+
+	std::vector<ClusterBounds> bounds;
+
+	std::vector<ClusterLight> pointReferences, spotReferences;
+
+	// offset, point light count, spot light count, and the number of indices Update has written so far, which the
+	// shaders ignore
+	std::vector<glm::uvec4> clusterData;
+	std::vector<GLuint> lightIndices;
+
+	GLuint DepthToSlice(GLfloat depth) const;
+	// Adds the light to every cluster overlapping its bounding sphere (view space), spot lights are
+	// additionally tested against their cone
+	void BinLight(glm::vec3 center, GLfloat radius, const Cone *cone, GLuint light,
+		std::vector<ClusterLight> &references) const;
+
+	// Storage buffers can't be bound with a size of 0, so empty ranges are padded
+	static void *AllocateStorage(RingBuffer *ring, GLuint binding, GLsizeiptr size);
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read only view of a whole file mapped into memory (MapViewOfFile on Windows, mmap elsewhere). Pages are
+// read on first touch, so opening costs nothing until the data is used
+class MappedFile
+{
+public:
+	MappedFile();
+
+	// Returns false if the file doesn't exist or can't be mapped, empty files can't be mapped either
+	bool Open(const std::string &fileName);
+	void Close();
+
+	bool IsOpen() const;
+	const void *GetData() const;
+	size_t GetSize() const;
+
+	~MappedFile();
+
+private:
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	const void *data;
+	size_t size;
+
+#ifdef _WIN32
+	// HANDLEs, kept as void* so windows.h stays out of this header
+	void *fileHandle;
+	void *mappingHandle;
+#endif
+};
@@ -1,18 +1,32 @@
 ﻿#include "Material.h"
+
+GLuint Material::nextMaterialId = 0;
+
 Material::Material() :
 	specularIntensity(0.0f),
-	shininess(0.0f)
+	shininess(0.0f),
+	materialId(nextMaterialId++)
 {}
 
 Material::Material(GLfloat sIntensity, GLfloat shininess) :
 	specularIntensity(sIntensity),
-	shininess(shininess)
+	shininess(shininess),
+	materialId(nextMaterialId++)
 {}
 
-void Material::UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation)
+GLfloat Material::GetSpecularIntensity() const
+{
+	return specularIntensity;
+}
+
+GLfloat Material::GetShininess() const
+{
+	return shininess;
+}
+
+GLuint Material::GetMaterialId() const
 {
-	glUniform1f(specularIntensityLocation, specularIntensity);
-	glUniform1f(shininessLocation, shininess);
+	return materialId;
 }
 
 Material::~Material() {}
@@ -7,7 +7,11 @@ public:
 	Material();
 	Material(GLfloat sIntensity, GLfloat shininess);
 
-	void UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation);
+	GLfloat GetSpecularIntensity() const;
+	GLfloat GetShininess() const;
+
+	// Unique per constructed material, copies share it
+	GLuint GetMaterialId() const;
 
 	~Material();
 private:
@@ -15,4 +19,7 @@ private:
 	GLfloat specularIntensity;
 	GLfloat shininess;
 
+	GLuint materialId;
+
+	static GLuint nextMaterialId;
 };
@@ -1,71 +1,179 @@
 #include "Mesh.h"
 
-Mesh::Mesh() : VAO(0), VBO(0), IBO(0), indexCount(0)
+#include <vector>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+Mesh::Mesh() : pool(nullptr), allocation(GeometryPool::INVALID_ALLOCATION), lodCount(0), positionScale(1.0f), positionOffset(0.0f)
 {}
 
-void Mesh::CreateMesh(const GLfloat* vertices, const unsigned int* indices, const GLsizei numOfVertices, const GLsizei numOfIndices)
+void Mesh::CreateMesh(GeometryPool* geometryPool, const GLfloat* vertices, const unsigned int* indices, const GLsizei numOfVertices,
+	const GLsizei numOfIndices, const AABB* knownBounds)
 {
-	indexCount = numOfIndices;
+	// Position is the first of the 8 floats of every vertex
+	AABB meshBounds;
+	if (knownBounds)
+	{
+		meshBounds = *knownBounds;
+	}
+	else
+	{
+		for (GLsizei i = 0; i + 2 < numOfVertices; i += VertexLayout::FLOATS_PER_VERTEX)
+		{
+			meshBounds.AddPoint(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+		}
+	}
 
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+	const VertexFormat format = geometryPool->GetFormat();
+	const GLsizei vertexCount = numOfVertices / VertexLayout::FLOATS_PER_VERTEX;
+	std::vector<GLubyte> encoded(static_cast<size_t>(vertexCount) * VertexLayout::GetVertexSize(format));
+	VertexLayout::Encode(format, vertices, vertexCount, meshBounds, encoded.data());
 
-	glGenBuffers(1, &IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(*indices) * numOfIndices, indices, GL_STATIC_DRAW);
+	CreateEncodedMesh(geometryPool, encoded.data(), vertexCount, indices, numOfIndices, meshBounds);
+}
 
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(*vertices) * numOfVertices, vertices, GL_STATIC_DRAW);
+void Mesh::CreateEncodedMesh(GeometryPool* geometryPool, const void* vertices, GLsizei vertexCount, const unsigned int* indices,
+	GLsizei numOfIndices, const AABB& meshBounds, const MeshLod* meshLods, size_t meshLodCount, const Meshlet* meshMeshlets,
+	size_t meshletCount)
+{
+	ClearMesh();
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, nullptr);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, reinterpret_cast<void*>(sizeof(vertices[0]) * 3));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, reinterpret_cast<void*>(sizeof(vertices[0]) * 5));
-	glEnableVertexAttribArray(2);
+	bounds = meshBounds;
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	lodCount = 0;
+	for (size_t i = 0; meshLods && i < meshLodCount && i < MAX_LODS; i++)
+	{
+		lods[lodCount++] = meshLods[i];
+	}
+	if (lodCount == 0)
+	{
+		lods[0].firstIndex = 0;
+		lods[0].indexCount = numOfIndices;
+		lods[0].error = 0.0f;
+		lodCount = 1;
+	}
 
-	glBindVertexArray(0);
+	if (meshMeshlets)
+	{
+		meshlets.assign(meshMeshlets, meshMeshlets + meshletCount);
+	}
+	VertexLayout::GetPositionDecode(geometryPool->GetFormat(), bounds, positionScale, positionOffset);
 
-	//MUST BE AFTER UNBINDING VAO
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	pool = geometryPool;
+	allocation = pool->Allocate(vertices, vertexCount, indices, numOfIndices);
 }
 
-void Mesh::RenderMesh() const
+// All meshes of a pool share its VAO, which stays bound until a mesh of another pool replaces it
+void Mesh::RenderMesh(const glm::mat4* models, GLsizei instanceCount, RingBuffer* instanceBuffer) const
 {
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	if (instanceCount <= 0)
+	{
+		return;
+	}
 
-	glDrawElements( GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+	GLintptr offset;
+	InstanceData *instances = static_cast<InstanceData*>(instanceBuffer->Allocate(GL_ARRAY_BUFFER,
+		sizeof(InstanceData) * instanceCount, offset));
+	WriteInstances(models, nullptr, instanceCount, nullptr, 0, instances);
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	pool->BindInstances(instanceBuffer->GetBufferId(), offset);
+	pool->Draw(allocation, instanceCount, lods[0].firstIndex, lods[0].indexCount);
 }
 
-void Mesh::ClearMesh()
+void Mesh::WriteInstances(const glm::mat4* models, const glm::mat3* normals, GLsizei instanceCount, const Material* material,
+	GLint faceMask, InstanceData* instances) const
 {
-	if(IBO != 0)
+	const glm::vec2 materialData = material ? glm::vec2(material->GetSpecularIntensity(), material->GetShininess()) :
+		glm::vec2(0.0f);
+
+	for (GLsizei i = 0; i < instanceCount; i++)
 	{
-		glDeleteBuffers(1, &IBO);
-		IBO = 0;
+		InstanceData &instance = instances[i];
+		instance.model = models[i];
+		instance.normalMatrix = normals ? normals[i] : glm::inverseTranspose(glm::mat3(models[i]));
+		instance.positionScale = positionScale;
+		instance.positionOffset = positionOffset;
+		instance.material = materialData;
+		instance.faceMask = faceMask;
 	}
-	if(VBO != 0)
+}
+
+DrawElementsIndirectCommand Mesh::MakeDrawCommand(GLuint firstIndex, GLsizei indexCount, GLsizei instanceCount,
+	GLuint baseInstance) const
+{
+	return pool->MakeDrawCommand(allocation, firstIndex, indexCount, instanceCount, baseInstance);
+}
+
+void Mesh::ClearMesh()
+{
+	if(pool && allocation != GeometryPool::INVALID_ALLOCATION)
 	{
-		glDeleteBuffers(1, &VBO);
-		VBO = 0;
+		pool->Free(allocation);
 	}
-	if(VAO != 0)
+	pool = nullptr;
+	allocation = GeometryPool::INVALID_ALLOCATION;
+	bounds = AABB();
+	lodCount = 0;
+	meshlets.clear();
+}
+
+const AABB& Mesh::GetBounds() const
+{
+	return bounds;
+}
+
+GLuint Mesh::GetVertexArrayId() const
+{
+	return pool ? pool->GetVertexArrayId() : 0;
+}
+
+GeometryPool* Mesh::GetPool() const
+{
+	return pool;
+}
+
+GLenum Mesh::GetIndexType() const
+{
+	return pool ? pool->GetAllocation(allocation).indexType : GL_UNSIGNED_INT;
+}
+
+GLuint Mesh::GetMeshId() const
+{
+	return allocation;
+}
+
+size_t Mesh::GetLodCount() const
+{
+	return lodCount;
+}
+
+const MeshLod& Mesh::GetLod(size_t lod) const
+{
+	return lods[lod];
+}
+
+size_t Mesh::SelectLod(GLfloat pixelsPerUnit, GLfloat maxPixelError) const
+{
+	// Errors grow with every level, so the first one that is too coarse ends the search
+	size_t lod = 0;
+	while (lod + 1 < lodCount && lods[lod + 1].error * pixelsPerUnit <= maxPixelError)
 	{
-		glDeleteVertexArrays(1, &VAO);
-		VAO = 0;
+		lod++;
 	}
-	indexCount = 0;
+	return lod;
+}
+
+size_t Mesh::GetMeshletCount() const
+{
+	return meshlets.size();
+}
+
+const Meshlet& Mesh::GetMeshlet(size_t meshlet) const
+{
+	return meshlets[meshlet];
 }
 
 Mesh::~Mesh()
 {
 	ClearMesh();
 }
-
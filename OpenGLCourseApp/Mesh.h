@@ -1,18 +1,81 @@
 #pragma once
+#include <vector>
+
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "RingBuffer.h"
+#include "GeometryPool.h"
+#include "Meshlet.h"
+#include "Material.h"
+
+// One level of detail, a range of the mesh's indices over the same vertices. error is how far the level's surface
+// is from the full detail one, in object space units
+struct MeshLod
+{
+	GLuint firstIndex;
+	GLsizei indexCount;
+	GLfloat error;
+};
+
+// Handle to one allocation in a GeometryPool, drawing binds the pool's shared VAO
 class Mesh
 {
 public:
+	static constexpr size_t MAX_LODS = 4;
+
 	Mesh();
 
-	void CreateMesh(const GLfloat *vertices, const unsigned int *indices, GLsizei numOfVertices, GLsizei numOfIndices);
-	void RenderMesh() const;
+	// Vertices are 8 floats each, encoded into the pool's format. Bounds are computed from the vertices unless
+	// they are already known
+	void CreateMesh(GeometryPool *pool, const GLfloat *vertices, const unsigned int *indices, GLsizei numOfVertices, GLsizei numOfIndices,
+		const AABB *knownBounds = nullptr);
+	// Vertices already encoded in the pool's format against bounds, like the ones of cooked models. With lods,
+	// indices holds the index ranges of all levels from the most detailed one on, otherwise it's a single level.
+	// Meshlets split the most detailed level
+	void CreateEncodedMesh(GeometryPool *pool, const void *vertices, GLsizei vertexCount, const unsigned int *indices,
+		GLsizei numOfIndices, const AABB &meshBounds, const MeshLod *meshLods = nullptr, size_t lodCount = 0,
+		const Meshlet *meshMeshlets = nullptr, size_t meshletCount = 0);
+	// One draw of the full detail level for all the model matrices, which are streamed through the ring buffer
+	void RenderMesh(const glm::mat4 *models, GLsizei instanceCount, RingBuffer *instanceBuffer) const;
+
+	// Instance data of this mesh drawn at every model matrix, material can be null. normals holds the normal
+	// matrix of each model matrix, without them they are derived here
+	void WriteInstances(const glm::mat4 *models, const glm::mat3 *normals, GLsizei instanceCount, const Material *material,
+		GLint faceMask, InstanceData *instances) const;
+	// Indirect command drawing indexCount of the mesh's indices from firstIndex, like a level or a meshlet range
+	DrawElementsIndirectCommand MakeDrawCommand(GLuint firstIndex, GLsizei indexCount, GLsizei instanceCount,
+		GLuint baseInstance) const;
 	void ClearMesh();
 
+	// Object space bounds of the vertex positions
+	const AABB &GetBounds() const;
+	GLuint GetVertexArrayId() const;
+	GeometryPool *GetPool() const;
+	GLenum GetIndexType() const;
+	// Unique among the meshes of the same pool
+	GLuint GetMeshId() const;
+
+	size_t GetLodCount() const;
+	const MeshLod &GetLod(size_t lod) const;
+	// Coarsest level whose error stays within maxPixelError on screen, pixelsPerUnit is how many pixels one object
+	// space unit covers where the mesh is drawn
+	size_t SelectLod(GLfloat pixelsPerUnit, GLfloat maxPixelError) const;
+
+	size_t GetMeshletCount() const;
+	const Meshlet &GetMeshlet(size_t meshlet) const;
+
 	~Mesh();
 
 private:
-	GLuint VAO, VBO, IBO;
-	GLsizei indexCount;
+	GeometryPool *pool;
+	GLuint allocation;
+	AABB bounds;
+	MeshLod lods[MAX_LODS];
+	size_t lodCount;
+	std::vector<Meshlet> meshlets;
+	// Undoes the position quantization of the pool's format
+	glm::vec3 positionScale, positionOffset;
 };
 
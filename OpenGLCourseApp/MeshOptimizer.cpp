@@ -0,0 +1,410 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	// Forsyth's scoring keeps a larger LRU cache than the hardware FIFO, it only ranks candidates
+	constexpr unsigned FORSYTH_CACHE_SIZE = 32;
+	constexpr GLfloat CACHE_DECAY_POWER = 1.5f;
+	constexpr GLfloat LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr GLfloat VALENCE_BOOST_SCALE = 2.0f;
+	constexpr GLfloat VALENCE_BOOST_POWER = 0.5f;
+
+	constexpr unsigned NO_TRIANGLE = 0xFFFFFFFF;
+
+	// Smallest cluster the overdraw pass cuts off at a soft boundary
+	constexpr size_t MIN_CLUSTER_TRIANGLES = 16;
+
+	constexpr size_t FLOATS_PER_VERTEX = 8;
+
+	GLfloat ScoreVertex(int cachePosition, unsigned remainingValence)
+	{
+		// Vertices without triangles left don't make any triangle more attractive
+		if (remainingValence == 0)
+		{
+			return -1.0f;
+		}
+
+		GLfloat score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score, so its neighbours aren't preferred over each other
+			if (cachePosition < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				const GLfloat scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Vertices with few triangles left are worth finishing off
+		score += VALENCE_BOOST_SCALE * std::pow(static_cast<GLfloat>(remainingValence), -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	// FIFO cache simulated with a timestamp per vertex: a vertex is cached if it was added less than
+	// CACHE_SIZE misses ago
+	class FifoCache
+	{
+	public:
+		explicit FifoCache(size_t vertexCount) : stamps(vertexCount, 0), time(MeshOptimizer::CACHE_SIZE + 1) {}
+
+		// Returns whether the vertex missed
+		bool Touch(unsigned vertex)
+		{
+			if (time - stamps[vertex] > MeshOptimizer::CACHE_SIZE)
+			{
+				stamps[vertex] = time++;
+				return true;
+			}
+			return false;
+		}
+
+		unsigned TouchTriangle(const unsigned *triangle)
+		{
+			return Touch(triangle[0]) + Touch(triangle[1]) + Touch(triangle[2]);
+		}
+
+		void Flush()
+		{
+			time += MeshOptimizer::CACHE_SIZE + 1;
+		}
+
+	private:
+		std::vector<unsigned> stamps;
+		unsigned time;
+	};
+}
+
+VertexCacheStats::VertexCacheStats() : triangles(0), vertices(0), transforms(0)
+{}
+
+void VertexCacheStats::Add(const VertexCacheStats& stats)
+{
+	triangles += stats.triangles;
+	vertices += stats.vertices;
+	transforms += stats.transforms;
+}
+
+double VertexCacheStats::GetACMR() const
+{
+	return triangles ? static_cast<double>(transforms) / triangles : 0.0;
+}
+
+double VertexCacheStats::GetATVR() const
+{
+	return vertices ? static_cast<double>(transforms) / vertices : 0.0;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles of every vertex, the ones not emitted yet are kept at the front of each vertex's list
+	std::vector<unsigned> valence(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		valence[indices[i]]++;
+	}
+
+	std::vector<unsigned> adjacencyOffsets(vertexCount + 1, 0);
+	std::partial_sum(valence.begin(), valence.end(), adjacencyOffsets.begin() + 1);
+
+	std::vector<unsigned> adjacency(triangleCount * 3);
+	std::vector<unsigned> filled(vertexCount, 0);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (size_t k = 0; k < 3; k++)
+		{
+			const unsigned vertex = indices[t * 3 + k];
+			adjacency[adjacencyOffsets[vertex] + filled[vertex]++] = static_cast<unsigned>(t);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<GLfloat> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		vertexScore[v] = ScoreVertex(-1, valence[v]);
+	}
+
+	std::vector<GLfloat> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	}
+
+	// Start with the best triangle overall, after that only triangles of cached vertices are candidates
+	unsigned bestTriangle = static_cast<unsigned>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+	size_t nextUnemitted = 0;
+
+	std::vector<unsigned> cache, newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	std::vector<unsigned> output;
+	output.reserve(triangleCount * 3);
+
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		if (bestTriangle == NO_TRIANGLE)
+		{
+			// The cache ran dry, carry on with the first triangle that is left
+			while (emitted[nextUnemitted])
+			{
+				nextUnemitted++;
+			}
+			bestTriangle = static_cast<unsigned>(nextUnemitted);
+		}
+
+		const unsigned *triangle = &indices[bestTriangle * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			const unsigned vertex = triangle[k];
+			unsigned *triangles = &adjacency[adjacencyOffsets[vertex]];
+			for (unsigned j = 0; j < valence[vertex]; j++)
+			{
+				if (triangles[j] == bestTriangle)
+				{
+					std::swap(triangles[j], triangles[valence[vertex] - 1]);
+					break;
+				}
+			}
+			valence[vertex]--;
+		}
+
+		// The triangle's vertices move to the front, everything past the cache size drops out
+		newCache.assign(triangle, triangle + 3);
+		for (size_t j = 0; j < cache.size(); j++)
+		{
+			const unsigned vertex = cache[j];
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+			{
+				newCache.push_back(vertex);
+			}
+		}
+
+		for (size_t j = 0; j < newCache.size(); j++)
+		{
+			const unsigned vertex = newCache[j];
+			cachePosition[vertex] = j < FORSYTH_CACHE_SIZE ? static_cast<int>(j) : -1;
+
+			const GLfloat score = ScoreVertex(cachePosition[vertex], valence[vertex]);
+			const GLfloat delta = score - vertexScore[vertex];
+			vertexScore[vertex] = score;
+
+			const unsigned *triangles = &adjacency[adjacencyOffsets[vertex]];
+			for (unsigned k = 0; k < valence[vertex]; k++)
+			{
+				triangleScore[triangles[k]] += delta;
+			}
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE)
+		{
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+
+		bestTriangle = NO_TRIANGLE;
+		GLfloat bestScore = -1.0f;
+		for (size_t j = 0; j < cache.size(); j++)
+		{
+			const unsigned vertex = cache[j];
+			const unsigned *triangles = &adjacency[adjacencyOffsets[vertex]];
+			for (unsigned k = 0; k < valence[vertex]; k++)
+			{
+				if (triangleScore[triangles[k]] > bestScore)
+				{
+					bestScore = triangleScore[triangles[k]];
+					bestTriangle = triangles[k];
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices, GLfloat threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	const size_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+	if (triangleCount < MIN_CLUSTER_TRIANGLES * 2)
+	{
+		return;
+	}
+
+	// Hard boundaries, where all three vertices miss and the cache effectively starts over
+	FifoCache fifo(vertexCount);
+	std::vector<size_t> hardClusters;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (fifo.TouchTriangle(&indices[t * 3]) == 3 || t == 0)
+		{
+			hardClusters.push_back(t);
+		}
+	}
+	hardClusters.push_back(triangleCount);
+
+	// Soft boundaries inside each hard cluster, where cutting costs little compared to the cluster's own ACMR
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c + 1 < hardClusters.size(); c++)
+	{
+		const size_t begin = hardClusters[c];
+		const size_t end = hardClusters[c + 1];
+
+		fifo.Flush();
+		unsigned clusterMisses = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			clusterMisses += fifo.TouchTriangle(&indices[t * 3]);
+		}
+		const GLfloat clusterACMR = static_cast<GLfloat>(clusterMisses) / (end - begin);
+
+		clusters.push_back(begin);
+		fifo.Flush();
+		unsigned segmentMisses = 0;
+		size_t segmentBegin = begin;
+		for (size_t t = begin; t < end; t++)
+		{
+			segmentMisses += fifo.TouchTriangle(&indices[t * 3]);
+
+			const size_t segmentTriangles = t + 1 - segmentBegin;
+			if (segmentTriangles >= MIN_CLUSTER_TRIANGLES && end - (t + 1) >= MIN_CLUSTER_TRIANGLES &&
+				static_cast<GLfloat>(segmentMisses) / segmentTriangles <= clusterACMR * threshold)
+			{
+				clusters.push_back(t + 1);
+				segmentBegin = t + 1;
+				segmentMisses = 0;
+				fifo.Flush();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	const size_t clusterCount = clusters.size() - 1;
+
+	// Area weighted centroid and normal of every cluster and of the whole mesh
+	glm::vec3 meshCentroid(0.0f);
+	GLfloat meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		GLfloat clusterArea = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const GLfloat *p0 = &vertices[indices[t * 3] * FLOATS_PER_VERTEX];
+			const GLfloat *p1 = &vertices[indices[t * 3 + 1] * FLOATS_PER_VERTEX];
+			const GLfloat *p2 = &vertices[indices[t * 3 + 2] * FLOATS_PER_VERTEX];
+			const glm::vec3 a(p0[0], p0[1], p0[2]), b(p1[0], p1[1], p1[2]), d(p2[0], p2[1], p2[2]);
+
+			const glm::vec3 normal = glm::cross(b - a, d - a);
+			const GLfloat area = glm::length(normal);
+			const glm::vec3 centroid = (a + b + d) / 3.0f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += clusterCentroids[c];
+		meshArea += clusterArea;
+		if (clusterArea > 0.0f)
+		{
+			clusterCentroids[c] /= clusterArea;
+		}
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters that face away from the center hide the ones behind them, so they go first
+	std::vector<GLfloat> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		const GLfloat length = glm::length(clusterNormals[c]);
+		sortKeys[c] = length > 0.0f ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / length) : 0.0f;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<unsigned> output;
+	output.reserve(indices.size());
+	for (size_t i = 0; i < clusterCount; i++)
+	{
+		const size_t c = order[i];
+		output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<unsigned int>& indices, std::vector<GLfloat>& vertices)
+{
+	const unsigned UNUSED = 0xFFFFFFFF;
+	const size_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+
+	std::vector<unsigned> remap(vertexCount, UNUSED);
+	std::vector<GLfloat> reordered;
+	reordered.reserve(vertices.size());
+
+	unsigned nextVertex = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const unsigned vertex = indices[i];
+		if (remap[vertex] == UNUSED)
+		{
+			remap[vertex] = nextVertex++;
+			reordered.insert(reordered.end(), vertices.begin() + vertex * FLOATS_PER_VERTEX,
+				vertices.begin() + (vertex + 1) * FLOATS_PER_VERTEX);
+		}
+		indices[i] = remap[vertex];
+	}
+
+	vertices.swap(reordered);
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	VertexCacheStats stats;
+	stats.triangles = indices.size() / 3;
+
+	FifoCache fifo(vertexCount);
+	for (size_t t = 0; t < stats.triangles; t++)
+	{
+		stats.transforms += fifo.TouchTriangle(&indices[t * 3]);
+	}
+
+	std::vector<bool> referenced(vertexCount, false);
+	for (unsigned index : indices)
+	{
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			stats.vertices++;
+		}
+	}
+
+	return stats;
+}
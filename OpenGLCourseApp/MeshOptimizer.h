@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+
+// Post-transform vertex cache behaviour of an index buffer, simulated with a FIFO cache. Counts add up over
+// meshes, so one report can cover a whole model
+struct VertexCacheStats
+{
+	unsigned long long triangles;
+	// Vertices the indices reference, so the count doesn't change when unused vertices are dropped
+	unsigned long long vertices;
+	// Vertices that missed the cache and had to be shaded
+	unsigned long long transforms;
+
+	VertexCacheStats();
+
+	void Add(const VertexCacheStats &stats);
+
+	// Average cache miss ratio, transforms per triangle (0.5 is the best a regular grid can get, 3 is no reuse)
+	double GetACMR() const;
+	// Average transform to vertex ratio, transforms per vertex (1 is ideal)
+	double GetATVR() const;
+};
+
+// Reorders the triangles and vertices of indexed triangle lists with 8 float vertices (position, uv, normal),
+// in place. Meant to run once after import, the order is what gets cooked
+class MeshOptimizer
+{
+public:
+	// FIFO cache size the stats and the overdraw clustering simulate, about what current hardware reuses
+	static constexpr unsigned CACHE_SIZE = 16;
+
+	// Forsyth's linear speed vertex cache optimization
+	static void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+	// Splits the cache optimized order into clusters and draws the clusters facing out of the mesh first, so
+	// more of the mesh is rejected by the depth test. Assumes counter-clockwise front faces. Clusters are cut
+	// where the cache restarts anyway, and at points where the cluster so far has an ACMR within threshold of the
+	// original
+	static void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<GLfloat> &vertices, GLfloat threshold);
+
+	// Orders vertices by first use in the index buffer, so vertex fetch walks the buffer mostly forwards.
+	// Unreferenced vertices are dropped, vertices shrinks to what is still used
+	static void OptimizeVertexFetch(std::vector<unsigned int> &indices, std::vector<GLfloat> &vertices);
+
+	// vertexCount sizes the simulated cache, only referenced vertices count towards the stats
+	static VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount);
+};
@@ -0,0 +1,493 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	constexpr size_t FLOATS_PER_VERTEX = 8;
+
+	// Symmetric 4x4 matrix of the summed squared distances to a set of planes
+	struct Quadric
+	{
+		double a00, a01, a02, a03;
+		double a11, a12, a13;
+		double a22, a23;
+		double a33;
+
+		Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0), a22(0), a23(0), a33(0) {}
+
+		void AddPlane(glm::vec3 normal, double distance)
+		{
+			a00 += normal.x * normal.x;
+			a01 += normal.x * normal.y;
+			a02 += normal.x * normal.z;
+			a03 += normal.x * distance;
+			a11 += normal.y * normal.y;
+			a12 += normal.y * normal.z;
+			a13 += normal.y * distance;
+			a22 += normal.z * normal.z;
+			a23 += normal.z * distance;
+			a33 += distance * distance;
+		}
+
+		void Add(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+			a11 += other.a11; a12 += other.a12; a13 += other.a13;
+			a22 += other.a22; a23 += other.a23;
+			a33 += other.a33;
+		}
+
+		// Summed squared distance of point to the planes. At least the squared distance to the farthest of them,
+		// so its root bounds how far the point is from every plane, not just on average
+		double Evaluate(glm::vec3 point) const
+		{
+			const double x = point.x, y = point.y, z = point.z;
+			const double sum = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+				a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+				a22 * z * z + 2.0 * a23 * z + a33;
+			return std::max(sum, 0.0);
+		}
+	};
+
+	// Edge between two positions, from collapsing onto to
+	struct Collapse
+	{
+		unsigned from, to;
+		double cost;
+	};
+
+	// Where a vertex at the collapsing position goes
+	struct WedgeMove
+	{
+		unsigned from, to;
+	};
+
+	glm::vec3 GetPosition(const std::vector<GLfloat>& vertices, unsigned vertex)
+	{
+		const GLfloat *p = &vertices[vertex * FLOATS_PER_VERTEX];
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	bool SameUv(const std::vector<GLfloat>& vertices, unsigned a, unsigned b)
+	{
+		const GLfloat *p = &vertices[a * FLOATS_PER_VERTEX];
+		const GLfloat *q = &vertices[b * FLOATS_PER_VERTEX];
+		return p[3] == q[3] && p[4] == q[4];
+	}
+
+	GLfloat NormalSimilarity(const std::vector<GLfloat>& vertices, unsigned a, unsigned b)
+	{
+		const GLfloat *p = &vertices[a * FLOATS_PER_VERTEX];
+		const GLfloat *q = &vertices[b * FLOATS_PER_VERTEX];
+		return p[5] * q[5] + p[6] * q[6] + p[7] * q[7];
+	}
+
+	// Welds the vertices that only differ in their uv or normal: positions receives the first vertex at each
+	// vertex's position, uvGroups the first vertex at the same position with the same uv
+	void FindWedges(const std::vector<GLfloat>& vertices, std::vector<unsigned>& positions, std::vector<unsigned>& uvGroups)
+	{
+		const size_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+
+		struct PositionHash
+		{
+			size_t operator()(const glm::vec3& p) const
+			{
+				const std::hash<float> hash;
+				return hash(p.x) ^ (hash(p.y) * 31) ^ (hash(p.z) * 131);
+			}
+		};
+		struct PositionEqual
+		{
+			bool operator()(const glm::vec3& a, const glm::vec3& b) const
+			{
+				return a.x == b.x && a.y == b.y && a.z == b.z;
+			}
+		};
+
+		// Vertices at the same position, as a list through nextWedge starting at the first of them
+		std::unordered_map<glm::vec3, unsigned, PositionHash, PositionEqual> firstAtPosition;
+		std::vector<unsigned> lastWedge(vertexCount), nextWedge(vertexCount);
+		positions.resize(vertexCount);
+		uvGroups.resize(vertexCount);
+		for (unsigned v = 0; v < vertexCount; v++)
+		{
+			auto inserted = firstAtPosition.insert(std::make_pair(GetPosition(vertices, v), v));
+			const unsigned first = inserted.first->second;
+			positions[v] = first;
+			nextWedge[v] = v;
+			lastWedge[v] = v;
+			uvGroups[v] = v;
+
+			if (!inserted.second)
+			{
+				for (unsigned w = first; ; w = nextWedge[w])
+				{
+					if (SameUv(vertices, v, w))
+					{
+						uvGroups[v] = uvGroups[w];
+						break;
+					}
+					if (w == lastWedge[first])
+					{
+						break;
+					}
+				}
+				nextWedge[lastWedge[first]] = v;
+				lastWedge[first] = v;
+			}
+		}
+	}
+
+	// Positions that can't move: the ones on open borders and on edges more than two triangles share. Opposite
+	// directions count as the same edge
+	std::vector<bool> FindLockedPositions(const std::vector<unsigned int>& indices, const std::vector<unsigned>& positions)
+	{
+		std::vector<bool> locked(positions.size(), false);
+
+		std::vector<unsigned long long> edges;
+		edges.reserve(indices.size());
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned long long a = positions[indices[t + k]], b = positions[indices[t + (k + 1) % 3]];
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i + 1;
+			while (j < edges.size() && edges[j] == edges[i])
+			{
+				j++;
+			}
+			if (j - i != 2)
+			{
+				locked[static_cast<unsigned>(edges[i] >> 32)] = true;
+				locked[static_cast<unsigned>(edges[i] & 0xFFFFFFFFull)] = true;
+			}
+			i = j;
+		}
+
+		return locked;
+	}
+
+	// Whether moving from onto to turns any of from's triangles over or collapses it to nothing
+	bool FlipsTriangle(const std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+		const std::vector<unsigned>& positions, const std::vector<unsigned>& offsets, const std::vector<unsigned>& adjacency,
+		unsigned from, unsigned to)
+	{
+		const glm::vec3 target = GetPosition(vertices, to);
+		for (unsigned j = offsets[from]; j < offsets[from + 1]; j++)
+		{
+			const unsigned *triangle = &indices[adjacency[j] * 3];
+			if (positions[triangle[0]] == to || positions[triangle[1]] == to || positions[triangle[2]] == to)
+			{
+				// Removed by the collapse
+				continue;
+			}
+
+			glm::vec3 before[3], after[3];
+			for (size_t k = 0; k < 3; k++)
+			{
+				before[k] = GetPosition(vertices, triangle[k]);
+				after[k] = positions[triangle[k]] == from ? target : before[k];
+			}
+
+			const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Finds a vertex at to for every vertex at from that from's triangles use. A vertex can only go to one with the
+	// same uv island across the collapsing edge, found through the triangles that have both positions, so uv seams
+	// only ever collapse along themselves. Among those the closest normal wins. False if a vertex has nowhere to go
+	bool MoveWedges(const std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+		const std::vector<unsigned>& positions, const std::vector<unsigned>& uvGroups, const std::vector<unsigned>& offsets,
+		const std::vector<unsigned>& adjacency, unsigned from, unsigned to, std::vector<WedgeMove>& crossings,
+		std::vector<WedgeMove>& moves)
+	{
+		// uv group at from and vertex at to of the corners of the collapsing edge
+		crossings.clear();
+		for (unsigned j = offsets[from]; j < offsets[from + 1]; j++)
+		{
+			const unsigned *triangle = &indices[adjacency[j] * 3];
+			unsigned fromVertex = 0, toVertex = 0;
+			bool hasTo = false;
+			for (size_t k = 0; k < 3; k++)
+			{
+				if (positions[triangle[k]] == from)
+				{
+					fromVertex = triangle[k];
+				}
+				else if (positions[triangle[k]] == to)
+				{
+					toVertex = triangle[k];
+					hasTo = true;
+				}
+			}
+			if (hasTo)
+			{
+				WedgeMove crossing;
+				crossing.from = uvGroups[fromVertex];
+				crossing.to = toVertex;
+				crossings.push_back(crossing);
+			}
+		}
+
+		moves.clear();
+		for (unsigned j = offsets[from]; j < offsets[from + 1]; j++)
+		{
+			const unsigned *triangle = &indices[adjacency[j] * 3];
+			unsigned vertex = triangle[0];
+			for (size_t k = 1; k < 3; k++)
+			{
+				if (positions[triangle[k]] == from)
+				{
+					vertex = triangle[k];
+				}
+			}
+
+			bool moved = false;
+			for (const WedgeMove &move : moves)
+			{
+				moved = moved || move.from == vertex;
+			}
+			if (moved)
+			{
+				continue;
+			}
+
+			WedgeMove move;
+			move.from = vertex;
+			GLfloat bestSimilarity = -2.0f;
+			for (const WedgeMove &crossing : crossings)
+			{
+				const GLfloat similarity = NormalSimilarity(vertices, vertex, crossing.to);
+				if (crossing.from == uvGroups[vertex] && similarity > bestSimilarity)
+				{
+					move.to = crossing.to;
+					bestSimilarity = similarity;
+				}
+			}
+			if (bestSimilarity < -1.5f)
+			{
+				return false;
+			}
+			moves.push_back(move);
+		}
+
+		return true;
+	}
+}
+
+std::vector<unsigned int> MeshSimplifier::Simplify(const std::vector<unsigned int>& indices, const std::vector<GLfloat>& vertices,
+	size_t targetIndexCount, GLfloat targetError, GLfloat* error)
+{
+	const size_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+
+	// Topology and quadrics are kept per position, by its first vertex
+	std::vector<unsigned> positions, uvGroups;
+	FindWedges(vertices, positions, uvGroups);
+
+	// Triangles with two corners at the same position have no area and no place in the topology
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		const unsigned a = positions[indices[t]], b = positions[indices[t + 1]], c = positions[indices[t + 2]];
+		if (a != b && b != c && a != c)
+		{
+			result.insert(result.end(), indices.begin() + t, indices.begin() + t + 3);
+		}
+	}
+
+	const std::vector<bool> locked = FindLockedPositions(result, positions);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t t = 0; t < result.size(); t += 3)
+	{
+		const glm::vec3 a = GetPosition(vertices, result[t]);
+		const glm::vec3 b = GetPosition(vertices, result[t + 1]);
+		const glm::vec3 c = GetPosition(vertices, result[t + 2]);
+		const glm::vec3 cross = glm::cross(b - a, c - a);
+		const GLfloat doubleArea = glm::length(cross);
+		if (doubleArea <= 0.0f)
+		{
+			continue;
+		}
+
+		const glm::vec3 normal = cross / doubleArea;
+		const double distance = -glm::dot(normal, a);
+		for (size_t k = 0; k < 3; k++)
+		{
+			quadrics[positions[result[t + k]]].AddPlane(normal, distance);
+		}
+	}
+
+	const double maxCost = static_cast<double>(targetError) * targetError;
+	double largestCost = 0.0;
+
+	std::vector<unsigned> offsets, adjacency, remap(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<unsigned long long> edges;
+	std::vector<bool> touched;
+	std::vector<WedgeMove> crossings, moves;
+
+	// Every pass collapses as many independent edges as it can in order of cost, then rebuilds
+	while (result.size() > targetIndexCount)
+	{
+		const size_t triangleCount = result.size() / 3;
+
+		// Triangles around each position
+		offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			offsets[positions[result[i]] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<unsigned> filled(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacency[filled[positions[result[i]]]++] = static_cast<unsigned>(i / 3);
+		}
+
+		edges.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned long long a = positions[result[t * 3 + k]], b = positions[result[t * 3 + (k + 1) % 3]];
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		// Cheaper direction of every edge that has one that can move
+		collapses.clear();
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			const unsigned a = static_cast<unsigned>(edges[i] >> 32);
+			const unsigned b = static_cast<unsigned>(edges[i] & 0xFFFFFFFFull);
+			if (locked[a] && locked[b])
+			{
+				continue;
+			}
+
+			Quadric combined = quadrics[a];
+			combined.Add(quadrics[b]);
+
+			Collapse collapse;
+			collapse.cost = -1.0;
+			if (!locked[a])
+			{
+				collapse.from = a;
+				collapse.to = b;
+				collapse.cost = combined.Evaluate(GetPosition(vertices, b));
+			}
+			if (!locked[b])
+			{
+				const double cost = combined.Evaluate(GetPosition(vertices, a));
+				if (collapse.cost < 0.0 || cost < collapse.cost)
+				{
+					collapse.from = b;
+					collapse.to = a;
+					collapse.cost = cost;
+				}
+			}
+			collapses.push_back(collapse);
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = static_cast<unsigned>(v);
+		}
+		touched.assign(vertexCount, false);
+
+		// Usually two triangles go away per collapse, stop once the target is reached
+		size_t trianglesLeft = triangleCount;
+		const size_t targetTriangles = targetIndexCount / 3;
+		size_t collapsed = 0;
+		for (size_t i = 0; i < collapses.size() && trianglesLeft > targetTriangles; i++)
+		{
+			const Collapse &collapse = collapses[i];
+			if (collapse.cost > maxCost)
+			{
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to] ||
+				FlipsTriangle(result, vertices, positions, offsets, adjacency, collapse.from, collapse.to) ||
+				!MoveWedges(result, vertices, positions, uvGroups, offsets, adjacency, collapse.from, collapse.to, crossings, moves))
+			{
+				continue;
+			}
+
+			// Triangles around from change shape, none of their positions can collapse again this pass
+			for (unsigned j = offsets[collapse.from]; j < offsets[collapse.from + 1]; j++)
+			{
+				const unsigned *triangle = &result[adjacency[j] * 3];
+				bool removed = false;
+				for (size_t k = 0; k < 3; k++)
+				{
+					touched[positions[triangle[k]]] = true;
+					removed = removed || positions[triangle[k]] == collapse.to;
+				}
+				if (removed)
+				{
+					trianglesLeft--;
+				}
+			}
+
+			for (const WedgeMove &move : moves)
+			{
+				remap[move.from] = move.to;
+			}
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			largestCost = std::max(largestCost, collapse.cost);
+			collapsed++;
+		}
+
+		if (collapsed == 0)
+		{
+			break;
+		}
+
+		// Collapsed triangles have two corners at the same position now and are dropped
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			const unsigned a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+			if (positions[a] != positions[b] && positions[b] != positions[c] && positions[a] != positions[c])
+			{
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+	}
+
+	if (error)
+	{
+		*error = static_cast<GLfloat>(std::sqrt(largestCost));
+	}
+	return result;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+
+// Quadric error metric simplification (Garland & Heckbert) of indexed triangle lists with 8 float vertices.
+// Edges collapse onto one of their vertices, so the result indexes the same vertex buffer and every level of
+// detail can share it. The topology is that of the welded positions: vertices that only differ in uv or normal
+// (flat shading, uv seams) move together, each onto a vertex of the same uv island at the target, so uv seams only
+// collapse along themselves. Positions on open borders never move, so cracks don't open up
+class MeshSimplifier
+{
+public:
+	// Collapses the cheapest edges until the result has at most targetIndexCount indices or the next collapse
+	// would move the surface further than targetError. error receives a bound of how far any collapse moved a
+	// vertex from the planes of the triangles it merged, as object space distance
+	static std::vector<unsigned int> Simplify(const std::vector<unsigned int> &indices, const std::vector<GLfloat> &vertices,
+		size_t targetIndexCount, GLfloat targetError, GLfloat *error);
+};
@@ -0,0 +1,299 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "GeometryUtils.h"
+
+namespace
+{
+	constexpr size_t FLOATS_PER_VERTEX = 8;
+	// Positions closer than this are the same point when looking for holes
+	constexpr GLfloat WELD_EPSILON = 1e-6f;
+
+	glm::vec3 GetPosition(const std::vector<GLfloat>& vertices, unsigned vertex)
+	{
+		const GLfloat *p = &vertices[vertex * FLOATS_PER_VERTEX];
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	// Closed meshes have every edge shared by exactly two triangles once vertices split on uv or normal seams are
+	// joined again. orientation is 1 if the triangles wind counter-clockwise seen from outside, -1 if clockwise
+	bool IsClosed(const unsigned int* indices, size_t indexCount, const std::vector<GLfloat>& vertices, GLfloat& orientation)
+	{
+		GeometryStreams streams;
+		streams.Deinterleave(vertices.data(), vertices.size() / FLOATS_PER_VERTEX, FLOATS_PER_VERTEX, 0, -1, -1);
+		std::vector<unsigned int> welded(indices, indices + indexCount);
+		GeometryUtils::WeldVertices(streams, welded, WELD_EPSILON);
+
+		std::vector<unsigned long long> edges;
+		edges.reserve(indexCount);
+		for (size_t t = 0; t + 2 < indexCount; t += 3)
+		{
+			// Triangles that collapse to a line once welded, like the ones at the poles of a sphere, cover nothing
+			if (welded[t] == welded[t + 1] || welded[t + 1] == welded[t + 2] || welded[t] == welded[t + 2])
+			{
+				continue;
+			}
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned long long a = welded[t + k], b = welded[t + (k + 1) % 3];
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i + 1;
+			while (j < edges.size() && edges[j] == edges[i])
+			{
+				j++;
+			}
+			if (j - i != 2)
+			{
+				return false;
+			}
+			i = j;
+		}
+
+		// Sign of the enclosed volume tells the winding apart
+		double volume = 0.0;
+		for (size_t t = 0; t + 2 < indexCount; t += 3)
+		{
+			const glm::vec3 a = GetPosition(vertices, indices[t]);
+			const glm::vec3 b = GetPosition(vertices, indices[t + 1]);
+			const glm::vec3 c = GetPosition(vertices, indices[t + 2]);
+			volume += glm::dot(a, glm::cross(b, c));
+		}
+		orientation = volume >= 0.0 ? 1.0f : -1.0f;
+		return volume != 0.0;
+	}
+
+	Meshlet MakeMeshlet(const unsigned int* indices, size_t firstIndex, size_t indexCount, const std::vector<GLfloat>& vertices,
+		bool cones, GLfloat orientation)
+	{
+		Meshlet meshlet;
+		meshlet.firstIndex = static_cast<uint32_t>(firstIndex);
+		meshlet.indexCount = static_cast<uint32_t>(indexCount);
+
+		glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+		for (size_t i = firstIndex; i < firstIndex + indexCount; i++)
+		{
+			const glm::vec3 position = GetPosition(vertices, indices[i]);
+			minimum = glm::min(minimum, position);
+			maximum = glm::max(maximum, position);
+		}
+
+		const glm::vec3 center = (minimum + maximum) * 0.5f;
+		GLfloat radius = 0.0f;
+		for (size_t i = firstIndex; i < firstIndex + indexCount; i++)
+		{
+			radius = std::max(radius, glm::length(GetPosition(vertices, indices[i]) - center));
+		}
+
+		// Outward facing unit normals, their average is the cone axis and the one furthest from it sets the angle
+		std::vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (size_t t = firstIndex; cones && t + 2 < firstIndex + indexCount; t += 3)
+		{
+			const glm::vec3 a = GetPosition(vertices, indices[t]);
+			const glm::vec3 b = GetPosition(vertices, indices[t + 1]);
+			const glm::vec3 c = GetPosition(vertices, indices[t + 2]);
+			const glm::vec3 normal = glm::cross(b - a, c - a) * orientation;
+			const GLfloat length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				normals.push_back(normal / length);
+				axis += normals.back();
+			}
+		}
+
+		GLfloat cutoff = 1.0f;
+		const GLfloat axisLength = glm::length(axis);
+		if (!normals.empty() && axisLength > 0.0f)
+		{
+			axis /= axisLength;
+
+			GLfloat minDot = 1.0f;
+			for (const glm::vec3 &normal : normals)
+			{
+				minDot = std::min(minDot, glm::dot(normal, axis));
+			}
+
+			// Normals spread over a hemisphere or more always have one facing the viewer
+			if (minDot > 0.0f)
+			{
+				cutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+		}
+		else
+		{
+			axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			meshlet.center[i] = center[i];
+			meshlet.coneAxis[i] = axis[i];
+		}
+		meshlet.radius = radius;
+		meshlet.coneCutoff = cutoff;
+		return meshlet;
+	}
+}
+
+std::vector<Meshlet> MeshletBuilder::Build(std::vector<unsigned int>& indices, size_t indexCount, const std::vector<GLfloat>& vertices)
+{
+	std::vector<Meshlet> meshlets;
+
+	const size_t vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+	const size_t triangleCount = indexCount / 3;
+
+	GLfloat orientation = 1.0f;
+	const bool cones = IsClosed(indices.data(), triangleCount * 3, vertices, orientation);
+
+	// Triangles around every vertex
+	std::vector<unsigned> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		offsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<unsigned> adjacency(triangleCount * 3);
+	std::vector<unsigned> filled(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[filled[indices[i]]++] = static_cast<unsigned>(i / 3);
+	}
+
+	std::vector<glm::vec3> normals(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3 a = GetPosition(vertices, indices[t * 3]);
+		const glm::vec3 b = GetPosition(vertices, indices[t * 3 + 1]);
+		const glm::vec3 c = GetPosition(vertices, indices[t * 3 + 2]);
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		const GLfloat length = glm::length(normal);
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	std::vector<unsigned int> ordered;
+	ordered.reserve(triangleCount * 3);
+	std::vector<bool> emitted(triangleCount, false);
+	// Vertices of the meshlet being filled are marked with its number
+	std::vector<unsigned> usedBy(vertexCount, ~0u);
+	std::vector<unsigned> meshletVertices;
+	unsigned meshletNumber = 0;
+	size_t nextSeed = 0;
+
+	while (true)
+	{
+		// New meshlets start from the earliest triangle left, so they follow the order the optimizers chose
+		while (nextSeed < triangleCount && emitted[nextSeed])
+		{
+			nextSeed++;
+		}
+		if (nextSeed == triangleCount)
+		{
+			break;
+		}
+
+		const size_t firstIndex = ordered.size();
+		meshletVertices.clear();
+		glm::vec3 normalSum(0.0f);
+		size_t triangle = nextSeed;
+
+		// Grows by the neighbouring triangle adding the fewest vertices, and among those the one closest to the
+		// meshlet's average normal, which keeps the normal cone narrow
+		while (triangle != triangleCount)
+		{
+			emitted[triangle] = true;
+			for (size_t k = 0; k < 3; k++)
+			{
+				const unsigned vertex = indices[triangle * 3 + k];
+				ordered.push_back(vertex);
+				if (usedBy[vertex] != meshletNumber)
+				{
+					usedBy[vertex] = meshletNumber;
+					meshletVertices.push_back(vertex);
+				}
+			}
+			normalSum += normals[triangle];
+
+			if ((ordered.size() - firstIndex) / 3 >= MAX_TRIANGLES)
+			{
+				break;
+			}
+
+			size_t best = triangleCount;
+			size_t bestNewVertices = 3;
+			GLfloat bestAlignment = -FLT_MAX;
+			for (const unsigned vertex : meshletVertices)
+			{
+				for (unsigned j = offsets[vertex]; j < offsets[vertex + 1]; j++)
+				{
+					const unsigned candidate = adjacency[j];
+					if (emitted[candidate])
+					{
+						continue;
+					}
+
+					size_t newVertices = 0;
+					for (size_t k = 0; k < 3; k++)
+					{
+						newVertices += usedBy[indices[candidate * 3 + k]] != meshletNumber;
+					}
+					if (meshletVertices.size() + newVertices > MAX_VERTICES)
+					{
+						continue;
+					}
+
+					const GLfloat alignment = glm::dot(normals[candidate], normalSum);
+					if (newVertices < bestNewVertices || (newVertices == bestNewVertices && alignment > bestAlignment))
+					{
+						best = candidate;
+						bestNewVertices = newVertices;
+						bestAlignment = alignment;
+					}
+				}
+			}
+			triangle = best;
+		}
+
+		meshlets.push_back(MakeMeshlet(ordered.data(), firstIndex, ordered.size() - firstIndex, vertices, cones, orientation));
+		meshletNumber++;
+	}
+
+	std::copy(ordered.begin(), ordered.end(), indices.begin());
+	return meshlets;
+}
+
+bool MeshletBuilder::IsBackFacing(const Meshlet& meshlet, glm::vec3 viewPoint)
+{
+	if (meshlet.coneCutoff >= 1.0f)
+	{
+		return false;
+	}
+
+	// The sphere stands in for the cone's apex, as every point of the cluster is inside it
+	const glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+	const glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+	const glm::vec3 toCenter = center - viewPoint;
+	return glm::dot(toCenter, axis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+bool MeshletBuilder::IsBackFacingDirection(const Meshlet& meshlet, glm::vec3 viewDirection)
+{
+	if (meshlet.coneCutoff >= 1.0f)
+	{
+		return false;
+	}
+
+	const glm::vec3 axis(meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]);
+	return glm::dot(glm::normalize(viewDirection), axis) >= meshlet.coneCutoff;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// A small cluster of a mesh's triangles, a contiguous range of its full detail indices. Written to cooked files as is
+struct Meshlet
+{
+	// Bounding sphere in object space
+	float center[3];
+	float radius;
+	// Every triangle's normal is within the cone around coneAxis, coneCutoff is the sine of the cone's half angle.
+	// A cutoff of 1 or more means the cluster has no usable cone and always faces the viewer
+	float coneAxis[3];
+	float coneCutoff;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// Splits meshes into meshlets and tests them against a view
+class MeshletBuilder
+{
+public:
+	static constexpr size_t MAX_VERTICES = 64;
+	static constexpr size_t MAX_TRIANGLES = 124;
+
+	// Groups the triangles of the first indexCount indices into meshlets and reorders them so that every meshlet
+	// is one range. Vertices are 8 floats each. Only meshes that are closed get normal cones, on an open surface
+	// the back of a triangle can be what the viewer sees
+	static std::vector<Meshlet> Build(std::vector<unsigned int> &indices, size_t indexCount, const std::vector<GLfloat> &vertices);
+
+	// Whether all the meshlet's triangles face away from viewPoint, both in object space
+	static bool IsBackFacing(const Meshlet &meshlet, glm::vec3 viewPoint);
+	// Same for a view looking along viewDirection, like a directional light's
+	static bool IsBackFacingDirection(const Meshlet &meshlet, glm::vec3 viewDirection);
+};
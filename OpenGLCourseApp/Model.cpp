@@ -1,36 +1,196 @@
 ﻿#include "Model.h"
 
+#include <cfloat>
+#include <cstring>
 #include <stdexcept>
 
 Model::Model() {}
 
-void Model::LoadModel(const std::string& fileName)
+void Model::LoadModel(const std::string& fileName, GeometryPool* pool)
 {
-	Assimp::Importer importer;
-	const aiScene *scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
+	const std::string cookedFileName = CookedModel::GetCookedFileName(fileName);
 
-	if(!scene)
+	CookedModel cooked(pool->GetFormat());
+	if (!cooked.Open(cookedFileName, fileName))
 	{
-		throw std::runtime_error("Model " + fileName + " failed to load: " + importer.GetErrorString());
+		ImportModel(fileName, &cooked);
+
+		if (!cooked.Write(cookedFileName, fileName))
+		{
+			printf("Failed to write cooked model at: %s\n", cookedFileName.c_str());
+		}
+	}
+
+	// Straight from the mapped file into the buffers
+	for (size_t i = 0; i < cooked.GetMeshCount(); i++)
+	{
+		const CookedMesh &cookedMesh = cooked.GetMesh(i);
+		const AABB meshBounds = CookedModel::GetBounds(cookedMesh);
+
+		MeshLod lods[Mesh::MAX_LODS];
+		const size_t lodCount = CookedModel::GetLods(cookedMesh, lods);
+
+		Mesh *newMesh = new Mesh();
+		newMesh->CreateEncodedMesh(pool, cooked.GetVertices(cookedMesh), cookedMesh.vertexCount, cooked.GetIndices(cookedMesh),
+			cookedMesh.indexCount, meshBounds, lods, lodCount, cooked.GetMeshlets(cookedMesh), cookedMesh.meshletCount);
+		meshList.push_back(newMesh);
+		meshToTex.push_back(cookedMesh.materialIndex);
+	}
+
+	// Open checked that parents come first, so their transforms are ready when the children need them
+	meshNodes.assign(meshList.size(), 0);
+	for (size_t i = 0; i < cooked.GetNodeCount(); i++)
+	{
+		const CookedNode &node = cooked.GetNode(i);
+		const glm::mat4 transform = CookedModel::GetTransform(node);
+		nodeParents.push_back(node.parent);
+		nodeTransforms.push_back(transform);
+		nodeWorlds.push_back(node.parent < 0 ? transform : nodeWorlds[node.parent] * transform);
+		for (uint32_t j = 0; j < node.meshCount; j++)
+		{
+			meshNodes[node.firstMesh + j] = static_cast<GLuint>(i);
+		}
+	}
+	if (nodeParents.empty())
+	{
+		nodeParents.push_back(TransformHierarchy::NO_PARENT);
+		nodeTransforms.push_back(glm::mat4(1.0f));
+		nodeWorlds.push_back(glm::mat4(1.0f));
+	}
+
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		bounds.AddBox(meshList[i]->GetBounds().Transform(nodeWorlds[meshNodes[i]]));
 	}
 
-	LoadNode(scene->mRootNode, scene);
+	// The cooked file is unmapped once loading is done, so the occluders keep their own copy
+	const GLfloat modelSize = glm::length(bounds.max - bounds.min);
+	for (size_t i = 0; i < cooked.GetMeshCount() && !bounds.IsEmpty(); i++)
+	{
+		const CookedMesh &cookedMesh = cooked.GetMesh(i);
+		const AABB meshBounds = CookedModel::GetBounds(cookedMesh);
+		const AABB placedBounds = meshBounds.Transform(nodeWorlds[meshNodes[i]]);
+		if (glm::length(placedBounds.max - placedBounds.min) < OCCLUDER_MIN_SIZE * modelSize)
+		{
+			continue;
+		}
+
+		Occluder occluder;
+		occluder.positions.resize(cookedMesh.vertexCount);
+		VertexLayout::DecodePositions(pool->GetFormat(), cooked.GetVertices(cookedMesh), cookedMesh.vertexCount, meshBounds,
+			occluder.positions.data());
+
+		// Full detail comes first, and is all there is without levels of detail
+		MeshLod lods[Mesh::MAX_LODS];
+		const size_t lodCount = CookedModel::GetLods(cookedMesh, lods);
+		const unsigned int *indices = cooked.GetIndices(cookedMesh);
+		occluder.indices.assign(indices, indices + (lodCount > 0 ? lods[0].indexCount : cookedMesh.indexCount));
 
-	LoadMaterials(scene);
+		occluders.push_back(occluder);
+		occluderNodes.push_back(meshNodes[i]);
+	}
+
+	LoadMaterials(cooked);
 }
 
-void Model::RenderModel()
+void Model::CookModel(const std::string& fileName, VertexFormat format)
 {
-	for(size_t i = 0; i < meshList.size(); i++)
+	const std::string cookedFileName = CookedModel::GetCookedFileName(fileName);
+
+	CookedModel cooked(format);
+	ImportModel(fileName, &cooked);
+
+	if (!cooked.Write(cookedFileName, fileName))
 	{
-		unsigned materialIndex = meshToTex[i];
+		throw std::runtime_error("Failed to write cooked model at: " + cookedFileName);
+	}
+}
+
+void Model::RenderModel(const glm::mat4* models, GLsizei instanceCount, RingBuffer* instanceBuffer)
+{
+	if (instanceCount <= 0)
+	{
+		return;
+	}
+
+	if (meshList.empty())
+	{
+		return;
+	}
+
+	// Every mesh decodes its positions differently, so each gets its own copy of the instances
+	GLintptr instanceOffset, commandOffset;
+	InstanceData *instances = static_cast<InstanceData*>(instanceBuffer->Allocate(GL_ARRAY_BUFFER,
+		sizeof(InstanceData) * instanceCount * meshList.size(), instanceOffset));
+	DrawElementsIndirectCommand *commands = static_cast<DrawElementsIndirectCommand*>(instanceBuffer->Allocate(
+		GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * meshList.size(), commandOffset));
 
-		if(materialIndex < textureList.size() && textureList[materialIndex])
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		const GLuint baseInstance = static_cast<GLuint>(i * instanceCount);
+		meshModels.resize(instanceCount);
+		for (GLsizei j = 0; j < instanceCount; j++)
 		{
-			textureList[materialIndex]->UseTexture();
+			meshModels[j] = models[j] * nodeWorlds[meshNodes[i]];
 		}
+		meshList[i]->WriteInstances(meshModels.data(), nullptr, instanceCount, nullptr, 0, instances + baseInstance);
+
+		const MeshLod &lod = meshList[i]->GetLod(0);
+		commands[i] = meshList[i]->MakeDrawCommand(lod.firstIndex, lod.indexCount, instanceCount, baseInstance);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceBuffer->GetBufferId());
+	meshList[0]->GetPool()->BindInstances(instanceBuffer->GetBufferId(), instanceOffset);
+
+	// One multi-draw per run of meshes with the same texture and index type
+	size_t batchStart = 0;
+	for (size_t i = 1; i <= meshList.size(); i++)
+	{
+		if (i < meshList.size() && GetMeshTexture(i) == GetMeshTexture(batchStart) &&
+			meshList[i]->GetIndexType() == meshList[batchStart]->GetIndexType())
+		{
+			continue;
+		}
+
+		Texture *texture = GetMeshTexture(batchStart);
+		if (texture)
+		{
+			texture->UseTexture();
+		}
+
+		meshList[batchStart]->GetPool()->MultiDrawIndirect(meshList[batchStart]->GetIndexType(),
+			commandOffset + sizeof(DrawElementsIndirectCommand) * batchStart, static_cast<GLsizei>(i - batchStart));
+		batchStart = i;
+	}
+}
+
+GLuint Model::AddToHierarchy(TransformHierarchy* hierarchy, GLint parent) const
+{
+	const GLuint rootNode = hierarchy->GetNodeCount();
+	for (size_t i = 0; i < nodeParents.size(); i++)
+	{
+		const GLint nodeParent = nodeParents[i] < 0 ? parent : static_cast<GLint>(rootNode) + nodeParents[i];
+		hierarchy->AddNode(nodeParent, nodeTransforms[i]);
+	}
+	return rootNode;
+}
+
+void Model::SubmitModel(RenderQueue* queue, Material* material, const FrameTransforms& scene, GLuint rootNode, GLint faceMask,
+	glm::vec3 center)
+{
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		const GLuint node = rootNode + meshNodes[i];
+		queue->Submit(meshList[i], GetMeshTexture(i), material, scene.GetWorlds(node), scene.GetNormals(node), 1, faceMask,
+			center);
+	}
+}
 
-		meshList[i]->RenderMesh();
+void Model::RasterizeOccluders(OcclusionCuller* culler, const FrameTransforms& scene, GLuint rootNode) const
+{
+	for (size_t i = 0; i < occluders.size(); i++)
+	{
+		culler->RasterizeOccluder(occluders[i], *scene.GetWorlds(rootNode + occluderNodes[i]));
 	}
 }
 
@@ -53,64 +213,153 @@ void Model::ClearModel()
 			textureList[i] = nullptr;
 		}
 	}
+
+	nodeParents.clear();
+	nodeTransforms.clear();
+	nodeWorlds.clear();
+	meshNodes.clear();
+	occluders.clear();
+	occluderNodes.clear();
+	bounds = AABB();
+}
+
+const AABB& Model::GetBounds() const
+{
+	return bounds;
+}
+
+size_t Model::GetMeshCount() const
+{
+	return meshList.size();
+}
+
+Texture* Model::GetMeshTexture(size_t mesh) const
+{
+	const unsigned materialIndex = meshToTex[mesh];
+	return materialIndex < textureList.size() ? textureList[materialIndex] : nullptr;
+}
+
+void Model::ImportModel(const std::string& fileName, CookedModel* cooked)
+{
+	Assimp::Importer importer;
+	const aiScene *scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
+
+	if(!scene)
+	{
+		throw std::runtime_error("Model " + fileName + " failed to load: " + importer.GetErrorString());
+	}
+
+	VertexCacheStats before, after;
+	ImportNode(scene->mRootNode, scene, -1, cooked, &before, &after);
+
+	printf("Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", fileName.c_str(),
+		before.GetACMR(), after.GetACMR(), before.GetATVR(), after.GetATVR());
+
+	ImportMaterials(scene, cooked);
 }
 
-void Model::LoadNode(aiNode* node, const aiScene* scene)
+void Model::ImportNode(aiNode* node, const aiScene* scene, int32_t parent, CookedModel* cooked, VertexCacheStats* before,
+	VertexCacheStats* after)
 {
 	for (size_t i = 0; i < node->mNumMeshes; i++)
 	{
-		LoadMesh(scene->mMeshes[node->mMeshes[i]], scene);
+		ImportMesh(scene->mMeshes[node->mMeshes[i]], cooked, before, after);
 	}
 
+	// Assimp's matrices are row major, glm's are column major
+	const aiMatrix4x4 &m = node->mTransformation;
+	const glm::mat4 transform(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+	const int32_t nodeIndex = static_cast<int32_t>(cooked->GetNodeCount());
+	cooked->AddNode(parent, transform, node->mNumMeshes);
+
 	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		LoadNode(node->mChildren[i], scene);
+		ImportNode(node->mChildren[i], scene, nodeIndex, cooked, before, after);
 	}
 }
 
-void Model::LoadMesh(aiMesh* mesh, const aiScene* scene)
+void Model::ImportMesh(aiMesh* mesh, CookedModel* cooked, VertexCacheStats* before, VertexCacheStats* after)
 {
-	std::vector<GLfloat> vertices;
+	// Triangulated, so every face has 3 indices
+	std::vector<GLfloat> vertices(mesh->mNumVertices * 8);
 	std::vector<unsigned> indices;
+	indices.reserve(mesh->mNumFaces * 3);
 
 	for(size_t i = 0; i < mesh->mNumVertices; i++)
 	{
-		vertices.insert(vertices.end(), { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z });
-		if(mesh->mTextureCoords[0])
-		{
-			vertices.insert(vertices.end(), { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y });
-		}
-		else
-		{
-			vertices.insert(vertices.end(), { 0.0f, 0.0f });
-		}
-		vertices.insert(vertices.end(), { -mesh->mNormals[i].x, -mesh->mNormals[i].y, -mesh->mNormals[i].z });
-
+		GLfloat *vertex = &vertices[i * 8];
+		vertex[0] = mesh->mVertices[i].x;
+		vertex[1] = mesh->mVertices[i].y;
+		vertex[2] = mesh->mVertices[i].z;
+		vertex[3] = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0][i].x : 0.0f;
+		vertex[4] = mesh->mTextureCoords[0] ? mesh->mTextureCoords[0][i].y : 0.0f;
+		vertex[5] = -mesh->mNormals[i].x;
+		vertex[6] = -mesh->mNormals[i].y;
+		vertex[7] = -mesh->mNormals[i].z;
 	}
 	for (size_t i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
-		for(size_t j = 0; j < face.mNumIndices; j++)
+		const aiFace &face = mesh->mFaces[i];
+		indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+	}
+
+	// Triangle order for the vertex cache first, then clusters for overdraw, then meshlets grown from that order,
+	// then vertices in the order they are used
+	before->Add(MeshOptimizer::AnalyzeVertexCache(indices, mesh->mNumVertices));
+	MeshOptimizer::OptimizeVertexCache(indices, mesh->mNumVertices);
+	MeshOptimizer::OptimizeOverdraw(indices, vertices, 1.05f);
+	const std::vector<Meshlet> meshlets = MeshletBuilder::Build(indices, indices.size(), vertices);
+	MeshOptimizer::OptimizeVertexFetch(indices, vertices);
+	after->Add(MeshOptimizer::AnalyzeVertexCache(indices, vertices.size() / 8));
+
+	MeshLod lods[Mesh::MAX_LODS];
+	const size_t lodCount = BuildLods(indices, vertices, lods);
+
+	cooked->AddMesh(vertices.data(), static_cast<GLsizei>(vertices.size()), indices.data(), static_cast<GLsizei>(indices.size()),
+		mesh->mMaterialIndex, lods, lodCount, meshlets.data(), meshlets.size());
+}
+
+size_t Model::BuildLods(std::vector<unsigned>& indices, const std::vector<GLfloat>& vertices, MeshLod* lods)
+{
+	lods[0].firstIndex = 0;
+	lods[0].indexCount = static_cast<GLsizei>(indices.size());
+	lods[0].error = 0.0f;
+
+	// Every level is simplified from the one before it, so the errors add up
+	std::vector<unsigned> previous(indices);
+	size_t lodCount = 1;
+	while (lodCount < Mesh::MAX_LODS && previous.size() / 3 >= LOD_MIN_TRIANGLES)
+	{
+		const size_t targetIndexCount = static_cast<size_t>(previous.size() / 3 * LOD_REDUCTION) * 3;
+
+		GLfloat error = 0.0f;
+		std::vector<unsigned> simplified = MeshSimplifier::Simplify(previous, vertices, targetIndexCount, FLT_MAX, &error);
+		if (simplified.empty() || simplified.size() > previous.size() * LOD_MIN_REDUCTION)
 		{
-			indices.push_back(face.mIndices[j]);
+			break;
 		}
+
+		MeshOptimizer::OptimizeVertexCache(simplified, vertices.size() / 8);
+
+		lods[lodCount].firstIndex = static_cast<GLuint>(indices.size());
+		lods[lodCount].indexCount = static_cast<GLsizei>(simplified.size());
+		lods[lodCount].error = lods[lodCount - 1].error + error;
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+
+		previous.swap(simplified);
+		lodCount++;
 	}
 
-	Mesh *newMesh = new Mesh();
-	newMesh->CreateMesh(vertices.data(), indices.data(), vertices.size(), indices.size());
-	meshList.push_back(newMesh);
-	meshToTex.push_back(mesh->mMaterialIndex);
+	return lodCount;
 }
 
-void Model::LoadMaterials(const aiScene* scene)
+void Model::ImportMaterials(const aiScene* scene, CookedModel* cooked)
 {
-	textureList.resize(scene->mNumMaterials);
-
 	for (size_t i = 0; i  < scene->mNumMaterials; i++)
 	{
 		aiMaterial *material = scene->mMaterials[i];
 
-		textureList[i] = nullptr;
+		std::string texPath;
 
 		if(material->GetTextureCount(aiTextureType_DIFFUSE))
 		{
@@ -120,16 +369,32 @@ void Model::LoadMaterials(const aiScene* scene)
 				const int idx = std::string(path.data).rfind("\\");
 				std::string fileName = std::string(path.data).substr(idx + 1);
 
-				std::string texPath = std::string("Textures/") + fileName;
+				texPath = std::string("Textures/") + fileName;
+			}
+		}
 
-				textureList[i] = new Texture(texPath.c_str());
+		cooked->AddMaterial(texPath);
+	}
+}
 
-				if(!textureList[i]->LoadTexture())
-				{
-					printf("Failed to load texture at: %s\n", texPath.c_str());
-					delete textureList[i];
-					textureList[i] = nullptr;
-				}
+void Model::LoadMaterials(const CookedModel& cooked)
+{
+	textureList.resize(cooked.GetMaterialCount());
+
+	for (size_t i = 0; i < cooked.GetMaterialCount(); i++)
+	{
+		textureList[i] = nullptr;
+
+		const std::string texPath = cooked.GetTextureName(i);
+		if (!texPath.empty())
+		{
+			textureList[i] = new Texture(texPath.c_str());
+
+			if(!textureList[i]->LoadTexture())
+			{
+				printf("Failed to load texture at: %s\n", texPath.c_str());
+				delete textureList[i];
+				textureList[i] = nullptr;
 			}
 		}
 
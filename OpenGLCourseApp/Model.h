@@ -9,23 +9,81 @@
 
 #include "Mesh.h"
 #include "Texture.h"
+#include "Material.h"
+#include "RenderQueue.h"
+#include "TransformHierarchy.h"
+#include "FrameTransforms.h"
+#include "OcclusionCuller.h"
+#include "CookedModel.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 
 class Model
 {
 public:
 	Model();
 
-	void LoadModel(const std::string& fileName);
-	void RenderModel();
+	// Loads the cooked file next to the model, and only imports the model with Assimp (and cooks it) when the
+	// cooked file is missing or stale
+	void LoadModel(const std::string& fileName, GeometryPool *pool);
+	// Imports and cooks the model without creating any GL objects, for cooking offline
+	static void CookModel(const std::string& fileName, VertexFormat format);
+	// Draws every mesh once per model matrix, with one indirect multi-draw per run of meshes sharing a texture.
+	// Meshes are placed by their nodes as they were imported
+	void RenderModel(const glm::mat4 *models, GLsizei instanceCount, RingBuffer *instanceBuffer);
+	// Adds the model's nodes below parent, depth first, and returns the index of its root node
+	GLuint AddToHierarchy(TransformHierarchy *hierarchy, GLint parent) const;
+	// Queues one draw per mesh with that mesh's texture, at the world matrix of its node. rootNode is what
+	// AddToHierarchy returned for the hierarchy scene was updated from
+	void SubmitModel(RenderQueue *queue, Material *material, const FrameTransforms &scene, GLuint rootNode, GLint faceMask,
+		glm::vec3 center);
+	// Draws the meshes big enough to hide something into the culler's buffer, placed like SubmitModel places them
+	void RasterizeOccluders(OcclusionCuller *culler, const FrameTransforms &scene, GLuint rootNode) const;
 	void ClearModel();
 
+	// Bounds of all meshes placed by their nodes, in the space the model's root node is in
+	const AABB &GetBounds() const;
+	size_t GetMeshCount() const;
+
 private:
+	// Each level of detail aims for this fraction of the previous level's triangles
+	static constexpr GLfloat LOD_REDUCTION = 0.5f;
+	// Meshes this small or levels that don't get much smaller aren't worth another level
+	static constexpr size_t LOD_MIN_TRIANGLES = 64;
+	static constexpr GLfloat LOD_MIN_REDUCTION = 0.9f;
+	// Meshes whose bounds are at least this fraction of the model's size are kept as occluders
+	static constexpr GLfloat OCCLUDER_MIN_SIZE = 0.25f;
+
+	static void ImportModel(const std::string& fileName, CookedModel *cooked);
+	// before and after collect the vertex cache stats of the meshes before and after optimizing them
+	static void ImportNode(aiNode *node, const aiScene *scene, int32_t parent, CookedModel *cooked, VertexCacheStats *before,
+		VertexCacheStats *after);
+	static void ImportMesh(aiMesh *mesh, CookedModel *cooked, VertexCacheStats *before, VertexCacheStats *after);
+	static void ImportMaterials(const aiScene *scene, CookedModel *cooked);
+	// Appends the coarser levels of detail after the optimized full detail indices, filling lods for all of them
+	static size_t BuildLods(std::vector<unsigned> &indices, const std::vector<GLfloat> &vertices, MeshLod *lods);
 
-	void LoadNode(aiNode *node, const aiScene *scene);
-	void LoadMesh(aiMesh *mesh, const aiScene *scene);
-	void LoadMaterials(const aiScene *scene);
+	void LoadMaterials(const CookedModel &cooked);
+	Texture *GetMeshTexture(size_t mesh) const;
 
 	std::vector<Mesh*> meshList;
 	std::vector<Texture*> textureList;
 	std::vector<unsigned> meshToTex;
+
+	// Assimp's node tree, depth first: the parent and transform relative to it of every node, and the node of each mesh
+	std::vector<GLint> nodeParents;
+	std::vector<glm::mat4> nodeTransforms;
+	// Node transforms relative to the model's root, as loaded
+	std::vector<glm::mat4> nodeWorlds;
+	std::vector<GLuint> meshNodes;
+
+	// Full detail triangles of the large meshes and the nodes they are at. Coarser levels can stick out of the mesh
+	// and hide what's actually visible
+	std::vector<Occluder> occluders;
+	std::vector<GLuint> occluderNodes;
+
+	// Model matrices of one mesh in RenderModel
+	std::vector<glm::mat4> meshModels;
+
+	AABB bounds;
 };
@@ -0,0 +1,366 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <emmintrin.h>
+
+namespace
+{
+	// Triangles with less area than this (in pixels) can't cover a pixel center reliably
+	constexpr GLfloat MIN_TRIANGLE_AREA = 1e-6f;
+
+	GLfloat HorizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(v);
+	}
+
+	GLfloat HorizontalMax(__m128 v)
+	{
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(v);
+	}
+
+	// Row of the view projection matrix applied to four points
+	__m128 TransformRow(const glm::mat4 &matrix, int row, __m128 x, __m128 y, __m128 z)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix[0][row]), x), _mm_mul_ps(_mm_set1_ps(matrix[1][row]), y)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix[2][row]), z), _mm_set1_ps(matrix[3][row])));
+	}
+
+	// Signed distance to the near plane in clip space, negative in front of it
+	GLfloat NearDistance(const glm::vec4 &clip)
+	{
+		return clip.z + clip.w;
+	}
+}
+
+OcclusionCuller::OcclusionCuller() :
+	width(0),
+	height(0),
+	tilesX(0),
+	tilesY(0),
+	viewProjection(1.0f),
+	stats()
+{}
+
+void OcclusionCuller::Init(GLuint width, GLuint height)
+{
+	tilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	tilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	this->width = tilesX * TILE_WIDTH;
+	this->height = tilesY * TILE_HEIGHT;
+
+	referenceDepths.assign(tilesX * tilesY, 1.0f);
+	workingDepths.assign(tilesX * tilesY, 0.0f);
+	coverage.assign(tilesX * tilesY, 0);
+}
+
+void OcclusionCuller::Begin(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+
+	// Everything is in front of the far plane, and the working layers hold nothing yet
+	std::fill(referenceDepths.begin(), referenceDepths.end(), 1.0f);
+	std::fill(workingDepths.begin(), workingDepths.end(), 0.0f);
+	std::fill(coverage.begin(), coverage.end(), 0);
+}
+
+void OcclusionCuller::RasterizeOccluder(const Occluder& occluder, const glm::mat4& transform)
+{
+	const glm::mat4 toClip = viewProjection * transform;
+	clipPositions.resize(occluder.positions.size());
+	for (size_t i = 0; i < occluder.positions.size(); i++)
+	{
+		clipPositions[i] = toClip * glm::vec4(occluder.positions[i], 1.0f);
+	}
+
+	for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+	{
+		const glm::vec4 &a = clipPositions[occluder.indices[i]];
+		const glm::vec4 &b = clipPositions[occluder.indices[i + 1]];
+		const glm::vec4 &c = clipPositions[occluder.indices[i + 2]];
+
+		// Triangles completely outside one side of the view can't cover anything
+		if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+			(a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+			(a.z > a.w && b.z > b.w && c.z > c.w))
+		{
+			continue;
+		}
+
+		stats.occluderTriangles++;
+		ClipTriangle(a, b, c);
+	}
+}
+
+bool OcclusionCuller::IsVisible(const AABB& box)
+{
+	if (box.IsEmpty() || coverage.empty())
+	{
+		return true;
+	}
+
+	stats.tested++;
+
+	// The eight corners as two sets of four, bottom and top
+	const __m128 x = _mm_setr_ps(box.min.x, box.max.x, box.min.x, box.max.x);
+	const __m128 y = _mm_setr_ps(box.min.y, box.min.y, box.max.y, box.max.y);
+	const __m128 bottomZ = _mm_set1_ps(box.min.z);
+	const __m128 topZ = _mm_set1_ps(box.max.z);
+
+	const __m128 clipX[2] = { TransformRow(viewProjection, 0, x, y, bottomZ), TransformRow(viewProjection, 0, x, y, topZ) };
+	const __m128 clipY[2] = { TransformRow(viewProjection, 1, x, y, bottomZ), TransformRow(viewProjection, 1, x, y, topZ) };
+	const __m128 clipZ[2] = { TransformRow(viewProjection, 2, x, y, bottomZ), TransformRow(viewProjection, 2, x, y, topZ) };
+	const __m128 clipW[2] = { TransformRow(viewProjection, 3, x, y, bottomZ), TransformRow(viewProjection, 3, x, y, topZ) };
+
+	// Boxes reaching through the near plane are too close to be hidden
+	const __m128 zero = _mm_setzero_ps();
+	if (_mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(clipZ[0], clipW[0]), zero)) != 0 ||
+		_mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(clipZ[1], clipW[1]), zero)) != 0)
+	{
+		return true;
+	}
+
+	__m128 ndcX[2], ndcY[2], ndcZ[2];
+	for (int i = 0; i < 2; i++)
+	{
+		const __m128 inverseW = _mm_div_ps(_mm_set1_ps(1.0f), clipW[i]);
+		ndcX[i] = _mm_mul_ps(clipX[i], inverseW);
+		ndcY[i] = _mm_mul_ps(clipY[i], inverseW);
+		ndcZ[i] = _mm_mul_ps(clipZ[i], inverseW);
+	}
+
+	const GLfloat minX = (HorizontalMin(_mm_min_ps(ndcX[0], ndcX[1])) * 0.5f + 0.5f) * width;
+	const GLfloat maxX = (HorizontalMax(_mm_max_ps(ndcX[0], ndcX[1])) * 0.5f + 0.5f) * width;
+	const GLfloat minY = (HorizontalMin(_mm_min_ps(ndcY[0], ndcY[1])) * 0.5f + 0.5f) * height;
+	const GLfloat maxY = (HorizontalMax(_mm_max_ps(ndcY[0], ndcY[1])) * 0.5f + 0.5f) * height;
+	const GLfloat nearest = HorizontalMin(_mm_min_ps(ndcZ[0], ndcZ[1])) * 0.5f + 0.5f;
+
+	// Off screen the buffer knows nothing, frustum culling decides there
+	if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+	{
+		return true;
+	}
+
+	const GLuint firstTileX = static_cast<GLuint>(std::max(minX, 0.0f)) / TILE_WIDTH;
+	const GLuint lastTileX = static_cast<GLuint>(std::min(maxX, width - 1.0f)) / TILE_WIDTH;
+	const GLuint firstTileY = static_cast<GLuint>(std::max(minY, 0.0f)) / TILE_HEIGHT;
+	const GLuint lastTileY = static_cast<GLuint>(std::min(maxY, height - 1.0f)) / TILE_HEIGHT;
+
+	// Visible as soon as the nearest point of the box is in front of the reference depth of any tile it touches
+	const __m128 nearestDepth = _mm_set1_ps(nearest);
+	for (GLuint tileY = firstTileY; tileY <= lastTileY; tileY++)
+	{
+		const GLfloat *row = referenceDepths.data() + tileY * tilesX;
+		GLuint tileX = firstTileX;
+		for (; tileX + 3 <= lastTileX; tileX += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmplt_ps(nearestDepth, _mm_loadu_ps(row + tileX))) != 0)
+			{
+				return true;
+			}
+		}
+		for (; tileX <= lastTileX; tileX++)
+		{
+			if (nearest < row[tileX])
+			{
+				return true;
+			}
+		}
+	}
+
+	stats.occluded++;
+	return false;
+}
+
+GLuint OcclusionCuller::GetWidth() const
+{
+	return width;
+}
+
+GLuint OcclusionCuller::GetHeight() const
+{
+	return height;
+}
+
+const OcclusionStats& OcclusionCuller::GetStats() const
+{
+	return stats;
+}
+
+void OcclusionCuller::ResetStats()
+{
+	stats = OcclusionStats();
+}
+
+OcclusionCuller::ScreenVertex OcclusionCuller::ToScreen(const glm::vec4& clip) const
+{
+	const GLfloat inverseW = 1.0f / clip.w;
+	ScreenVertex vertex;
+	vertex.x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+	vertex.y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+	vertex.z = clip.z * inverseW * 0.5f + 0.5f;
+	return vertex;
+}
+
+void OcclusionCuller::ClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+{
+	const glm::vec4 *vertices[3] = { &a, &b, &c };
+	const GLfloat distances[3] = { NearDistance(a), NearDistance(b), NearDistance(c) };
+
+	if (distances[0] >= 0.0f && distances[1] >= 0.0f && distances[2] >= 0.0f)
+	{
+		RasterizeTriangle(ToScreen(a), ToScreen(b), ToScreen(c));
+		return;
+	}
+
+	// Walks the edges keeping the part in front of the near plane, which leaves at most four vertices
+	glm::vec4 polygon[4];
+	int polygonSize = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const int next = (i + 1) % 3;
+		if (distances[i] >= 0.0f)
+		{
+			polygon[polygonSize++] = *vertices[i];
+		}
+		if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f))
+		{
+			const GLfloat t = distances[i] / (distances[i] - distances[next]);
+			polygon[polygonSize++] = *vertices[i] + (*vertices[next] - *vertices[i]) * t;
+		}
+	}
+
+	for (int i = 2; i < polygonSize; i++)
+	{
+		RasterizeTriangle(ToScreen(polygon[0]), ToScreen(polygon[i - 1]), ToScreen(polygon[i]));
+	}
+}
+
+void OcclusionCuller::RasterizeTriangle(ScreenVertex a, ScreenVertex b, ScreenVertex c)
+{
+	GLfloat area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	if (!(std::fabs(area) > MIN_TRIANGLE_AREA))
+	{
+		return;
+	}
+
+	// Counter-clockwise, so the inside is where every edge function is positive
+	if (area < 0.0f)
+	{
+		std::swap(b, c);
+		area = -area;
+	}
+
+	const GLfloat minX = std::min(std::min(a.x, b.x), c.x);
+	const GLfloat maxX = std::max(std::max(a.x, b.x), c.x);
+	const GLfloat minY = std::min(std::min(a.y, b.y), c.y);
+	const GLfloat maxY = std::max(std::max(a.y, b.y), c.y);
+	if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+	{
+		return;
+	}
+
+	const GLuint firstTileX = static_cast<GLuint>(std::max(minX, 0.0f)) / TILE_WIDTH;
+	const GLuint lastTileX = static_cast<GLuint>(std::min(maxX, width - 1.0f)) / TILE_WIDTH;
+	const GLuint firstTileY = static_cast<GLuint>(std::max(minY, 0.0f)) / TILE_HEIGHT;
+	const GLuint lastTileY = static_cast<GLuint>(std::min(maxY, height - 1.0f)) / TILE_HEIGHT;
+
+	// Edge functions edgeX * x + edgeY * y + edgeC, one per edge
+	const ScreenVertex *vertices[3] = { &a, &b, &c };
+	GLfloat edgeX[3], edgeY[3], edgeC[3];
+	__m128 edgeXs[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const ScreenVertex &from = *vertices[i];
+		const ScreenVertex &to = *vertices[(i + 1) % 3];
+		edgeX[i] = from.y - to.y;
+		edgeY[i] = to.x - from.x;
+		edgeC[i] = -(edgeX[i] * from.x + edgeY[i] * from.y);
+		edgeXs[i] = _mm_set1_ps(edgeX[i]);
+	}
+
+	// Depth is linear in window coordinates: z = depthX * x + depthY * y + depthC
+	const GLfloat depthX = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+	const GLfloat depthY = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+	const GLfloat depthC = a.z - depthX * a.x - depthY * a.y;
+	const GLfloat triangleMaxDepth = std::max(std::max(a.z, b.z), c.z);
+
+	const __m128 columnOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (GLuint tileY = firstTileY; tileY <= lastTileY; tileY++)
+	{
+		const GLfloat bottom = static_cast<GLfloat>(tileY * TILE_HEIGHT) + 0.5f;
+		const GLfloat top = bottom + TILE_HEIGHT - 1.0f;
+
+		for (GLuint tileX = firstTileX; tileX <= lastTileX; tileX++)
+		{
+			const GLfloat left = static_cast<GLfloat>(tileX * TILE_WIDTH);
+			const __m128 leftColumns = _mm_add_ps(_mm_set1_ps(left), columnOffsets);
+			const __m128 rightColumns = _mm_add_ps(leftColumns, _mm_set1_ps(4.0f));
+
+			// One bit per pixel center inside all three edges, row by row from the bottom
+			GLuint mask = 0;
+			for (GLuint row = 0; row < TILE_HEIGHT; row++)
+			{
+				const GLfloat y = bottom + row;
+				__m128 leftInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				__m128 rightInside = leftInside;
+				for (int i = 0; i < 3; i++)
+				{
+					const __m128 rowValue = _mm_set1_ps(edgeY[i] * y + edgeC[i]);
+					leftInside = _mm_and_ps(leftInside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeXs[i], leftColumns), rowValue), zero));
+					rightInside = _mm_and_ps(rightInside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeXs[i], rightColumns), rowValue), zero));
+				}
+				const GLuint rowMask = static_cast<GLuint>(_mm_movemask_ps(leftInside) | (_mm_movemask_ps(rightInside) << 4));
+				mask |= rowMask << (row * TILE_WIDTH);
+			}
+
+			if (mask == 0)
+			{
+				continue;
+			}
+
+			// The plane is farthest at a corner of the tile, but never farther than the triangle's farthest vertex
+			const GLfloat right = left + TILE_WIDTH - 0.5f;
+			const GLfloat tileMaxDepth = depthC + std::max(depthX * (left + 0.5f), depthX * right) +
+				std::max(depthY * bottom, depthY * top);
+			UpdateTile(tileY * tilesX + tileX, mask, std::min(tileMaxDepth, triangleMaxDepth));
+		}
+	}
+}
+
+void OcclusionCuller::UpdateTile(GLuint tile, GLuint mask, GLfloat depth)
+{
+	// Nothing behind the reference depth can hide more than it already does
+	if (depth >= referenceDepths[tile])
+	{
+		return;
+	}
+
+	// A triangle covering the whole tile is a reference on its own, and makes a working layer behind it useless
+	if (mask == FULL_COVERAGE)
+	{
+		referenceDepths[tile] = depth;
+		if (workingDepths[tile] >= depth)
+		{
+			workingDepths[tile] = 0.0f;
+			coverage[tile] = 0;
+		}
+		return;
+	}
+
+	workingDepths[tile] = std::max(workingDepths[tile], depth);
+	coverage[tile] |= mask;
+	if (coverage[tile] == FULL_COVERAGE)
+	{
+		referenceDepths[tile] = workingDepths[tile];
+		workingDepths[tile] = 0.0f;
+		coverage[tile] = 0;
+	}
+}
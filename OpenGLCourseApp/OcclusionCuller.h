@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// Counts of the occlusion culling, accumulated until reset
+struct OcclusionStats
+{
+	unsigned long long occluderTriangles;
+	unsigned long long tested;
+	unsigned long long occluded;
+};
+
+// CPU copy of the triangles of a mesh that hides what's behind it
+struct Occluder
+{
+	std::vector<glm::vec3> positions;
+	std::vector<GLuint> indices;
+};
+
+// Software occlusion culling against a small depth buffer in the style of masked occlusion culling. Instead of a
+// depth per pixel every tile of TILE_WIDTH x TILE_HEIGHT pixels keeps a reference depth that everything in the tile
+// is in front of, and a working layer: the pixels the occluders since covered (one bit each) and the farthest of
+// their depths. Once the working layer covers the whole tile it becomes the new reference. Occluders are drawn
+// first, then the boxes of everything else are tested against the reference depths of the tiles they overlap.
+// Pixel coverage is computed with SSE, four pixels of a tile row at a time. Doesn't touch GL, so it runs without a
+// context
+class OcclusionCuller
+{
+public:
+	static constexpr GLuint TILE_WIDTH = 8;
+	static constexpr GLuint TILE_HEIGHT = 4;
+
+	OcclusionCuller();
+
+	// width and height in pixels, rounded up to whole tiles
+	void Init(GLuint width, GLuint height);
+
+	// Clears the buffer for a view, nothing hides anything until occluders are drawn
+	void Begin(const glm::mat4 &viewProjection);
+	// Draws the occluder's triangles, transform takes its positions to world space
+	void RasterizeOccluder(const Occluder &occluder, const glm::mat4 &transform);
+	// False only if the box (in world space) is behind the occluders drawn since Begin
+	bool IsVisible(const AABB &box);
+
+	GLuint GetWidth() const;
+	GLuint GetHeight() const;
+
+	const OcclusionStats &GetStats() const;
+	void ResetStats();
+
+private:
+	static constexpr GLuint FULL_COVERAGE = 0xFFFFFFFFu;
+
+	// Window coordinates in pixels, depth from 0 at the near plane to 1 at the far plane
+	struct ScreenVertex
+	{
+		GLfloat x, y, z;
+	};
+
+	GLuint width, height;
+	GLuint tilesX, tilesY;
+
+	// One entry per tile, row by row
+	std::vector<GLfloat> referenceDepths;
+	std::vector<GLfloat> workingDepths;
+	std::vector<GLuint> coverage;
+
+	glm::mat4 viewProjection;
+
+	// Clip space positions of the occluder being drawn
+	std::vector<glm::vec4> clipPositions;
+
+	OcclusionStats stats;
+
+	ScreenVertex ToScreen(const glm::vec4 &clip) const;
+	// Clips the triangle against the near plane, which keeps w positive for the divide
+	void ClipTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+	void RasterizeTriangle(ScreenVertex a, ScreenVertex b, ScreenVertex c);
+	void UpdateTile(GLuint tile, GLuint mask, GLfloat depth);
+};
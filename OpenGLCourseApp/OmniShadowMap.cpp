@@ -1,32 +1,38 @@
 #include "OmniShadowMap.h"
 
+#include "GLState.h"
 
-OmniShadowMap::OmniShadowMap() : ShadowMap() {}
+
+OmniShadowMap::OmniShadowMap() : ShadowMap(), lightCount(0) {}
 
 bool OmniShadowMap::Init(GLuint width, GLuint height)
+{
+	return Init(width, height, 1);
+}
+
+bool OmniShadowMap::Init(GLuint width, GLuint height, GLuint lights)
 {
 	shadowWidth = width;
 	shadowHeight = height;
+	lightCount = lights;
 
 	glGenFramebuffers(1, &FBO);
 
 	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP_ARRAY, shadowMap);
 
-	// Loop through every side of the cubemap and create the textures for each (can add i to the enum to get all consequent sides in order)
-	for (size_t i = 0; i < 6; i++)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, 
-			shadowWidth, shadowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	}
+	// One cubemap per light, each taking six consecutive layers in the usual +X, -X, +Y, -Y, +Z, -Z order
+	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT,
+		shadowWidth, shadowHeight, lightCount * 6, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	// Layered attachment, the geometry shader picks the layer-face with gl_Layer
+	GLState::BindFramebuffer(FBO);
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap, 0);
 
 	glDrawBuffer(GL_NONE);
@@ -40,7 +46,7 @@ bool OmniShadowMap::Init(GLuint width, GLuint height)
 		return false;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(0);
 
 	return true;
 
@@ -48,13 +54,16 @@ bool OmniShadowMap::Init(GLuint width, GLuint height)
 
 void OmniShadowMap::Write()
 {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	GLState::BindFramebuffer(FBO);
 
 }
 
 void OmniShadowMap::Read(GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+	GLState::BindTexture(textureUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP_ARRAY, shadowMap);
 }
 
+GLuint OmniShadowMap::GetLightCount() const
+{
+	return lightCount;
+}
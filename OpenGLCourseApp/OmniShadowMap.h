@@ -1,5 +1,8 @@
 #pragma once
 #include "ShadowMap.h"
+
+// Shadow cubemaps for all omnidirectional lights, stored as the layers of a single cubemap array
+// so that one pass can render every light (layer-face = light * 6 + face)
 class OmniShadowMap :
     public ShadowMap
 {
@@ -7,10 +10,14 @@ public:
 	OmniShadowMap();
 
     bool Init(GLuint width, GLuint height);
+    bool Init(GLuint width, GLuint height, GLuint lights);
 
 	void Write();
 
 	void Read(GLenum textureUnit);
 
-};
+	GLuint GetLightCount() const;
 
+private:
+	GLuint lightCount;
+};
@@ -1,41 +1,50 @@
 #include "PointLight.h"
+
+#include <algorithm>
+#include <cmath>
+
+static_assert(sizeof(OmniShadowData) == MAX_OMNI_SHADOWS * 6 * 64 + MAX_OMNI_SHADOWS * 16 + 16,
+	"OmniShadowData doesn't match the std140 layout");
+
 PointLight::PointLight() : Light(),
 position(glm::vec3(0.0f, 0.0f, 0.0f)),
 constant(1.0f),
 linear(0.0f),
-exponent(0.0f)
+exponent(0.0f),
+nearPlane(0.0f),
+farPlane(0.0f),
+shadowIndex(-1)
 {}
 
-PointLight::PointLight(GLuint shadowWidth, GLuint shadowHeight,
-	GLfloat near, GLfloat far, GLfloat red, GLfloat green, GLfloat blue,
+PointLight::PointLight(GLfloat near, GLfloat far, GLfloat red, GLfloat green, GLfloat blue,
 	GLfloat aIntensity, GLfloat dIntensity,
 	GLfloat xPos, GLfloat yPos, GLfloat zPos,
-	GLfloat con, GLfloat lin, GLfloat exp) : Light(shadowWidth, shadowHeight, red, green, blue, aIntensity, dIntensity),
+	GLfloat con, GLfloat lin, GLfloat exp) : Light(0, 0, red, green, blue, aIntensity, dIntensity),
 	position(glm::vec3(xPos, yPos, zPos)),
 	constant(con),
 	linear(lin),
 	exponent(exp),
-	farPlane(far)
+	nearPlane(near),
+	farPlane(far),
+	shadowIndex(-1)
 {
-	const float aspect = static_cast<float>(shadowWidth) / static_cast<float>(shadowHeight);
-	lightProj = glm::perspective(glm::radians(90.0f), aspect, near, far);
-
-	shadowMap = new OmniShadowMap();
-	shadowMap->Init(shadowWidth, shadowHeight);
+	// Cube faces are square
+	lightProj = glm::perspective(glm::radians(90.0f), 1.0f, near, far);
 }
 
-void PointLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-	GLuint diffuseIntensityLocation, GLuint positionLocation,
-	GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation) const
+PointLightData PointLight::GetLightData() const
 {
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
-	glUniform3f(ambientColorLocation, color.x, color.y, color.z);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
-
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
+	PointLightData data = {};
+	data.color = color;
+	data.ambientIntensity = ambientIntensity;
+	data.position = position;
+	data.diffuseIntensity = diffuseIntensity;
+	data.constant = constant;
+	data.linear = linear;
+	data.exponent = exponent;
+	data.shadowIndex = shadowIndex;
+	data.farPlane = farPlane;
+	return data;
 }
 
 std::vector<glm::mat4> PointLight::CalculateLightTransform() const
@@ -55,6 +64,50 @@ std::vector<glm::mat4> PointLight::CalculateLightTransform() const
 	return lightMatrices;
 }
 
+void PointLight::GetOmniShadowData(const std::vector<PointLight*>& lights, OmniShadowData* data)
+{
+	const size_t lightCount = std::min<size_t>(lights.size(), MAX_OMNI_SHADOWS);
+	data->lightCount = static_cast<GLint>(lightCount);
+
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		data->lightPositions[i] = glm::vec4(lights[i]->position, lights[i]->farPlane);
+
+		const std::vector<glm::mat4> lightMatrices = lights[i]->CalculateLightTransform();
+		std::copy(lightMatrices.begin(), lightMatrices.end(), data->lightMatrices + i * 6);
+	}
+}
+
+GLfloat PointLight::CalculateRange() const
+{
+	const GLfloat intensity = std::max(std::max(color.x, color.y), color.z) * (ambientIntensity + diffuseIntensity);
+
+	// Solve exponent * d^2 + linear * d + constant = 256 * intensity
+	const GLfloat c = constant - 256.0f * intensity;
+	if (c >= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	if (exponent > 0.0f)
+	{
+		return (-linear + sqrtf(linear * linear - 4.0f * exponent * c)) / (2.0f * exponent);
+	}
+
+	if (linear > 0.0f)
+	{
+		return -c / linear;
+	}
+
+	// No falloff at all, the light reaches as far as its shadows do
+	return farPlane;
+}
+
+GLfloat PointLight::GetNearPlane() const
+{
+	return nearPlane;
+}
+
 GLfloat PointLight::GetFarPlane() const
 {
 	return farPlane;
@@ -65,4 +118,14 @@ glm::vec3 PointLight::GetPosition() const
 	return position;
 }
 
+GLint PointLight::GetShadowIndex() const
+{
+	return shadowIndex;
+}
+
+void PointLight::SetShadowIndex(GLint index)
+{
+	shadowIndex = index;
+}
+
 
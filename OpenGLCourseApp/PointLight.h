@@ -1,34 +1,65 @@
 #pragma once
 #include <vector>
 
+#include "CommonValues.h"
 #include "Light.h"
 #include "OmniShadowMap.h"
 
+// Layout of a point light in the clustered lighting storage buffer (std430)
+struct PointLightData
+{
+	glm::vec3 color;
+	GLfloat ambientIntensity;
+	glm::vec3 position;
+	GLfloat diffuseIntensity;
+	GLfloat constant, linear, exponent;
+	GLint shadowIndex; // Cubemap in the omni shadow map array, -1 if the light casts no shadows
+	GLfloat farPlane;
+	GLfloat padding[3];
+};
+
+// Layout of the OmniShadows uniform block (std140), shared by the omni shadow pass and the main pass
+struct OmniShadowData
+{
+	glm::mat4 lightMatrices[MAX_OMNI_SHADOWS * 6];
+	glm::vec4 lightPositions[MAX_OMNI_SHADOWS]; // w is the far plane
+	GLint lightCount;
+	GLint padding[3];
+};
+
 class PointLight :
 	public Light
 {
 public:
 	PointLight();
-	PointLight(GLuint shadowWidth, GLuint shadowHeight,
-		GLfloat near, GLfloat far,
+	PointLight(GLfloat near, GLfloat far,
 		GLfloat red, GLfloat green, GLfloat blue,
 		GLfloat aIntensity, GLfloat dIntensity,
 		GLfloat xPos, GLfloat yPos, GLfloat zPos,
 		GLfloat con, GLfloat lin, GLfloat exp);
-	void UseLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation) const;
+	PointLightData GetLightData() const;
 
 	std::vector<glm::mat4> CalculateLightTransform() const;
+	// Light i of the list renders into cubemap i of the omni shadow map array
+	static void GetOmniShadowData(const std::vector<PointLight*> &lights, OmniShadowData *data);
+
+	// Distance at which the attenuated light drops below 1/256 of its intensity
+	GLfloat CalculateRange() const;
 
+	GLfloat GetNearPlane() const;
 	GLfloat GetFarPlane() const;
 	glm::vec3 GetPosition() const;
 
+	GLint GetShadowIndex() const;
+	void SetShadowIndex(GLint index);
+
 protected:
 	glm::vec3 position;
 
 	GLfloat constant, linear, exponent;
 
-	GLfloat farPlane;
+	GLfloat nearPlane, farPlane;
+
+	GLint shadowIndex;
 };
 
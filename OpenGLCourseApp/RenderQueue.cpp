@@ -0,0 +1,388 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static constexpr GLuint PASS_BITS = 4;
+static constexpr GLuint PROGRAM_BITS = 6;
+static constexpr GLuint TEXTURE_BITS = 12;
+static constexpr GLuint INDEX_TYPE_BITS = 2;
+static constexpr GLuint MATERIAL_BITS = 8;
+static constexpr GLuint MESH_BITS = 12;
+static constexpr GLuint DEPTH_BITS = 20;
+
+static_assert(PASS_BITS + PROGRAM_BITS + TEXTURE_BITS + INDEX_TYPE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64,
+	"Sort key fields don't add up to 64 bits");
+
+RenderQueue::RenderQueue() :
+	pass(0),
+	program(0),
+	passKind(PassKind::Shaded),
+	eyePosition(0.0f),
+	farPlane(1.0f),
+	lodPixelScale(0.0f),
+	lodPerspective(false),
+	lodMaxPixelError(0.0f),
+	lodEyePoints(nullptr),
+	lodEyePointCount(0),
+	cullFrusta(nullptr),
+	cullFrustumCount(0),
+	cullViewPoints(nullptr),
+	cullViewPointCount(0),
+	cullOrthographic(false),
+	stats()
+{}
+
+void RenderQueue::BeginPass(GLuint newPass, PassKind kind, GLuint newProgram, glm::vec3 eye, GLfloat far)
+{
+	pass = newPass;
+	passKind = kind;
+	program = newProgram;
+	eyePosition = eye;
+	farPlane = far;
+
+	lodMaxPixelError = 0.0f;
+	lodEyePoints = nullptr;
+	lodEyePointCount = 0;
+	cullFrusta = nullptr;
+	cullFrustumCount = 0;
+
+	items.clear();
+	entries.clear();
+	instances.clear();
+	rangeFirstIndices.clear();
+	rangeIndexCounts.clear();
+}
+
+bool RenderQueue::IsDepthOnly() const
+{
+	return passKind == PassKind::DepthOnly;
+}
+
+void RenderQueue::SetLodSelection(const glm::mat4& projection, GLfloat viewportHeight, GLfloat maxPixelError,
+	const glm::vec3* eyePoints, GLuint eyePointCount)
+{
+	// The last row of a perspective projection moves -z into w, an orthographic one leaves w at 1
+	lodPerspective = projection[2][3] != 0.0f;
+	lodPixelScale = projection[1][1] * viewportHeight * 0.5f;
+	lodMaxPixelError = maxPixelError;
+	lodEyePoints = eyePoints;
+	lodEyePointCount = eyePoints ? eyePointCount : 0;
+}
+
+void RenderQueue::SetMeshletCulling(const Frustum* frusta, GLuint frustumCount, const glm::vec3* viewPoints,
+	GLuint viewPointCount, bool orthographic)
+{
+	cullFrusta = frusta;
+	cullFrustumCount = frustumCount;
+	cullViewPoints = viewPoints;
+	cullViewPointCount = viewPointCount;
+	cullOrthographic = orthographic;
+}
+
+void RenderQueue::Submit(const Mesh* mesh, Texture* texture, Material* material, const glm::mat4* models,
+	const glm::mat3* normals, GLsizei instanceCount, GLint faceMask, glm::vec3 center)
+{
+	if (instanceCount <= 0)
+	{
+		return;
+	}
+
+	if (passKind == PassKind::DepthOnly)
+	{
+		texture = nullptr;
+		material = nullptr;
+	}
+
+	DrawItem item;
+	item.mesh = mesh;
+	item.texture = texture;
+	item.material = material;
+	item.firstInstance = static_cast<GLsizei>(instances.size());
+	item.instanceCount = instanceCount;
+	item.lod = SelectLod(mesh, models[0], center);
+	item.firstRange = 0;
+	item.rangeCount = 0;
+
+	// Meshlets only cover the full detail level, and testing them for every instance would cost more than it saves
+	if (cullFrusta && item.lod == 0 && instanceCount == 1 && mesh->GetMeshletCount() > 0 && !CullMeshlets(mesh, models[0], item))
+	{
+		return;
+	}
+
+	instances.resize(instances.size() + instanceCount);
+	mesh->WriteInstances(models, normals, instanceCount, material, faceMask, &instances[item.firstInstance]);
+
+	// Front to back within the same state, so early depth testing rejects more of the later draws
+	const GLfloat maxDepth = static_cast<GLfloat>((1u << DEPTH_BITS) - 1);
+	const GLfloat depth = std::min(std::max(glm::length(center - eyePosition) / farPlane, 0.0f), 1.0f) * maxDepth;
+
+	SortEntry entry;
+	entry.key = MakeSortKey(pass, program, texture ? texture->GetTextureId() : 0, mesh->GetIndexType(),
+		material ? material->GetMaterialId() : 0, mesh->GetMeshId(), static_cast<GLuint>(depth));
+	entry.item = static_cast<GLuint>(items.size());
+
+	items.push_back(item);
+	entries.push_back(entry);
+}
+
+void RenderQueue::Flush(RingBuffer* frameBuffer)
+{
+	if (items.empty())
+	{
+		return;
+	}
+
+	const DrawItem *previous = nullptr;
+	for (const DrawItem &item : items)
+	{
+		stats.unsortedStateChanges += CountStateChanges(previous, item);
+		previous = &item;
+	}
+
+	SortEntries();
+
+	// One command per draw, or per meshlet range of a draw, in sorted order. A batch ends where the texture, the
+	// pool or the index type changes, which are the only state left between draws
+	commands.clear();
+	batches.clear();
+	previous = nullptr;
+	for (const SortEntry &entry : entries)
+	{
+		const DrawItem &item = items[entry.item];
+
+		stats.sortedStateChanges += CountStateChanges(previous, item);
+		stats.draws++;
+
+		const GLenum indexType = item.mesh->GetIndexType();
+		if (batches.empty() || batches.back().texture != item.texture || batches.back().pool != item.mesh->GetPool() ||
+			batches.back().indexType != indexType)
+		{
+			Batch batch;
+			batch.texture = item.texture;
+			batch.pool = item.mesh->GetPool();
+			batch.indexType = indexType;
+			batch.firstCommand = commands.size();
+			batch.commandCount = 0;
+			batches.push_back(batch);
+		}
+
+		if (item.rangeCount > 0)
+		{
+			for (size_t i = item.firstRange; i < item.firstRange + item.rangeCount; i++)
+			{
+				commands.push_back(item.mesh->MakeDrawCommand(rangeFirstIndices[i], rangeIndexCounts[i], 1, item.firstInstance));
+				stats.triangles += rangeIndexCounts[i] / 3;
+			}
+		}
+		else
+		{
+			const MeshLod &lod = item.mesh->GetLod(item.lod);
+			commands.push_back(item.mesh->MakeDrawCommand(lod.firstIndex, lod.indexCount, item.instanceCount, item.firstInstance));
+			stats.triangles += static_cast<unsigned long long>(lod.indexCount / 3) * item.instanceCount;
+		}
+		batches.back().commandCount = commands.size() - batches.back().firstCommand;
+
+		previous = &item;
+	}
+
+	// Commands address their instances with baseInstance, relative to where the instance data is bound
+	GLintptr instanceOffset, commandOffset;
+	void *instanceData = frameBuffer->Allocate(GL_ARRAY_BUFFER, sizeof(InstanceData) * instances.size(), instanceOffset);
+	memcpy(instanceData, instances.data(), sizeof(InstanceData) * instances.size());
+	void *commandData = frameBuffer->Allocate(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * commands.size(),
+		commandOffset);
+	memcpy(commandData, commands.data(), sizeof(DrawElementsIndirectCommand) * commands.size());
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frameBuffer->GetBufferId());
+
+	const GeometryPool *boundPool = nullptr;
+	const Texture *boundTexture = nullptr;
+	for (const Batch &batch : batches)
+	{
+		if (batch.texture && batch.texture != boundTexture)
+		{
+			batch.texture->UseTexture();
+			boundTexture = batch.texture;
+		}
+
+		if (batch.pool != boundPool)
+		{
+			// Depth only passes read the pool's packed positions instead of whole vertices
+			batch.pool->BindInstances(frameBuffer->GetBufferId(), instanceOffset, IsDepthOnly());
+			boundPool = batch.pool;
+		}
+
+		batch.pool->MultiDrawIndirect(batch.indexType, commandOffset + sizeof(DrawElementsIndirectCommand) * batch.firstCommand,
+			static_cast<GLsizei>(batch.commandCount));
+		stats.multiDraws++;
+	}
+
+	items.clear();
+	entries.clear();
+	instances.clear();
+	rangeFirstIndices.clear();
+	rangeIndexCounts.clear();
+}
+
+const RenderQueueStats& RenderQueue::GetStats() const
+{
+	return stats;
+}
+
+void RenderQueue::ResetStats()
+{
+	stats = RenderQueueStats();
+}
+
+GLuint64 RenderQueue::MakeSortKey(GLuint pass, GLuint program, GLuint texture, GLenum indexType, GLuint material, GLuint mesh,
+	GLuint depth)
+{
+	// Ids wider than their field wrap around, which only costs sorting quality, never correctness
+	GLuint64 key = pass & ((1u << PASS_BITS) - 1);
+	key = (key << PROGRAM_BITS) | (program & ((1u << PROGRAM_BITS) - 1));
+	key = (key << TEXTURE_BITS) | (texture & ((1u << TEXTURE_BITS) - 1));
+	key = (key << INDEX_TYPE_BITS) | (GeometryPool::GetIndexSize(indexType) >> 1);
+	key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+	key = (key << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+	key = (key << DEPTH_BITS) | (depth & ((1u << DEPTH_BITS) - 1));
+	return key;
+}
+
+void RenderQueue::SortEntries()
+{
+	sortScratch.resize(entries.size());
+
+	for (GLuint shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = { 0 };
+		for (const SortEntry &entry : entries)
+		{
+			counts[(entry.key >> shift) & 0xFF]++;
+		}
+
+		// Every key has the same byte here, so this pass wouldn't move anything
+		if (counts[(entries[0].key >> shift) & 0xFF] == entries.size())
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t &count : counts)
+		{
+			const size_t bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+
+		for (const SortEntry &entry : entries)
+		{
+			sortScratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+		}
+
+		entries.swap(sortScratch);
+	}
+}
+
+size_t RenderQueue::SelectLod(const Mesh* mesh, const glm::mat4& model, glm::vec3 center) const
+{
+	if (lodMaxPixelError <= 0.0f || mesh->GetLodCount() <= 1)
+	{
+		return 0;
+	}
+
+	// Errors are in object space, the largest axis scale of the model matrix takes them to world space
+	GLfloat pixelsPerUnit = lodPixelScale * GetMaxScale(model);
+	if (lodPerspective)
+	{
+		// Distance to the eye stands in for view depth, which errs towards more detail off axis. With several eyes the
+		// nearest one needs the most detail
+		GLfloat distance = lodEyePointCount > 0 ? glm::length(center - lodEyePoints[0]) : glm::length(center - eyePosition);
+		for (GLuint i = 1; i < lodEyePointCount; i++)
+		{
+			distance = std::min(distance, glm::length(center - lodEyePoints[i]));
+		}
+		pixelsPerUnit /= std::max(distance, 0.001f);
+	}
+
+	return mesh->SelectLod(pixelsPerUnit, lodMaxPixelError);
+}
+
+bool RenderQueue::CullMeshlets(const Mesh* mesh, const glm::mat4& model, DrawItem& item)
+{
+	// Facing is tested in object space, where the cones are. Which side of a triangle a point is on survives any
+	// affine transform, so this holds for non-uniform scales too
+	const glm::mat4 inverseModel = glm::inverse(model);
+	glm::vec3 localViewPoints[MAX_CULL_VIEW_POINTS];
+	const GLuint viewPointCount = cullViewPointCount <= MAX_CULL_VIEW_POINTS ? cullViewPointCount : 0;
+	for (GLuint i = 0; i < viewPointCount; i++)
+	{
+		localViewPoints[i] = cullOrthographic ? glm::vec3(inverseModel * glm::vec4(cullViewPoints[i], 0.0f)) :
+			glm::vec3(inverseModel * glm::vec4(cullViewPoints[i], 1.0f));
+	}
+
+	const GLfloat scale = GetMaxScale(model);
+	item.firstRange = rangeFirstIndices.size();
+
+	for (size_t i = 0; i < mesh->GetMeshletCount(); i++)
+	{
+		const Meshlet &meshlet = mesh->GetMeshlet(i);
+
+		// Without view points facing isn't known, so nothing is culled by its cone
+		bool facing = viewPointCount == 0;
+		for (GLuint j = 0; j < viewPointCount && !facing; j++)
+		{
+			facing = cullOrthographic ? !MeshletBuilder::IsBackFacingDirection(meshlet, localViewPoints[j]) :
+				!MeshletBuilder::IsBackFacing(meshlet, localViewPoints[j]);
+		}
+
+		bool inside = false;
+		if (facing)
+		{
+			const glm::vec3 center(model * glm::vec4(meshlet.center[0], meshlet.center[1], meshlet.center[2], 1.0f));
+			for (GLuint j = 0; j < cullFrustumCount && !inside; j++)
+			{
+				inside = cullFrusta[j].IntersectsSphere(center, meshlet.radius * scale);
+			}
+		}
+
+		if (!inside)
+		{
+			stats.meshletsCulled++;
+			continue;
+		}
+		stats.meshletsDrawn++;
+
+		// Meshlets are stored in index order, so visible neighbours become one range
+		if (rangeFirstIndices.size() > item.firstRange &&
+			rangeFirstIndices.back() + rangeIndexCounts.back() == meshlet.firstIndex)
+		{
+			rangeIndexCounts.back() += static_cast<GLsizei>(meshlet.indexCount);
+		}
+		else
+		{
+			rangeFirstIndices.push_back(meshlet.firstIndex);
+			rangeIndexCounts.push_back(static_cast<GLsizei>(meshlet.indexCount));
+		}
+	}
+
+	item.rangeCount = rangeFirstIndices.size() - item.firstRange;
+	return item.rangeCount > 0;
+}
+
+GLfloat RenderQueue::GetMaxScale(const glm::mat4& model)
+{
+	return std::sqrt(std::max(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+		glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+}
+
+GLuint RenderQueue::CountStateChanges(const DrawItem* previous, const DrawItem& item) const
+{
+	if (!previous)
+	{
+		return 3;
+	}
+
+	return (previous->texture != item.texture) + (previous->material != item.material) + (previous->mesh != item.mesh);
+}
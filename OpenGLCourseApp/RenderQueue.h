@@ -0,0 +1,141 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+#include "Texture.h"
+#include "Material.h"
+#include "RingBuffer.h"
+#include "Frustum.h"
+
+struct RenderQueueStats
+{
+	unsigned long long draws;
+	// glMultiDrawElementsIndirect calls the draws were submitted with
+	unsigned long long multiDraws;
+	unsigned long long triangles;
+	// Meshlets of the draws that were split into them, drawn and rejected by their sphere or cone
+	unsigned long long meshletsDrawn;
+	unsigned long long meshletsCulled;
+	// Texture, material and mesh switches, in submission order and after sorting
+	unsigned long long unsortedStateChanges;
+	unsigned long long sortedStateChanges;
+};
+
+enum class PassKind
+{
+	// Shadow map passes, their programs never read textures or materials
+	DepthOnly,
+	Shaded
+};
+
+// Collects the draws of a pass, sorts them by a 64 bit key and submits them so that draws sharing state
+// end up next to each other. Key layout, from the most significant bit:
+// pass (4) | program (6) | texture (12) | index type (2) | material (8) | mesh (12) | depth (20)
+// Transforms, position decode, material and face mask are all instance data, so a pass is one indirect multi-draw
+// per texture and index type
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	// Starts collecting draws, depth in the keys is the distance to eyePosition relative to farPlane. Depth only
+	// passes drop the texture and material of every draw, so they sort and batch by mesh alone
+	void BeginPass(GLuint pass, PassKind kind, GLuint program, glm::vec3 eyePosition, GLfloat farPlane);
+	bool IsDepthOnly() const;
+	// Picks the level of detail of the following submissions from the pass's projection: the coarsest one whose
+	// error stays under maxPixelError pixels on a viewport viewportHeight pixels tall. Until it is called, and with
+	// a zero maxPixelError, every draw uses the full detail. Perspective passes measure the distance from the pass's
+	// eye, or from the nearest of eyePoints when there are several with the same projection (the lights of the omni
+	// shadow pass). The array has to stay alive until the pass is flushed
+	void SetLodSelection(const glm::mat4 &projection, GLfloat viewportHeight, GLfloat maxPixelError,
+		const glm::vec3 *eyePoints = nullptr, GLuint eyePointCount = 0);
+	// Splits single instance draws of full detail meshes into their meshlets and only draws the ones inside one of
+	// the frusta that face at least one of the view points. For orthographic views the view points are the view
+	// directions instead. The arrays have to stay alive until the pass is flushed
+	void SetMeshletCulling(const Frustum *frusta, GLuint frustumCount, const glm::vec3 *viewPoints, GLuint viewPointCount,
+		bool orthographic);
+
+	// Adds one instanced draw, the model and normal matrices are copied. center is used for the depth part of the
+	// key and for the level of detail, which the first instance's scale picks for all of them
+	void Submit(const Mesh *mesh, Texture *texture, Material *material, const glm::mat4 *models, const glm::mat3 *normals,
+		GLsizei instanceCount, GLint faceMask, glm::vec3 center);
+
+	// Sorts everything submitted since BeginPass and draws it with as few glMultiDrawElementsIndirect calls as the
+	// textures allow, streaming all instance data and draw commands through frameBuffer at once
+	void Flush(RingBuffer *frameBuffer);
+
+	const RenderQueueStats &GetStats() const;
+	void ResetStats();
+
+	static GLuint64 MakeSortKey(GLuint pass, GLuint program, GLuint texture, GLenum indexType, GLuint material, GLuint mesh,
+		GLuint depth);
+
+private:
+	struct DrawItem
+	{
+		const Mesh *mesh;
+		Texture *texture;
+		Material *material;
+		GLsizei firstInstance, instanceCount;
+		size_t lod;
+		// Meshlet ranges to draw instead of the whole level, when rangeCount isn't 0
+		size_t firstRange, rangeCount;
+	};
+
+	struct SortEntry
+	{
+		GLuint64 key;
+		GLuint item;
+	};
+
+	// Consecutive commands that can go into one multi-draw
+	struct Batch
+	{
+		Texture *texture;
+		GeometryPool *pool;
+		GLenum indexType;
+		size_t firstCommand, commandCount;
+	};
+
+	// Omnidirectional shadow passes have a view point per light
+	static constexpr GLuint MAX_CULL_VIEW_POINTS = 8;
+
+	GLuint pass, program;
+	PassKind passKind;
+	glm::vec3 eyePosition;
+	GLfloat farPlane;
+
+	// Pixels per world unit, at unit distance for perspective projections and anywhere for orthographic ones
+	GLfloat lodPixelScale;
+	bool lodPerspective;
+	GLfloat lodMaxPixelError;
+	const glm::vec3 *lodEyePoints;
+	GLuint lodEyePointCount;
+
+	const Frustum *cullFrusta;
+	GLuint cullFrustumCount;
+	const glm::vec3 *cullViewPoints;
+	GLuint cullViewPointCount;
+	bool cullOrthographic;
+
+	std::vector<DrawItem> items;
+	std::vector<SortEntry> entries, sortScratch;
+	std::vector<InstanceData> instances;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<Batch> batches;
+	std::vector<GLuint> rangeFirstIndices;
+	std::vector<GLsizei> rangeIndexCounts;
+
+	RenderQueueStats stats;
+
+	// LSD radix sort of the entries by key, one byte per pass, skipping bytes that are equal in every key
+	void SortEntries();
+	GLuint CountStateChanges(const DrawItem *previous, const DrawItem &item) const;
+	size_t SelectLod(const Mesh *mesh, const glm::mat4 &model, glm::vec3 center) const;
+	// Adds the visible meshlets as ranges, merging neighbours, and returns false if none is visible
+	bool CullMeshlets(const Mesh *mesh, const glm::mat4 &model, DrawItem &item);
+	static GLfloat GetMaxScale(const glm::mat4 &model);
+};
@@ -0,0 +1,120 @@
+#include "RingBuffer.h"
+
+#include <stdexcept>
+#include <string>
+
+RingBuffer::RingBuffer() :
+	bufferId(0),
+	mappedData(nullptr),
+	frameSize(0),
+	frameUsed(0),
+	frameIndex(0),
+	uniformAlignment(256),
+	storageAlignment(256),
+	fences{}
+{}
+
+void RingBuffer::Init(GLsizeiptr size)
+{
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+	// Keep every region aligned for both targets
+	const GLsizeiptr alignment = uniformAlignment > storageAlignment ? uniformAlignment : storageAlignment;
+	frameSize = (size + alignment - 1) / alignment * alignment;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &bufferId);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+	glBufferStorage(GL_UNIFORM_BUFFER, frameSize * FRAMES_IN_FLIGHT, nullptr, flags);
+	mappedData = static_cast<GLubyte*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, frameSize * FRAMES_IN_FLIGHT, flags));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (!mappedData)
+	{
+		throw std::runtime_error("Failed to map the frame data buffer!");
+	}
+}
+
+void RingBuffer::BeginFrame()
+{
+	frameIndex = (frameIndex + 1) % FRAMES_IN_FLIGHT;
+	frameUsed = 0;
+
+	GLsync &fence = fences[frameIndex];
+	if (!fence)
+	{
+		return;
+	}
+
+	// Flush on the first try, otherwise the fence might never be submitted and the wait never ends
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(fence, waitFlags, 1000000) == GL_TIMEOUT_EXPIRED)
+	{
+		waitFlags = 0;
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void RingBuffer::EndFrame()
+{
+	fences[frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void *RingBuffer::Allocate(GLenum target, GLsizeiptr size, GLintptr &offset)
+{
+	const GLsizeiptr alignment = target == GL_SHADER_STORAGE_BUFFER ? storageAlignment : uniformAlignment;
+	const GLsizeiptr start = (frameUsed + alignment - 1) / alignment * alignment;
+
+	if (start + size > frameSize)
+	{
+		throw std::runtime_error("Frame data buffer overflow, " + std::to_string(start + size) + " of " +
+			std::to_string(frameSize) + " bytes!");
+	}
+
+	frameUsed = start + size;
+	offset = frameIndex * frameSize + start;
+	return mappedData + offset;
+}
+
+void RingBuffer::BindRange(GLenum target, GLuint binding, GLintptr offset, GLsizeiptr size) const
+{
+	glBindBufferRange(target, binding, bufferId, offset, size);
+}
+
+GLuint RingBuffer::GetBufferId() const
+{
+	return bufferId;
+}
+
+void RingBuffer::ClearBuffer()
+{
+	for (GLsync &fence : fences)
+	{
+		if (fence)
+		{
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (bufferId != 0)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		glDeleteBuffers(1, &bufferId);
+		bufferId = 0;
+	}
+
+	mappedData = nullptr;
+}
+
+RingBuffer::~RingBuffer()
+{
+	ClearBuffer();
+}
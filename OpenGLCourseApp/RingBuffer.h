@@ -0,0 +1,40 @@
+#pragma once
+#include <GL/glew.h>
+
+// Persistently mapped buffer split into one region per frame in flight. Per-frame data is written straight
+// into the mapping and bound with glBindBufferRange, and a fence per region keeps the CPU from overwriting
+// data the GPU is still reading
+class RingBuffer
+{
+public:
+	static constexpr GLuint FRAMES_IN_FLIGHT = 3;
+
+	RingBuffer();
+
+	void Init(GLsizeiptr frameSize);
+
+	// Waits until the GPU is done with the next region and starts allocating from it
+	void BeginFrame();
+	void EndFrame();
+
+	// Returns where to write size bytes, offset is aligned for binding the range to target
+	void *Allocate(GLenum target, GLsizeiptr size, GLintptr &offset);
+	void BindRange(GLenum target, GLuint binding, GLintptr offset, GLsizeiptr size) const;
+
+	GLuint GetBufferId() const;
+
+	void ClearBuffer();
+
+	~RingBuffer();
+
+private:
+	GLuint bufferId;
+	GLubyte *mappedData;
+
+	GLsizeiptr frameSize, frameUsed;
+	GLuint frameIndex;
+
+	GLint uniformAlignment, storageAlignment;
+
+	GLsync fences[FRAMES_IN_FLIGHT];
+};
@@ -1,14 +1,12 @@
 ﻿#include "Shader.h"
 
+#include "GLState.h"
+
 #include <glm/gtc/type_ptr.inl>
 
 
 Shader::Shader() :
-	shaderProgramId(0),
-	uniformModel(0),
-	uniformProjection(0),
-	pointLightCount(0),
-	spotLightCount(0)
+	shaderProgramId(0)
 {}
 
 void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
@@ -106,113 +104,28 @@ void Shader::CompileShader(const char* vertexCode, const char* geometryCode, con
 	CompileProgram();
 }
 
-GLuint Shader::GetProjectionLocation() const
-{
-	return uniformProjection;
-}
-
-GLuint Shader::GetModelLocation() const
-{
-	return uniformModel;
-}
-
-GLuint Shader::GetViewLocation() const
-{
-	return uniformView;
-}
-
-GLuint Shader::GetAmbientIntensityLocation() const
+void Shader::SetSpotShadowMaps(SpotLight* sLight, GLuint lightCount, unsigned textureUnit)
 {
-	return uniformDirectionalLight.uniformAmbientIntensity;
-}
-
-GLuint Shader::GetAmbientColorLocation() const
-{
-	return uniformDirectionalLight.uniformColor;
-}
-
-GLuint Shader::GetDiffuseIntensityLocation() const
-{
-	return uniformDirectionalLight.uniformDiffuseIntensity;
-}
-GLuint Shader::GetDirectionLocation() const
-{
-	return uniformDirectionalLight.uniformDirection;
-}
-
-GLuint Shader::GetSpecularIntensityLocation() const
-{
-	return uniformSpecularIntensity;
-}
-
-GLuint Shader::GetShininessLocation() const
-{
-	return uniformShininess;
-}
-
-GLuint Shader::GetEyePositionLocation() const
-{
-	return uniformEyePosition;
-}
-
-GLuint Shader::GetOmniLightPosLocation() const
-{
-	return uniformOmniLightPos;
-}
-
-GLuint Shader::GetFarPlaneLocation() const
-{
-	return uniformFarPlane;
-}
-
-void Shader::SetDirectionalLight(DirectionalLight* directionalLight)
-{
-	directionalLight->UseLight(uniformDirectionalLight.uniformAmbientIntensity, uniformDirectionalLight.uniformColor,
-		uniformDirectionalLight.uniformDiffuseIntensity, uniformDirectionalLight.uniformDirection);
-}
-
-void Shader::SetPointLights(PointLight* pLight, GLuint lightCount, unsigned textureUnit, unsigned offset)
-{
-	if (lightCount > MAX_POINT_LIGHTS)
+	for (size_t i = 0; i < lightCount; i++)
 	{
-		lightCount = MAX_POINT_LIGHTS;
-	}
+		const GLint shadowIndex = sLight[i].GetShadowIndex();
+		if (shadowIndex < 0 || shadowIndex >= MAX_SPOT_SHADOWS)
+		{
+			continue;
+		}
 
-	glUniform1i(uniformPointLightCount, lightCount);
+		sLight[i].GetShadowMap()->Read(GL_TEXTURE0 + textureUnit + shadowIndex);
+		glUniform1i(uniformSpotShadowMap[shadowIndex].shadowMap, textureUnit + shadowIndex);
 
-	for (size_t i = 0; i < lightCount; i++)
-	{
-		pLight[i].UseLight(
-			uniformPointLight[i].uniformAmbientIntensity, uniformPointLight[i].uniformColor,
-			uniformPointLight[i].uniformDiffuseIntensity, uniformPointLight[i].uniformPosition,
-			uniformPointLight[i].uniformConstant, uniformPointLight[i].uniformLinear, uniformPointLight[i].uniformExponent);
-
-		pLight[i].GetShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniShadowMap[i + offset].shadowMap, textureUnit + i);
-		glUniform1f(uniformOmniShadowMap[i + offset].farPlane, pLight[i].GetFarPlane());
+		const glm::mat4 lTransform = sLight[i].CalculateLightTransform();
+		glUniformMatrix4fv(uniformSpotShadowMap[shadowIndex].transform, 1, GL_FALSE, glm::value_ptr(lTransform));
+		glUniform2f(uniformSpotShadowMap[shadowIndex].planes, sLight[i].GetNearPlane(), sLight[i].GetFarPlane());
 	}
 }
 
-void Shader::SetSpotLights(SpotLight* sLight, GLuint lightCount, unsigned textureUnit, unsigned offset)
+void Shader::SetLightClusters(LightClusters* clusters)
 {
-	if (lightCount > MAX_SPOT_LIGHTS)
-	{					 
-		lightCount = MAX_SPOT_LIGHTS;
-	}
-
-	glUniform1i(uniformSpotLightCount, lightCount);
-
-	for (size_t i = 0; i < lightCount; i++)
-	{
-		sLight[i].UseLight(
-			uniformSpotLight[i].uniformAmbientIntensity, uniformSpotLight[i].uniformColor,
-			uniformSpotLight[i].uniformDiffuseIntensity, uniformSpotLight[i].uniformPosition, uniformSpotLight[i].uniformDirection,
-			uniformSpotLight[i].uniformConstant, uniformSpotLight[i].uniformLinear, uniformSpotLight[i].uniformExponent,
-			uniformSpotLight[i].uniformEdge);
-		sLight[i].GetShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniShadowMap[i + offset].shadowMap, textureUnit + i);
-		glUniform1f(uniformOmniShadowMap[i + offset].farPlane, sLight[i].GetFarPlane());
-	}
+	clusters->UseClusters(uniformClusterDimensions, uniformClusterTileSize, uniformClusterDepthParams);
 }
 
 void Shader::SetTexture(GLuint textureUnit)
@@ -225,22 +138,24 @@ void Shader::SetDirectionalShadowMap(GLuint textureUnit)
 	glUniform1i(uniformDirectionalShadowMap, textureUnit);
 }
 
+void Shader::SetOmniShadowMap(GLuint textureUnit)
+{
+	glUniform1i(uniformOmniShadowMap, textureUnit);
+}
+
 void Shader::SetDirectionalLightTransform(glm::mat4* lTransform)
 {
 	glUniformMatrix4fv(uniformDirectionalLightTransform, 1, GL_FALSE, glm::value_ptr(*lTransform));
 }
 
-void Shader::SetLightMatrices(std::vector<glm::mat4> lightMatrices)
+void Shader::UseShader() const
 {
-	for (size_t i = 0; i < 6; i++)
-	{
-		glUniformMatrix4fv(uniformLightMatrices[i], 1, GL_FALSE, glm::value_ptr(lightMatrices[i]));
-	}
+	GLState::UseProgram(shaderProgramId);
 }
 
-void Shader::UseShader() const
+GLuint Shader::GetProgramId() const
 {
-	glUseProgram(shaderProgramId);
+	return shaderProgramId;
 }
 
 
@@ -250,10 +165,8 @@ void Shader::ClearShader()
 	{
 		glDeleteProgram(shaderProgramId);
 		shaderProgramId = 0;
+		GLState::Invalidate();
 	}
-
-	uniformModel = 0;
-	uniformProjection = 0;
 }
 
 void Shader::AddShader(const GLuint programId, const char* shaderCode, const GLenum shaderType)
@@ -279,6 +192,15 @@ void Shader::AddShader(const GLuint programId, const char* shaderCode, const GLe
 	glAttachShader(programId, shaderId);
 }
 
+void Shader::BindUniformBlock(const char* blockName, GLuint binding) const
+{
+	const GLuint blockIndex = glGetUniformBlockIndex(shaderProgramId, blockName);
+	if (blockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(shaderProgramId, blockIndex, binding);
+	}
+}
+
 void Shader::CompileProgram()
 {
 	GLint result = 0;
@@ -293,99 +215,32 @@ void Shader::CompileProgram()
 	}
 
 
-	uniformModel = glGetUniformLocation(shaderProgramId, "model");
-	uniformView = glGetUniformLocation(shaderProgramId, "view");
-	uniformProjection = glGetUniformLocation(shaderProgramId, "projection");
-	uniformDirectionalLight.uniformColor = glGetUniformLocation(shaderProgramId, "directionalLight.base.color");
-	uniformDirectionalLight.uniformAmbientIntensity = glGetUniformLocation(shaderProgramId, "directionalLight.base.ambientIntensity");
-	uniformDirectionalLight.uniformDirection = glGetUniformLocation(shaderProgramId, "directionalLight.direction");
-	uniformDirectionalLight.uniformDiffuseIntensity = glGetUniformLocation(shaderProgramId, "directionalLight.base.diffuseIntensity");
-	uniformSpecularIntensity = glGetUniformLocation(shaderProgramId, "material.specularIntensity");
-	uniformShininess = glGetUniformLocation(shaderProgramId, "material.shininess");
-	uniformEyePosition = glGetUniformLocation(shaderProgramId, "eyePos");
-
-	uniformPointLightCount = glGetUniformLocation(shaderProgramId, "pointLightCount");
-
-	for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
-	{
-		char locBuf[100] = { '\0' };
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].base.color", i);
-		uniformPointLight[i].uniformColor = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].base.ambientIntensity", i);
-		uniformPointLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].base.diffuseIntensity", i);
-		uniformPointLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].position", i);
-		uniformPointLight[i].uniformPosition = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].constant", i);
-		uniformPointLight[i].uniformConstant = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].linear", i);
-		uniformPointLight[i].uniformLinear = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "pointLights[%d].exponent", i);
-		uniformPointLight[i].uniformExponent = glGetUniformLocation(shaderProgramId, locBuf);
-	}
-
-	uniformSpotLightCount = glGetUniformLocation(shaderProgramId, "spotLightCount");
-
-	for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
-	{
-		char locBuf[100] = { '\0' };
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.base.color", i);
-		uniformSpotLight[i].uniformColor = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.base.ambientIntensity", i);
-		uniformSpotLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.base.diffuseIntensity", i);
-		uniformSpotLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.position", i);
-		uniformSpotLight[i].uniformPosition = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.constant", i);
-		uniformSpotLight[i].uniformConstant = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.linear", i);
-		uniformSpotLight[i].uniformLinear = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].base.exponent", i);
-		uniformSpotLight[i].uniformExponent = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].direction", i);
-		uniformSpotLight[i].uniformDirection = glGetUniformLocation(shaderProgramId, locBuf);
-
-		snprintf(locBuf, sizeof(locBuf), "spotLights[%d].edge", i);
-		uniformSpotLight[i].uniformEdge = glGetUniformLocation(shaderProgramId, locBuf);
-	}
+	// Camera, lights and shadow matrices come from the per-frame uniform blocks
+	BindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+	BindUniformBlock("DirectionalLight", DIRECTIONAL_LIGHT_BLOCK_BINDING);
+	BindUniformBlock("OmniShadows", OMNI_SHADOW_BLOCK_BINDING);
 
 	uniformTexture = glGetUniformLocation(shaderProgramId, "textureSampler");
 	uniformDirectionalLightTransform = glGetUniformLocation(shaderProgramId, "directionalLightTransform");
 	uniformDirectionalShadowMap = glGetUniformLocation(shaderProgramId, "directionalShadowMap");
 
-	uniformOmniLightPos = glGetUniformLocation(shaderProgramId, "lightPos");
-	uniformFarPlane = glGetUniformLocation(shaderProgramId, "farPlane");
+	uniformOmniShadowMap = glGetUniformLocation(shaderProgramId, "omniShadowMap");
 
-	for(size_t i = 0; i < 6; i++)
-	{
-		char locBuf[100] = { '\0' };
-		snprintf(locBuf, sizeof(locBuf), "lightMatrices[%d]", i);
-		uniformLightMatrices[i] = glGetUniformLocation(shaderProgramId, locBuf);
-	}
+	uniformClusterDimensions = glGetUniformLocation(shaderProgramId, "clusterDimensions");
+	uniformClusterTileSize = glGetUniformLocation(shaderProgramId, "clusterTileSize");
+	uniformClusterDepthParams = glGetUniformLocation(shaderProgramId, "clusterDepthParams");
 
-	for(size_t i = 0; i < MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS; i++)
+	for(size_t i = 0; i < MAX_SPOT_SHADOWS; i++)
 	{
 		char locBuf[100] = { '\0' };
-		snprintf(locBuf, sizeof(locBuf), "omniShadowMaps[%d].shadowMap", i);
-		uniformOmniShadowMap[i].shadowMap = glGetUniformLocation(shaderProgramId, locBuf);
+		snprintf(locBuf, sizeof(locBuf), "spotShadowMaps[%d].shadowMap", i);
+		uniformSpotShadowMap[i].shadowMap = glGetUniformLocation(shaderProgramId, locBuf);
+
+		snprintf(locBuf, sizeof(locBuf), "spotShadowMaps[%d].transform", i);
+		uniformSpotShadowMap[i].transform = glGetUniformLocation(shaderProgramId, locBuf);
 
-		snprintf(locBuf, sizeof(locBuf), "omniShadowMaps[%d].farPlane", i);
-		uniformOmniShadowMap[i].farPlane = glGetUniformLocation(shaderProgramId, locBuf);
+		snprintf(locBuf, sizeof(locBuf), "spotShadowMaps[%d].planes", i);
+		uniformSpotShadowMap[i].planes = glGetUniformLocation(shaderProgramId, locBuf);
 	}
 }
 
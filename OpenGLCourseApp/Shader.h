@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include <string>
 #include <fstream>
+#include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -9,6 +10,7 @@
 #include "DirectionalLight.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "LightClusters.h"
 
 class Shader
 {
@@ -22,92 +24,41 @@ public:
 
 	static std::string ReadFile(const char *fileLocation);
 
-	GLuint GetProjectionLocation() const;
-	GLuint GetModelLocation() const;
-	GLuint GetViewLocation() const;
-	GLuint GetAmbientIntensityLocation() const;
-	GLuint GetAmbientColorLocation() const;
-	GLuint GetDiffuseIntensityLocation() const;
-	GLuint GetDirectionLocation() const;
-	GLuint GetSpecularIntensityLocation() const;
-	GLuint GetShininessLocation() const;
-	GLuint GetEyePositionLocation() const;
-	GLuint GetOmniLightPosLocation() const;
-	GLuint GetFarPlaneLocation() const;
 
-	void SetDirectionalLight(DirectionalLight *directionalLight);
-	void SetPointLights(PointLight *pLight, GLuint lightCount, unsigned textureUnit, unsigned offset);
-	void SetSpotLights(SpotLight *sLight, GLuint lightCount, unsigned textureUnit, unsigned offset);
+	// Binds the shadow maps of the spot lights that cast shadows, starting at textureUnit
+	void SetSpotShadowMaps(SpotLight *sLight, GLuint lightCount, unsigned textureUnit);
+	void SetLightClusters(LightClusters *clusters);
 	void SetTexture(GLuint textureUnit);
 	void SetDirectionalShadowMap(GLuint textureUnit);
+	void SetOmniShadowMap(GLuint textureUnit);
 	void SetDirectionalLightTransform(glm::mat4 *lTransform);
-	void SetLightMatrices(std::vector<glm::mat4> lightMatrices);
 
 	void UseShader() const;
+	GLuint GetProgramId() const;
 	void ClearShader();
 
 	~Shader();
 
 private:
 
-	GLuint shaderProgramId, uniformModel, uniformView, uniformProjection,
-			uniformEyePosition, uniformSpecularIntensity, uniformShininess,
+	GLuint shaderProgramId,
 			uniformTexture,
 			uniformDirectionalLightTransform, uniformDirectionalShadowMap,
-			uniformOmniLightPos, uniformFarPlane;
+			uniformOmniShadowMap;
 
-	GLuint uniformLightMatrices[6];
-	int pointLightCount, spotLightCount;
-
-	struct
-	{
-		GLuint uniformColor;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformDirection;
-	} uniformDirectionalLight;
-
-	GLuint uniformPointLightCount;
-
-	struct
-	{
-		GLuint uniformColor;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformPosition;
-		GLuint uniformConstant;
-		GLuint uniformLinear;
-		GLuint uniformExponent;
-	} uniformPointLight[MAX_POINT_LIGHTS];
-
-	GLuint uniformSpotLightCount;
-
-	struct
-	{
-		GLuint uniformColor;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformPosition;
-		GLuint uniformConstant;
-		GLuint uniformLinear;
-		GLuint uniformExponent;
-
-		GLuint uniformDirection;
-		GLuint uniformEdge;
-	} uniformSpotLight[MAX_SPOT_LIGHTS];
+	GLuint uniformClusterDimensions, uniformClusterTileSize, uniformClusterDepthParams;
 
 	struct
 	{
 		GLuint shadowMap;
-		GLuint farPlane;
-	} uniformOmniShadowMap[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+		GLuint transform;
+		GLuint planes;
+	} uniformSpotShadowMap[MAX_SPOT_SHADOWS];
 
 	void CompileShader(const char *vertexCode, const char *fragmentCode);
 	void CompileShader(const char *vertexCode, const char *geometryCode, const char *fragmentCode);
 	static void AddShader(GLuint programId, const char* shaderCode, GLenum shaderType);
+	void BindUniformBlock(const char *blockName, GLuint binding) const;
 
 	void CompileProgram();
 };
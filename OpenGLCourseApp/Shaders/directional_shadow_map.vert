@@ -1,11 +1,13 @@
 #version 330
 
-layout (location = 0) in vec3 pos;
+layout (location = 0) in vec3 pos; // from the pool's position-only stream
+layout (location = 3) in mat4 model; // per instance
+layout (location = 7) in vec3 positionScale;
+layout (location = 8) in vec3 positionOffset;
 
-uniform mat4 model;
 uniform mat4 directionalLightTransform; // projection * view, from the point of view of the light source
 
 void main()
 {
-	gl_Position = directionalLightTransform * model * vec4(pos, 1.0);
+	gl_Position = directionalLightTransform * model * vec4(positionOffset + positionScale * pos, 1.0);
 }
\ No newline at end of file
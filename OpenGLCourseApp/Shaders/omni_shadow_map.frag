@@ -1,14 +1,20 @@
-#version 330
+#version 400
 
-in vec4 FragPos;
+const int MAX_OMNI_SHADOWS = 3;
 
-uniform vec3 lightPos;
-uniform float farPlane;
+in vec4 FragPos;
+flat in int LightIndex;
 
+layout (std140) uniform OmniShadows
+{
+	mat4 lightMatrices[MAX_OMNI_SHADOWS * 6];
+	vec4 lightPositions[MAX_OMNI_SHADOWS]; // w: far plane
+	int lightCount;
+};
 
 void main() 
 {
-	float dist = length(FragPos.xyz - lightPos);
-	dist = dist / farPlane;
+	float dist = length(FragPos.xyz - lightPositions[LightIndex].xyz);
+	dist = dist / lightPositions[LightIndex].w;
 	gl_FragDepth = dist;
 }
\ No newline at end of file
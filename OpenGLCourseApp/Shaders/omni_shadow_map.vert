@@ -1,10 +1,16 @@
-#version 330
+#version 400
 
-layout (location = 0) in vec3 pos;
+layout (location = 0) in vec3 pos; // from the pool's position-only stream
+layout (location = 3) in mat4 model; // per instance
+layout (location = 7) in vec3 positionScale;
+layout (location = 8) in vec3 positionOffset;
+// Bit per layer-face whose frustum the instance is in, the rest are culled on the CPU
+layout (location = 10) in int faceMask;
 
-uniform mat4 model;
+flat out int FaceMask;
 
 void main() 
 {
-	gl_Position = model * vec4(pos, 1.0);
+	gl_Position = model * vec4(positionOffset + positionScale * pos, 1.0);
+	FaceMask = faceMask;
 }
\ No newline at end of file
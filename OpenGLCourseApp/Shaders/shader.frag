@@ -1,15 +1,18 @@
-#version 330		
+#version 430		
 
 in vec4 vColor;
 in vec2 texCoord;
 in vec3 Normal;
 in vec3 FragPos;
 in vec4 DirectionalLightSpacePos;
+in float ViewDepth;
+flat in float SpecularIntensity;
+flat in float Shininess;
 
 out vec4 color;		
 
-const int MAX_POINT_LIGHTS = 3;
-const int MAX_SPOT_LIGHTS = 3;
+const int MAX_OMNI_SHADOWS = 3;
+const int MAX_SPOT_SHADOWS = 3;
 
 struct Light
 {
@@ -18,54 +21,87 @@ struct Light
 	float diffuseIntensity;
 };
 
-struct DirectionalLight 
-{
-	Light base;
-	vec3 direction;
-};
-
+// Point and spot lights live in storage buffers, matching PointLightData and SpotLightData on the CPU
 struct PointLight
 {
-	Light base;
+	vec3 color;
+	float ambientIntensity;
 	vec3 position;
+	float diffuseIntensity;
 	float constant;
 	float linear;
 	float exponent;
+	int shadowIndex;
+	float farPlane;
 };
 
 struct SpotLight
 {
-	PointLight base;
+	vec3 color;
+	float ambientIntensity;
+	vec3 position;
+	float diffuseIntensity;
 	vec3 direction;
 	float edge;
+	float constant;
+	float linear;
+	float exponent;
+	int shadowIndex;
 };
 
-struct OmniShadowMap
+struct SpotShadowMap
 {
-	samplerCube shadowMap;
-	float farPlane;
+	sampler2D shadowMap;
+	mat4 transform;
+	vec2 planes; // near, far
 };
 
-struct Material
+layout (std430, binding = 0) readonly buffer PointLightBuffer
 {
-	float specularIntensity;
-	float shininess;
+	PointLight pointLights[];
 };
 
-uniform int pointLightCount;
-uniform int spotLightCount;
+layout (std430, binding = 1) readonly buffer SpotLightBuffer
+{
+	SpotLight spotLights[];
+};
 
-uniform DirectionalLight directionalLight;
-uniform PointLight pointLights[MAX_POINT_LIGHTS];
-uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
+// x: offset into lightIndices, y: point light count, z: spot light count (listed after the point lights)
+layout (std430, binding = 2) readonly buffer ClusterBuffer
+{
+	uvec4 clusters[];
+};
 
-uniform sampler2D textureSampler;
-uniform sampler2D directionalShadowMap;
-uniform OmniShadowMap omniShadowMaps[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+layout (std430, binding = 3) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
 
-uniform Material material;
+uniform uvec3 clusterDimensions;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthParams; // slice = log(depth) * x + y
+
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePos;
+};
 
-uniform vec3 eyePos;
+layout (std140) uniform DirectionalLight
+{
+	vec3 color;
+	float ambientIntensity;
+	vec3 direction;
+	float diffuseIntensity;
+	mat4 transform;
+} directionalLight;
+
+uniform sampler2D textureSampler;
+uniform sampler2D directionalShadowMap;
+// Cubemap i of the array belongs to the point light with shadow index i
+uniform samplerCubeArray omniShadowMap;
+uniform SpotShadowMap spotShadowMaps[MAX_SPOT_SHADOWS];
 
 vec3 sampleOffsetDirections[20] = vec3[]
 (
@@ -77,7 +113,7 @@ vec3 sampleOffsetDirections[20] = vec3[]
 );
 
 
-float CalcDirectionalShadowFactor(DirectionalLight light)
+float CalcDirectionalShadowFactor()
 {
 	vec3 projCoords = DirectionalLightSpacePos.xyz / DirectionalLightSpacePos.w;
 	projCoords = (projCoords * 0.5) + 0.5;
@@ -85,7 +121,7 @@ float CalcDirectionalShadowFactor(DirectionalLight light)
 	float current = projCoords.z;
 
 	vec3 normal = normalize(Normal);
-	vec3 lightDirection = normalize(light.direction);
+	vec3 lightDirection = normalize(directionalLight.direction);
 
 	float bias = max(0.05 * (1 - dot(normal, lightDirection)), 0.005);
 
@@ -110,8 +146,13 @@ float CalcDirectionalShadowFactor(DirectionalLight light)
 	return shadow;
 }
 
-float CalcOmniShadowFactor(PointLight light, int shadowIndex)
+float CalcOmniShadowFactor(PointLight light)
 {
+	if (light.shadowIndex < 0)
+	{
+		return 0.0;
+	}
+
 	vec3 fragToLight = FragPos - light.position;
 	float current = length(fragToLight);
 	
@@ -119,13 +160,13 @@ float CalcOmniShadowFactor(PointLight light, int shadowIndex)
 	float bias = 0.05;
 	int samples = 20;
 
-	float viewDistance = length(eyePos - FragPos);
-	float diskRadius = (1.0 + (viewDistance / omniShadowMaps[shadowIndex].farPlane)) / 25.0;
+	float viewDistance = length(eyePos.xyz - FragPos);
+	float diskRadius = (1.0 + (viewDistance / light.farPlane)) / 25.0;
 	
 	for (int i = 0; i < samples; i++)
 	{
-		float closest = texture(omniShadowMaps[shadowIndex].shadowMap, fragToLight + sampleOffsetDirections[i] * diskRadius).r;
-		closest *= omniShadowMaps[shadowIndex].farPlane;
+		float closest = texture(omniShadowMap, vec4(fragToLight + sampleOffsetDirections[i] * diskRadius, light.shadowIndex)).r;
+		closest *= light.farPlane;
 		if (current - bias > closest)
 		{
 			shadow += 1.0;
@@ -136,6 +177,70 @@ float CalcOmniShadowFactor(PointLight light, int shadowIndex)
 	return shadow;
 }
 
+float LinearizeDepth(float depth, vec2 planes)
+{
+	float ndc = depth * 2.0 - 1.0;
+	return (2.0 * planes.x * planes.y) / (planes.y + planes.x - ndc * (planes.y - planes.x));
+}
+
+// Sampler arrays may only be indexed with dynamically uniform values, and the shadow index comes from
+// the cluster's light list, so pick the sampler with constant indices
+float SampleSpotShadowMap(int shadowIndex, vec2 uv)
+{
+	switch (shadowIndex)
+	{
+	case 0: return texture(spotShadowMaps[0].shadowMap, uv).r;
+	case 1: return texture(spotShadowMaps[1].shadowMap, uv).r;
+	default: return texture(spotShadowMaps[2].shadowMap, uv).r;
+	}
+}
+
+vec2 SpotShadowMapSize(int shadowIndex)
+{
+	switch (shadowIndex)
+	{
+	case 0: return vec2(textureSize(spotShadowMaps[0].shadowMap, 0));
+	case 1: return vec2(textureSize(spotShadowMaps[1].shadowMap, 0));
+	default: return vec2(textureSize(spotShadowMaps[2].shadowMap, 0));
+	}
+}
+
+float CalcSpotShadowFactor(int shadowIndex)
+{
+	if (shadowIndex < 0)
+	{
+		return 0.0;
+	}
+
+	vec4 lightSpacePos = spotShadowMaps[shadowIndex].transform * vec4(FragPos, 1.0);
+	vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
+	projCoords = (projCoords * 0.5) + 0.5;
+
+	if(projCoords.z > 1.0)
+	{
+		return 0.0;
+	}
+
+	// Perspective depth isn't linear, so compare distances along the light direction to keep the bias constant
+	vec2 planes = spotShadowMaps[shadowIndex].planes;
+	float current = LinearizeDepth(projCoords.z, planes);
+	float bias = 0.05;
+
+	float shadow = 0.0;
+
+	vec2 texSize = 1.0 / SpotShadowMapSize(shadowIndex);
+	for (int x = -1; x <= 1; x++)
+	{
+		for(int y = -1; y <= 1; y++)
+		{
+			float closest = LinearizeDepth(SampleSpotShadowMap(shadowIndex, projCoords.xy + vec2(x, y) * texSize), planes);
+			shadow += current - bias > closest ? 1.0 : 0.0;
+		}
+	}
+
+	return shadow / 9.0;
+}
+
 vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor) 
 {
 	vec4 ambientColor = vec4(light.color, 1.0) * light.ambientIntensity;
@@ -143,45 +248,52 @@ vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor)
 	vec4 diffuseColor = vec4(light.color, 1.0) * light.diffuseIntensity * diffuseFactor;
 	vec4 specularColor = vec4(0, 0, 0, 0);
 	bool isLit = diffuseFactor > 0.0;
-	vec3 fragToEye = normalize(eyePos - FragPos);
+	vec3 fragToEye = normalize(eyePos.xyz - FragPos);
 	vec3 refl = normalize(reflect(direction, normalize(Normal)));
 	float specularFactor = max(dot(fragToEye, refl), 0.0);
-	specularFactor = pow(specularFactor, material.shininess);
-	specularColor = vec4(light.color, 1.0) * material.specularIntensity * specularFactor * float(isLit);
+	specularFactor = pow(specularFactor, Shininess);
+	specularColor = vec4(light.color, 1.0) * SpecularIntensity * specularFactor * float(isLit);
 
 	return ambientColor + (1.0 - shadowFactor) * (diffuseColor + specularColor);
 }
 
 vec4 CalcDirectionalLight()
 {
-	float shadowFactor = CalcDirectionalShadowFactor(directionalLight);
-	return CalcLightByDirection(directionalLight.base, directionalLight.direction, shadowFactor);
+	Light base = Light(directionalLight.color, directionalLight.ambientIntensity, directionalLight.diffuseIntensity);
+	return CalcLightByDirection(base, directionalLight.direction, CalcDirectionalShadowFactor());
 }
 
-vec4 CalcPointLight(PointLight pLight, int shadowIndex)
+vec4 CalcAttenuatedLight(Light light, vec3 position, float constant, float linear, float exponent, float shadowFactor)
 {
-	vec3 direction = FragPos - pLight.position;
+	vec3 direction = FragPos - position;
 	float dist = length(direction);
 	direction = normalize(direction);
 
-	float shadowFactor = CalcOmniShadowFactor(pLight, shadowIndex);
-
-	vec4 color = CalcLightByDirection(pLight.base, direction, shadowFactor);
-	float attenuation = pLight.exponent * dist * dist + 
-						pLight.linear * dist +
-						pLight.constant;
+	vec4 color = CalcLightByDirection(light, direction, shadowFactor);
+	float attenuation = exponent * dist * dist + 
+						linear * dist +
+						constant;
 
 	return color / attenuation;
 }
 
-vec4 CalcSpotLight(SpotLight sLight, int shadowIndex)
+vec4 CalcPointLight(PointLight pLight)
 {
-	vec3 rayDirection = normalize(FragPos - sLight.base.position);
+	Light base = Light(pLight.color, pLight.ambientIntensity, pLight.diffuseIntensity);
+	return CalcAttenuatedLight(base, pLight.position, pLight.constant, pLight.linear, pLight.exponent,
+		CalcOmniShadowFactor(pLight));
+}
+
+vec4 CalcSpotLight(SpotLight sLight)
+{
+	vec3 rayDirection = normalize(FragPos - sLight.position);
 	float spotLightFactor = dot(rayDirection, sLight.direction);
 
 	if(spotLightFactor > sLight.edge) 
 	{
-		vec4 color = CalcPointLight(sLight.base, shadowIndex);
+		Light base = Light(sLight.color, sLight.ambientIntensity, sLight.diffuseIntensity);
+		vec4 color = CalcAttenuatedLight(base, sLight.position, sLight.constant, sLight.linear, sLight.exponent,
+			CalcSpotShadowFactor(sLight.shadowIndex));
 
 		return color * (1.0 - (1.0 - spotLightFactor) * (1.0 / (1.0 - sLight.edge)));
 	} else {
@@ -189,22 +301,26 @@ vec4 CalcSpotLight(SpotLight sLight, int shadowIndex)
 	}
 }
 
-vec4 CalcPointLights()
+uvec4 GetCluster()
 {
-	vec4 totalColor = vec4(0, 0, 0, 0);
-	for(int i = 0; i < pointLightCount; i++)
-	{
-		totalColor += CalcPointLight(pointLights[i], i);
-	}
-	return totalColor;
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), clusterDimensions.xy - 1);
+	uint slice = min(uint(max(log(ViewDepth) * clusterDepthParams.x + clusterDepthParams.y, 0.0)), clusterDimensions.z - 1);
+	return clusters[tile.x + tile.y * clusterDimensions.x + slice * clusterDimensions.x * clusterDimensions.y];
 }
 
-vec4 CalcSpotLights()
+// Only the lights binned into this fragment's cluster can reach it
+vec4 CalcClusterLights()
 {
+	uvec4 cluster = GetCluster();
+
 	vec4 totalColor = vec4(0, 0, 0, 0);
-	for(int i = 0; i < spotLightCount; i++)
+	for(uint i = 0; i < cluster.y; i++)
+	{
+		totalColor += CalcPointLight(pointLights[lightIndices[cluster.x + i]]);
+	}
+	for(uint i = 0; i < cluster.z; i++)
 	{
-		totalColor += CalcSpotLight(spotLights[i], i + pointLightCount);
+		totalColor += CalcSpotLight(spotLights[lightIndices[cluster.x + cluster.y + i]]);
 	}
 	return totalColor;
 }
@@ -212,8 +328,7 @@ vec4 CalcSpotLights()
 void main()					
 {
 	vec4 finalColor = CalcDirectionalLight();
-	finalColor += CalcPointLights();
-	finalColor += CalcSpotLights();
+	finalColor += CalcClusterLights();
 	
 	color = texture(textureSampler, texCoord) * finalColor;
 }
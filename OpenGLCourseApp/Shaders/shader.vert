@@ -1,28 +1,54 @@
-#version 330
+#version 430
 
 layout (location = 0) in vec3 pos;	
 layout (location = 1) in vec2 uv;
 layout (location = 2) in vec3 normal;
+layout (location = 3) in mat4 model; // per instance
+// Per mesh, undoes the position quantization of the vertex format
+layout (location = 7) in vec3 positionScale;
+layout (location = 8) in vec3 positionOffset;
+layout (location = 9) in vec2 material; // per instance: specular intensity, shininess
+layout (location = 11) in mat3 normalMatrix; // per instance, inverse transpose of the model matrix
 
 out vec4 vColor;	
 out vec2 texCoord;
 out vec3 Normal;
 out vec3 FragPos;
 out vec4 DirectionalLightSpacePos;
+out float ViewDepth;
+flat out float SpecularIntensity;
+flat out float Shininess;
 
-uniform mat4 model;			
-uniform mat4 view;
-uniform mat4 projection;			
-uniform mat4 directionalLightTransform;
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePos;
+};
+
+layout (std140) uniform DirectionalLight
+{
+	vec3 color;
+	float ambientIntensity;
+	vec3 direction;
+	float diffuseIntensity;
+	mat4 transform;
+} directionalLight;
 													
 void main()											
 {													
-	gl_Position = projection * view * model * vec4(pos, 1.0);
-	DirectionalLightSpacePos = directionalLightTransform * model * vec4(pos, 1.0);
-	vColor = vec4(clamp(pos, 0.0f, 1.0f), 1.0f);	
+	vec3 position = positionOffset + positionScale * pos;
+
+	gl_Position = projection * view * model * vec4(position, 1.0);
+	DirectionalLightSpacePos = directionalLight.transform * model * vec4(position, 1.0);
+	vColor = vec4(clamp(position, 0.0f, 1.0f), 1.0f);	
 	texCoord = uv;
 
-	Normal = mat3(transpose(inverse(model))) * normal;
+	Normal = normalMatrix * normal;
+
+	FragPos = (model * vec4(position, 1.0)).xyz;
+	ViewDepth = -(view * vec4(FragPos, 1.0)).z;
 
-	FragPos = (model * vec4(pos, 1.0)).xyz;
+	SpecularIntensity = material.x;
+	Shininess = material.y;
 }
\ No newline at end of file
@@ -1,14 +1,22 @@
 #version 330
 
 layout (location = 0) in vec3 pos;
+layout (location = 7) in vec3 positionScale;
+layout (location = 8) in vec3 positionOffset;
 
 out vec3 TexCoords;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec4 eyePos;
+};
 
 void main()
 {
-	TexCoords = pos;
-	gl_Position = projection * view * vec4(pos, 1.0);
+	vec3 position = positionOffset + positionScale * pos;
+	TexCoords = position;
+	// Drop the translation so the skybox stays centered on the camera
+	gl_Position = projection * mat4(mat3(view)) * vec4(position, 1.0);
 }
\ No newline at end of file
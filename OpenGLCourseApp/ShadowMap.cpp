@@ -2,6 +2,8 @@
 
 #include <string>
 
+#include "GLState.h"
+
 ShadowMap::ShadowMap() :
 	FBO(0),
 	shadowWidth(0)
@@ -15,7 +17,7 @@ bool ShadowMap::Init(unsigned int width, unsigned int height)
 	glGenFramebuffers(1, &FBO);
 
 	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	GLState::BindTexture(0, GL_TEXTURE_2D, shadowMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
@@ -24,7 +26,7 @@ bool ShadowMap::Init(unsigned int width, unsigned int height)
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	GLState::BindFramebuffer(FBO);
 	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
 
 	// Ignore color attachments
@@ -39,21 +41,20 @@ bool ShadowMap::Init(unsigned int width, unsigned int height)
 		return false;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(0);
 
 	return true;
 }
 
 void ShadowMap::Write()
 {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	GLState::BindFramebuffer(FBO);
 
 }
 
 void ShadowMap::Read(GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	GLState::BindTexture(textureUnit - GL_TEXTURE0, GL_TEXTURE_2D, shadowMap);
 }
 
 GLuint ShadowMap::GetShadowWidth()
@@ -77,4 +78,6 @@ ShadowMap::~ShadowMap()
 	{
 		glDeleteTextures(1, &shadowMap);
 	}
+
+	GLState::Invalidate();
 }
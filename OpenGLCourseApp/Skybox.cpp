@@ -1,18 +1,16 @@
 ﻿#include "Skybox.h"
 
+#include "GLState.h"
+
 Skybox::Skybox() = default;
 
-Skybox::Skybox(std::vector<std::string> faceLocations)
+Skybox::Skybox(std::vector<std::string> faceLocations, GeometryPool* pool)
 {
 	skyShader = new Shader();
 	skyShader->CreateFromFiles("Shaders/skybox.vert", "Shaders/skybox.frag");
 
-	uniformProjection = skyShader->GetProjectionLocation();
-	uniformView = skyShader->GetViewLocation();
-
-
 	glGenTextures(1, &textureId);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, textureId);
 
 	int width, height, bitDepth;
 
@@ -72,26 +70,22 @@ Skybox::Skybox(std::vector<std::string> faceLocations)
 	};
 
 	skyMesh = new Mesh();
-	skyMesh->CreateMesh(skyboxVertices, skyBoxIndices, 64, 36);
+	skyMesh->CreateMesh(pool, skyboxVertices, skyBoxIndices, 64, 36);
 }
 
-void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix) const
+void Skybox::DrawSkybox(RingBuffer* instanceBuffer) const
 {
-	viewMatrix = glm::mat4(glm::mat3(viewMatrix));
-
 	glDepthMask(GL_FALSE);
 
 	skyShader->UseShader();
-	
-	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, textureId);
 
 	skyShader->Validate();
 
-	skyMesh->RenderMesh();
+	// The skybox shader ignores the model matrix, only the position decode of the instance data is read
+	const glm::mat4 model(1.0f);
+	skyMesh->RenderMesh(&model, 1, instanceBuffer);
 
 	glDepthMask(GL_TRUE);
 }
@@ -16,14 +16,15 @@ class Skybox
 public:
 	Skybox();
 
-	Skybox(std::vector<std::string> faceLocations);
+	Skybox(std::vector<std::string> faceLocations, GeometryPool *pool);
 
-	void DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix) const;
+	// View and projection come from the Camera uniform block
+	// The skybox's instance data is streamed through instanceBuffer
+	void DrawSkybox(RingBuffer *instanceBuffer) const;
 
 private:
 	Mesh *skyMesh;
 	Shader *skyShader;
 
 	GLuint textureId;
-	GLuint uniformProjection, uniformView;
 };
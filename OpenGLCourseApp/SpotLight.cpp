@@ -1,5 +1,8 @@
 #include "SpotLight.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <glm/trigonometric.hpp>
 
 SpotLight::SpotLight() : PointLight(),
@@ -10,42 +13,68 @@ isOn(true)
 {}
 
 SpotLight::SpotLight(
-	GLuint shadowWidth, GLuint shadowHeight,
+	GLuint shadowSize,
 	GLfloat near, GLfloat far, GLfloat red, GLfloat green, GLfloat blue,
 	GLfloat aIntensity, GLfloat dIntensity,
 	GLfloat xPos, GLfloat yPos, GLfloat zPos,
 	GLfloat xDir, GLfloat yDir, GLfloat zDir,
 	GLfloat con, GLfloat lin, GLfloat exp,
-	GLfloat edge) : PointLight(shadowWidth, shadowHeight, near, far, red, green, blue, aIntensity, dIntensity, xPos, yPos, zPos, con, lin, exp),
+	GLfloat edge) : PointLight(near, far, red, green, blue, aIntensity, dIntensity, xPos, yPos, zPos, con, lin, exp),
 	direction(glm::normalize(glm::vec3(xDir, yDir, zDir))),
 	edge(edge),
 	processedEdge(cosf(glm::radians(edge))),
 	isOn(true)
-{}
+{
+	// The frustum covers the whole cone plus a little margin for the PCF kernel at the cone's edge
+	const GLfloat fov = std::min(2.0f * edge + 2.0f, 170.0f);
+	lightProj = glm::perspective(glm::radians(fov), 1.0f, near, far);
+
+	// The map spans 2 tan(fov / 2) on a plane at unit distance, a 90 degree cone spans 2
+	const GLfloat size = static_cast<GLfloat>(shadowSize) * tanf(glm::radians(fov * 0.5f));
+	GLuint mapSize = (static_cast<GLuint>(std::ceil(size)) + SHADOW_SIZE_GRANULARITY - 1) / SHADOW_SIZE_GRANULARITY *
+		SHADOW_SIZE_GRANULARITY;
+	mapSize = std::min(std::max(mapSize, MIN_SHADOW_SIZE), MAX_SHADOW_SIZE);
+
+	shadowMap = new ShadowMap();
+	shadowMap->Init(mapSize, mapSize);
+}
 
-void SpotLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-	GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation,
-	GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
-	GLuint edgeLocation)
-{
-	glUniform3f(ambientColorLocation, color.x, color.y, color.z);
-	if (isOn)
-	{
-		glUniform1f(ambientIntensityLocation, ambientIntensity);
-		glUniform1f(diffuseIntensityLocation, diffuseIntensity);
-	}
-	else
-	{
-		glUniform1f(ambientIntensityLocation, 0.0f);
-		glUniform1f(diffuseIntensityLocation, 0.0f);
-	}
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
-
-	glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-	glUniform1f(edgeLocation, processedEdge);
+SpotLightData SpotLight::GetLightData() const
+{
+	SpotLightData data = {};
+	data.color = color;
+	data.ambientIntensity = isOn ? ambientIntensity : 0.0f;
+	data.position = position;
+	data.diffuseIntensity = isOn ? diffuseIntensity : 0.0f;
+	data.direction = direction;
+	data.edge = processedEdge;
+	data.constant = constant;
+	data.linear = linear;
+	data.exponent = exponent;
+	data.shadowIndex = shadowIndex;
+	return data;
+}
+
+glm::vec3 SpotLight::GetDirection() const
+{
+	return direction;
+}
+
+GLfloat SpotLight::GetEdge() const
+{
+	return edge;
+}
+
+bool SpotLight::IsOn() const
+{
+	return isOn;
+}
+
+glm::mat4 SpotLight::CalculateLightTransform() const
+{
+	// Any up vector works as long as it isn't parallel to the light direction
+	const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return lightProj * glm::lookAt(position, position + direction, up);
 }
 
 void SpotLight::SetFlash(glm::vec3 pos, glm::vec3 dir)
@@ -1,11 +1,27 @@
 #pragma once
 #include "PointLight.h"
+
+// Layout of a spot light in the clustered lighting storage buffer (std430)
+struct SpotLightData
+{
+	glm::vec3 color;
+	GLfloat ambientIntensity;
+	glm::vec3 position;
+	GLfloat diffuseIntensity;
+	glm::vec3 direction;
+	GLfloat edge;
+	GLfloat constant, linear, exponent;
+	GLint shadowIndex; // Entry in the spot shadow maps, -1 if the light casts no shadows
+};
+
 class SpotLight :
 	public PointLight
 {
 public:
 	SpotLight();
-	SpotLight(GLuint shadowWidth, GLuint shadowHeight,
+	// shadowSize is the size of the square shadow map a 90 degree cone would get. Narrower cones get fewer texels,
+	// so every light's shadows have the same density
+	SpotLight(GLuint shadowSize,
 		GLfloat near, GLfloat far,
 		GLfloat red, GLfloat green, GLfloat blue,
 		GLfloat aIntensity, GLfloat dIntensity,
@@ -14,16 +30,25 @@ public:
 		GLfloat con, GLfloat lin, GLfloat exp,
 		GLfloat edge);
 
-	void UseLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
-		GLuint edgeLocation);
+	SpotLightData GetLightData() const;
+
+	glm::vec3 GetDirection() const;
+	GLfloat GetEdge() const;
+	bool IsOn() const;
+
+	// A spot light only needs a single perspective shadow map covering its cone, instead of a cubemap
+	glm::mat4 CalculateLightTransform() const;
 
 	void SetFlash(glm::vec3 pos, glm::vec3 dir);
 
 	void Toggle();
 
 private:
+	// Bounds of the derived shadow map size, which is rounded up to whole multiples of the granularity
+	static constexpr GLuint MIN_SHADOW_SIZE = 128;
+	static constexpr GLuint MAX_SHADOW_SIZE = 4096;
+	static constexpr GLuint SHADOW_SIZE_GRANULARITY = 64;
+
 	glm::vec3 direction;
 	GLfloat edge, processedEdge;
 
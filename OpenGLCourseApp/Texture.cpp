@@ -2,6 +2,8 @@
 
 #include <string>
 
+#include "GLState.h"
+
 Texture::Texture() :
 	textureID(0),
 	width(0),
@@ -24,7 +26,7 @@ bool Texture::LoadTextureA()
 	}
 
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	GLState::BindTexture(0, GL_TEXTURE_2D, textureID);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -34,7 +36,7 @@ bool Texture::LoadTextureA()
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 
 	stbi_image_free(texData);
 
@@ -51,7 +53,7 @@ bool Texture::LoadTexture()
 	}
 
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	GLState::BindTexture(0, GL_TEXTURE_2D, textureID);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -61,7 +63,7 @@ bool Texture::LoadTexture()
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 
 	stbi_image_free(texData);
 
@@ -70,7 +72,11 @@ bool Texture::LoadTexture()
 
 void Texture::ClearTexture()
 {
-	glDeleteTextures(1, &textureID);
+	if (textureID != 0)
+	{
+		glDeleteTextures(1, &textureID);
+		GLState::Invalidate();
+	}
 	textureID = 0;
 	width = 0;
 	height = 0;
@@ -81,8 +87,12 @@ void Texture::ClearTexture()
 
 void Texture::UseTexture()
 {
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	GLState::BindTexture(1, GL_TEXTURE_2D, textureID);
+}
+
+GLuint Texture::GetTextureId() const
+{
+	return textureID;
 }
 
 Texture::~Texture()
@@ -12,6 +12,7 @@ public:
 	bool LoadTexture();
 	bool LoadTextureA();
 	void UseTexture();
+	GLuint GetTextureId() const;
 	void ClearTexture();
 
 	~Texture();
@@ -0,0 +1,181 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// world = parent * local, column by column: world column c is the sum of parent column k times local[c][k]
+	inline void MultiplyTransforms(const GLfloat* parent, const GLfloat* local, GLfloat* world)
+	{
+#ifdef __AVX__
+		// Two columns of the result at once, each parent column broadcast to both halves
+		const __m256 p0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent));
+		const __m256 p1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 4));
+		const __m256 p2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 8));
+		const __m256 p3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 12));
+		for (int column = 0; column < 4; column += 2)
+		{
+			const __m256 l = _mm256_loadu_ps(local + column * 4);
+			__m256 result = _mm256_mul_ps(p0, _mm256_permute_ps(l, 0x00));
+			result = _mm256_add_ps(result, _mm256_mul_ps(p1, _mm256_permute_ps(l, 0x55)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(p2, _mm256_permute_ps(l, 0xAA)));
+			result = _mm256_add_ps(result, _mm256_mul_ps(p3, _mm256_permute_ps(l, 0xFF)));
+			_mm256_storeu_ps(world + column * 4, result);
+		}
+#else
+		const __m128 p0 = _mm_loadu_ps(parent);
+		const __m128 p1 = _mm_loadu_ps(parent + 4);
+		const __m128 p2 = _mm_loadu_ps(parent + 8);
+		const __m128 p3 = _mm_loadu_ps(parent + 12);
+		for (int column = 0; column < 4; column++)
+		{
+			const __m128 l = _mm_loadu_ps(local + column * 4);
+			__m128 result = _mm_mul_ps(p0, _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(p1, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(p2, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 2, 2))));
+			result = _mm_add_ps(result, _mm_mul_ps(p3, _mm_shuffle_ps(l, l, _MM_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(world + column * 4, result);
+		}
+#endif
+	}
+}
+
+TransformHierarchy::TransformHierarchy()
+{}
+
+GLuint TransformHierarchy::AddNode(GLint parent, const glm::mat4& local)
+{
+	const GLuint node = static_cast<GLuint>(parents.size());
+	// Only the subtrees on the path to the last node end at the end of the arrays
+	if (parent != NO_PARENT && (parent < 0 || static_cast<GLuint>(parent) >= node || subtreeEnds[parent] != node))
+	{
+		throw std::runtime_error("Transform hierarchy nodes have to be added depth first");
+	}
+
+	parents.push_back(parent);
+	subtreeEnds.push_back(node + 1);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(0);
+
+	for (GLint ancestor = parent; ancestor != NO_PARENT; ancestor = parents[ancestor])
+	{
+		subtreeEnds[ancestor] = node + 1;
+	}
+
+	MarkDirty(node);
+	return node;
+}
+
+void TransformHierarchy::SetLocal(GLuint node, const glm::mat4& local)
+{
+	locals[node] = local;
+	MarkDirty(node);
+}
+
+void TransformHierarchy::Update()
+{
+	updatedRanges.clear();
+	if (dirtyNodes.empty())
+	{
+		return;
+	}
+
+	// In order, a dirty node inside a subtree that was just recomputed is already done
+	std::sort(dirtyNodes.begin(), dirtyNodes.end());
+
+	GLuint updatedEnd = 0;
+	for (GLuint root : dirtyNodes)
+	{
+		dirty[root] = 0;
+		if (root < updatedEnd)
+		{
+			continue;
+		}
+
+		const GLuint end = subtreeEnds[root];
+		for (GLuint node = root; node < end; node++)
+		{
+			const GLint parent = parents[node];
+			if (parent == NO_PARENT)
+			{
+				worlds[node] = locals[node];
+			}
+			else
+			{
+				MultiplyTransforms(&worlds[parent][0][0], &locals[node][0][0], &worlds[node][0][0]);
+			}
+		}
+
+		if (!updatedRanges.empty() && updatedRanges.back().first + updatedRanges.back().count == root)
+		{
+			updatedRanges.back().count += end - root;
+		}
+		else
+		{
+			TransformRange range;
+			range.first = root;
+			range.count = end - root;
+			updatedRanges.push_back(range);
+		}
+		updatedEnd = end;
+	}
+
+	dirtyNodes.clear();
+}
+
+GLuint TransformHierarchy::GetNodeCount() const
+{
+	return static_cast<GLuint>(parents.size());
+}
+
+GLint TransformHierarchy::GetParent(GLuint node) const
+{
+	return parents[node];
+}
+
+const glm::mat4& TransformHierarchy::GetLocal(GLuint node) const
+{
+	return locals[node];
+}
+
+const glm::mat4& TransformHierarchy::GetWorld(GLuint node) const
+{
+	return worlds[node];
+}
+
+const glm::mat4* TransformHierarchy::GetWorlds() const
+{
+	return worlds.data();
+}
+
+const std::vector<TransformRange>& TransformHierarchy::GetUpdatedRanges() const
+{
+	return updatedRanges;
+}
+
+void TransformHierarchy::Clear()
+{
+	parents.clear();
+	subtreeEnds.clear();
+	locals.clear();
+	worlds.clear();
+	dirty.clear();
+	dirtyNodes.clear();
+	updatedRanges.clear();
+}
+
+void TransformHierarchy::MarkDirty(GLuint node)
+{
+	if (!dirty[node])
+	{
+		dirty[node] = 1;
+		dirtyNodes.push_back(node);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Nodes [first, first + count) of a TransformHierarchy
+struct TransformRange
+{
+	GLuint first;
+	GLuint count;
+};
+
+// Tree of local transforms with their world matrices, one array per node attribute. Nodes are kept in depth first
+// order, so parents come before their children and every subtree is the contiguous range [node, subtree end).
+// Changing a local transform marks the node dirty, and Update only recomputes the subtrees below dirty nodes, in
+// one linear pass each
+class TransformHierarchy
+{
+public:
+	static constexpr GLint NO_PARENT = -1;
+
+	TransformHierarchy();
+
+	// Appends a node and returns its index. To keep the depth first order the parent has to be NO_PARENT or the
+	// last added node or one of its ancestors, which is what adding a tree recursively does
+	GLuint AddNode(GLint parent, const glm::mat4 &local);
+	void SetLocal(GLuint node, const glm::mat4 &local);
+
+	// Recomputes the world matrices of dirty nodes and everything below them
+	void Update();
+
+	GLuint GetNodeCount() const;
+	GLint GetParent(GLuint node) const;
+	const glm::mat4 &GetLocal(GLuint node) const;
+	// Only up to date after Update
+	const glm::mat4 &GetWorld(GLuint node) const;
+	const glm::mat4 *GetWorlds() const;
+	// Ranges the last Update recomputed, sorted and not touching each other
+	const std::vector<TransformRange> &GetUpdatedRanges() const;
+
+	void Clear();
+
+private:
+	std::vector<GLint> parents;
+	// One past the last node of each node's subtree
+	std::vector<GLuint> subtreeEnds;
+	std::vector<glm::mat4> locals, worlds;
+	std::vector<GLubyte> dirty;
+
+	// Every dirty node once, in the order they were marked
+	std::vector<GLuint> dirtyNodes;
+	std::vector<TransformRange> updatedRanges;
+
+	void MarkDirty(GLuint node);
+};
@@ -0,0 +1,162 @@
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+	struct QuantizedVertex
+	{
+		GLushort position[4];
+		GLuint uv;
+		GLuint normal;
+	};
+
+	static_assert(sizeof(QuantizedVertex) == 16, "Quantized vertices are read with a 16 byte stride");
+
+	GLushort QuantizeUnorm16(GLfloat value, GLfloat minValue, GLfloat extent)
+	{
+		if (extent <= 0.0f)
+		{
+			return 0;
+		}
+
+		const GLfloat normalized = std::min(std::max((value - minValue) / extent, 0.0f), 1.0f);
+		return static_cast<GLushort>(std::lround(normalized * 65535.0f));
+	}
+}
+
+GLsizei VertexLayout::GetVertexSize(VertexFormat format)
+{
+	return format == VertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(GLfloat) * FLOATS_PER_VERTEX;
+}
+
+GLsizei VertexLayout::GetPositionSize(VertexFormat format)
+{
+	return format == VertexFormat::Quantized ? sizeof(QuantizedVertex::position) : sizeof(GLfloat) * 3;
+}
+
+void VertexLayout::SetAttributeFormats(VertexFormat format, GLuint binding)
+{
+	if (format == VertexFormat::Quantized)
+	{
+		glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position));
+		glVertexAttribFormat(1, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, uv));
+		glVertexAttribFormat(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(QuantizedVertex, normal));
+	}
+	else
+	{
+		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
+		glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 5);
+	}
+
+	for (GLuint i = 0; i < 3; i++)
+	{
+		glVertexAttribBinding(i, binding);
+		glEnableVertexAttribArray(i);
+	}
+}
+
+void VertexLayout::SetPositionFormat(VertexFormat format, GLuint binding)
+{
+	if (format == VertexFormat::Quantized)
+	{
+		glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+	}
+	else
+	{
+		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+	}
+
+	glVertexAttribBinding(0, binding);
+	glEnableVertexAttribArray(0);
+}
+
+void VertexLayout::Encode(VertexFormat format, const GLfloat* vertices, GLsizei vertexCount, const AABB& bounds, void* encoded)
+{
+	if (format == VertexFormat::Float)
+	{
+		memcpy(encoded, vertices, sizeof(GLfloat) * FLOATS_PER_VERTEX * vertexCount);
+		return;
+	}
+
+	const glm::vec3 extents = bounds.max - bounds.min;
+	QuantizedVertex *out = static_cast<QuantizedVertex*>(encoded);
+	for (GLsizei i = 0; i < vertexCount; i++)
+	{
+		const GLfloat *vertex = vertices + i * FLOATS_PER_VERTEX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			out[i].position[axis] = QuantizeUnorm16(vertex[axis], bounds.min[axis], extents[axis]);
+		}
+		out[i].position[3] = 0;
+
+		// x ends up in the low bits, which is the order GL reads both formats in
+		out[i].uv = glm::packHalf2x16(glm::vec2(vertex[3], vertex[4]));
+
+		glm::vec3 normal(vertex[5], vertex[6], vertex[7]);
+		const GLfloat length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normal /= length;
+		}
+		out[i].normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+	}
+}
+
+void VertexLayout::ExtractPositions(VertexFormat format, const void* encoded, GLsizei vertexCount, void* positions)
+{
+	const GLsizei vertexSize = GetVertexSize(format);
+	const GLsizei positionSize = GetPositionSize(format);
+	const GLubyte *in = static_cast<const GLubyte*>(encoded);
+	GLubyte *out = static_cast<GLubyte*>(positions);
+	for (GLsizei i = 0; i < vertexCount; i++)
+	{
+		memcpy(out + i * positionSize, in + i * vertexSize, positionSize);
+	}
+}
+
+void VertexLayout::DecodePositions(VertexFormat format, const void* encoded, GLsizei vertexCount, const AABB& bounds,
+	glm::vec3* positions)
+{
+	if (format == VertexFormat::Float)
+	{
+		const GLfloat *in = static_cast<const GLfloat*>(encoded);
+		for (GLsizei i = 0; i < vertexCount; i++)
+		{
+			const GLfloat *vertex = in + i * FLOATS_PER_VERTEX;
+			positions[i] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+		}
+		return;
+	}
+
+	// Same as the shaders: offset + scale * the normalized position
+	glm::vec3 scale, offset;
+	GetPositionDecode(format, bounds, scale, offset);
+	const QuantizedVertex *in = static_cast<const QuantizedVertex*>(encoded);
+	for (GLsizei i = 0; i < vertexCount; i++)
+	{
+		const glm::vec3 normalized(in[i].position[0] / 65535.0f, in[i].position[1] / 65535.0f, in[i].position[2] / 65535.0f);
+		positions[i] = offset + scale * normalized;
+	}
+}
+
+void VertexLayout::GetPositionDecode(VertexFormat format, const AABB& bounds, glm::vec3& scale, glm::vec3& offset)
+{
+	if (format == VertexFormat::Quantized && !bounds.IsEmpty())
+	{
+		scale = bounds.max - bounds.min;
+		offset = bounds.min;
+	}
+	else
+	{
+		scale = glm::vec3(1.0f);
+		offset = glm::vec3(0.0f);
+	}
+}
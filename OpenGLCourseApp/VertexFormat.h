@@ -0,0 +1,49 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+
+// Vertex layouts a GeometryPool can store. Both feed the same attributes (0 position, 1 uv, 2 normal) as
+// floats to the shaders, which only have to undo the position quantization
+enum class VertexFormat
+{
+	// Position, uv and normal as 8 floats, 32 bytes
+	Float,
+	// Position as 16 bit unorm relative to the mesh bounds (plus padding), uv as half floats and the normal as
+	// signed normalized 10:10:10:2, 16 bytes
+	Quantized
+};
+
+class VertexLayout
+{
+public:
+	// Source vertices handed to the encoder are always the 8 float layout
+	static constexpr GLsizei FLOATS_PER_VERTEX = 8;
+
+	// Generic attributes that hold the per mesh position decode, read from the instance data of the draw:
+	// position = offset + scale * pos
+	static constexpr GLuint POSITION_SCALE_ATTRIBUTE = 7;
+	static constexpr GLuint POSITION_OFFSET_ATTRIBUTE = 8;
+
+	static GLsizei GetVertexSize(VertexFormat format);
+	// Size of the position alone, which is the first member of every format
+	static GLsizei GetPositionSize(VertexFormat format);
+
+	// Attribute formats of the VAO that reads this format from binding
+	static void SetAttributeFormats(VertexFormat format, GLuint binding);
+	// Only the position attribute, read from a tightly packed stream of GetPositionSize sized positions
+	static void SetPositionFormat(VertexFormat format, GLuint binding);
+
+	// Writes vertexCount vertices in format to encoded, which needs room for vertexCount * GetVertexSize.
+	// bounds has to contain every position
+	static void Encode(VertexFormat format, const GLfloat *vertices, GLsizei vertexCount, const AABB &bounds, void *encoded);
+	// Copies the positions out of vertexCount encoded vertices, packed, to positions
+	static void ExtractPositions(VertexFormat format, const void *encoded, GLsizei vertexCount, void *positions);
+	// Decodes the positions of vertexCount encoded vertices back to floats, for the CPU. bounds are the ones they
+	// were encoded with
+	static void DecodePositions(VertexFormat format, const void *encoded, GLsizei vertexCount, const AABB &bounds,
+		glm::vec3 *positions);
+
+	static void GetPositionDecode(VertexFormat format, const AABB &bounds, glm::vec3 &scale, glm::vec3 &offset);
+};
@@ -1,11 +1,18 @@
 #include "Window.h"
+#include "GLState.h"
 #include <cstdlib>
 #include <stdexcept>
+#include <string>
 
 
 Window::Window() :
+	mainWindow(nullptr),
 	width(800),
 	height(600),
+	headless(false),
+	offscreenFBO(0),
+	offscreenColor(0),
+	offscreenDepth(0),
 	mouseFirstMoved(true),
 	xChange(0.0f),
 	yChange(0.0f)
@@ -16,9 +23,14 @@ Window::Window() :
 	}
 }
 
-Window::Window(GLint windowWidth, GLint windowHeight) :
+Window::Window(GLint windowWidth, GLint windowHeight, bool headless) :
+	mainWindow(nullptr),
 	width(windowWidth),
 	height(windowHeight),
+	headless(headless),
+	offscreenFBO(0),
+	offscreenColor(0),
+	offscreenDepth(0),
 	mouseFirstMoved(true),
 	xChange(0.0f),
 	yChange(0.0f)
@@ -31,6 +43,14 @@ Window::Window(GLint windowWidth, GLint windowHeight) :
 
 void Window::initialize()
 {
+#ifdef GLFW_PLATFORM_NULL
+	if (headless)
+	{
+		// Build machines have no display server, so don't let GLFW look for one
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
+#endif
+
 	if (!glfwInit())
 	{
 		glfwTerminate();
@@ -38,15 +58,16 @@ void Window::initialize()
 	}
 
 	// Setup GLFW window properties
-	// OpenGL version 3.3
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	// OpenGL version 4.4 (persistently mapped frame data, storage buffers for clustered lighting,
+	// cubemap arrays for the omni shadow pass)
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
 
 	// Core profile -> no backwards compatibility
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-	mainWindow = glfwCreateWindow(width, height, "Test Window", nullptr, nullptr);
+	createContext();
 	if (!mainWindow)
 	{
 		glfwTerminate();
@@ -66,16 +87,30 @@ void Window::initialize()
 	// Allow modern extension features
 	glewExperimental = GL_TRUE;
 
-	if (glewInit() != GLEW_OK)
+	GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLEW still looks for GLX after loading the core entry points, which EGL/OSMesa contexts don't have
+	if (headless && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		glewStatus = GLEW_OK;
+	}
+#endif
+
+	if (glewStatus != GLEW_OK)
 	{
 		glfwDestroyWindow(mainWindow);
 		glfwTerminate();
 		throw std::runtime_error("GLEW initialize failed!");
 	}
 
+	if (headless)
+	{
+		createOffscreenFramebuffer();
+	}
+
 	glEnable(GL_DEPTH_TEST);
 
-	glViewport(0, 0, bufferWidth, bufferHeight);
+	GLState::Viewport(0, 0, bufferWidth, bufferHeight);
 
 	glfwSetWindowUserPointer(mainWindow, this);
 }
@@ -94,12 +129,77 @@ GLfloat Window::getYChange()
 	return change;
 }
 
+void Window::swapBuffers() const
+{
+	// Nothing to present for the offscreen framebuffer
+	if (!headless)
+	{
+		glfwSwapBuffers(mainWindow);
+	}
+}
+
 Window::~Window()
 {
+	if (offscreenFBO)
+	{
+		glDeleteFramebuffers(1, &offscreenFBO);
+		glDeleteRenderbuffers(1, &offscreenColor);
+		glDeleteRenderbuffers(1, &offscreenDepth);
+		GLState::Invalidate();
+	}
+
 	glfwDestroyWindow(mainWindow);
 	glfwTerminate();
 }
 
+void Window::createContext()
+{
+	if (!headless)
+	{
+		mainWindow = glfwCreateWindow(width, height, "Test Window", nullptr, nullptr);
+		return;
+	}
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	// Try a surfaceless EGL context first and fall back to OSMesa, both of which run on llvmpipe without a GPU
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+	mainWindow = glfwCreateWindow(width, height, "Headless Window", nullptr, nullptr);
+	if (!mainWindow)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		mainWindow = glfwCreateWindow(width, height, "Headless Window", nullptr, nullptr);
+	}
+}
+
+void Window::createOffscreenFramebuffer()
+{
+	// The null platform reports no framebuffer, render at the requested size instead
+	bufferWidth = width;
+	bufferHeight = height;
+
+	glGenRenderbuffers(1, &offscreenColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, bufferWidth, bufferHeight);
+
+	glGenRenderbuffers(1, &offscreenDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, bufferWidth, bufferHeight);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &offscreenFBO);
+	GLState::BindFramebuffer(offscreenFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		throw std::runtime_error("Offscreen framebuffer incomplete: " + std::to_string(status));
+	}
+}
+
 void Window::createCallBacks()
 {
 	glfwSetKeyCallback(mainWindow, handleKeys);
@@ -7,20 +7,23 @@ class Window
 {
 public:
 	Window();
-	Window(GLint windowWidth, GLint windowHeight);
+	Window(GLint windowWidth, GLint windowHeight, bool headless = false);
 
 	void initialize();
 
 	GLint getBufferWidth() const { return bufferWidth; }
 	GLint getBufferHeight() const { return bufferHeight; }
 
+	bool isHeadless() const { return headless; }
+	GLuint getFramebuffer() const { return offscreenFBO; }
+
 	bool getShouldClose() const { return glfwWindowShouldClose(mainWindow); }
 
 	bool *getKeys() { return keys; }
 	GLfloat getXChange();
 	GLfloat getYChange();
 
-	void swapBuffers() const { glfwSwapBuffers(mainWindow); }
+	void swapBuffers() const;
 
 	~Window();
 private:
@@ -29,11 +32,17 @@ private:
 	GLint width, height;
 	GLint bufferWidth, bufferHeight;
 
+	// Headless windows render into an offscreen framebuffer instead of the (invisible) default one
+	bool headless;
+	GLuint offscreenFBO, offscreenColor, offscreenDepth;
+
 	bool mouseFirstMoved;
 	bool keys[1024];
 
 	GLfloat lastX, lastY, xChange, yChange;
 
+	void createContext();
+	void createOffscreenFramebuffer();
 	void createCallBacks();
 	static void handleKeys(GLFWwindow* window, int key, int code, int action, int mode);
 	static void handleMouse(GLFWwindow* window, double xPos, double yPos);
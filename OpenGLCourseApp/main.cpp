@@ -1,5 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cmath>
 #include <stdexcept>
@@ -12,26 +14,36 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <cstdlib>
+#include <cstring>
 
 #include "Mesh.h"
+#include "GeometryPool.h"
+#include "GeometryUtils.h"
 #include "Shader.h"
 #include "Window.h"
 #include "Camera.h"
 #include "DirectionalLight.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "OmniShadowMap.h"
+#include "LightClusters.h"
+#include "RingBuffer.h"
+#include "Frustum.h"
+#include "TransformHierarchy.h"
+#include "FrameTransforms.h"
+#include "BoundingVolumeHierarchy.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
+#include "GLState.h"
 #include "Material.h"
 #include "Texture.h"
 #include "Model.h"
+#include "Benchmark.h"
 
 #include "Skybox.h"
 
 #include <assimp/Importer.hpp>
 
-GLuint uniformProjection = 0, uniformModel = 0, uniformView = 0,
-       uniformEyePosition = 0, uniformSpecularIntensity = 0, uniformShininess = 0,
-       uniformOmniLightPos = 0, uniformFarPlane = 0;
-
 Window mainWindow;
 std::vector<Mesh*> meshList;
 std::vector<Shader> shaderList;
@@ -51,6 +63,21 @@ DirectionalLight mainLight;
 PointLight pointLights[MAX_POINT_LIGHTS];
 SpotLight spotLights[MAX_SPOT_LIGHTS];
 
+// Every point light shares one cubemap array and is rendered in a single omni shadow pass
+OmniShadowMap omniShadowMap;
+std::vector<PointLight*> omniShadowLights;
+
+// Point and spot lights are binned per cluster instead of being looped over by every fragment
+LightClusters lightClusters;
+
+// Per-frame uniform and light data, written once per frame and bound to every program by range
+RingBuffer frameData;
+
+// Vertices and indices of every mesh, behind one VAO
+GeometryPool geometryPool;
+// Quantized vertices are half the size of the float layout, which mostly pays off in the shadow passes
+const VertexFormat GEOMETRY_FORMAT = VertexFormat::Quantized;
+
 Skybox skybox;
 
 unsigned int pointLightCount = 0;
@@ -61,51 +88,86 @@ GLfloat lastTime = 0.0f;
 
 GLfloat laptopAngle = 0.0f;
 
+// Everything in the scene, the laptop's own nodes below a pivot that UpdateScene spins
+TransformHierarchy sceneHierarchy;
+// World matrices of the scene, updated once per frame by UpdateScene and shared by every pass
+FrameTransforms frameTransforms;
+
+// Nodes of the scene's objects, instances of the same mesh are next to each other
+GLuint pyramidNodes = 0;
+GLuint floorNode = 0;
+GLuint laptopPivotNode = 0;
+GLuint laptopNode = 0;
+GLuint laptopModelNode = 0;
+
+// Spatial indices every pass culls the scene with: what never moves is built once, what does is refit every frame
+BoundingVolumeHierarchy staticObjects;
+BoundingVolumeHierarchy dynamicObjects;
+
+// Objects of the indices, instances of the same mesh are next to each other like their nodes
+constexpr GLuint STATIC_PYRAMIDS = 0;
+constexpr GLuint STATIC_FLOOR = 2;
+constexpr GLuint STATIC_OBJECT_COUNT = 3;
+constexpr GLuint DYNAMIC_LAPTOP = 0;
+constexpr GLuint DYNAMIC_OBJECT_COUNT = 1;
+
+// Query results of the current pass, the volumes each object is in
+std::vector<VolumeHit> sceneHits;
+std::vector<GLint> staticMasks, dynamicMasks;
+
+// The omni shadow pass passes one bit per layer-face of the cubemap array
+static_assert(MAX_OMNI_SHADOWS * 6 <= 32, "Omni shadow face mask doesn't fit an int");
+
+CullingStats cullingStats;
+
+// The main view drops what's hidden behind the pyramids, the floor and the laptop before submitting it. The buffer
+// is tiny compared to the window, a pixel of it covers about 5x6 of the window's
+OcclusionCuller occlusionCuller;
+constexpr GLuint OCCLUSION_WIDTH = 256;
+constexpr GLuint OCCLUSION_HEIGHT = 128;
+Occluder pyramidOccluder, floorOccluder;
+// CPU time spent drawing occluders and testing boxes, over the same frames as the stats
+std::chrono::duration<double, std::milli> occlusionTime(0.0);
+
+// Model and normal matrices of the instances that survived culling, reused by every batch
+std::vector<glm::mat4> visibleModels;
+std::vector<glm::mat3> visibleNormals;
+
+// Draws are queued per pass and submitted sorted by state
+RenderQueue renderQueue;
+
+// Pass part of the render queue sort keys
+constexpr GLuint PASS_DIRECTIONAL_SHADOW = 0;
+constexpr GLuint PASS_OMNI_SHADOW = 1;
+constexpr GLuint PASS_SPOT_SHADOW = 2;
+constexpr GLuint PASS_MAIN = 3;
+
+// Benchmark runs use a fixed time step so that animation doesn't depend on the frame rate
+constexpr GLfloat BENCHMARK_TIME_STEP = 1.0f / 60.0f;
+constexpr unsigned BENCHMARK_WARMUP_FRAMES = 10;
+
+// Levels of detail are picked so that their error stays under this many pixels, shadow maps are blurred by
+// filtering anyway and take coarser levels
+constexpr GLfloat LOD_PIXEL_ERROR = 1.0f;
+constexpr GLfloat SHADOW_LOD_BIAS = 4.0f;
+
+// Shadow map size of a 90 degree spot light, the 20 degree ones get 1024x1024
+constexpr GLuint SPOT_SHADOW_SIZE = 2560;
+
 static const char* vShader = "Shaders/shader.vert";
 static const char* fShader = "Shaders/shader.frag";
 
-void calculateNormals(const unsigned int* indices, unsigned int indexCount, GLfloat* vertices,
-                      unsigned int vertexCount, unsigned int vLength, unsigned int normalOffset)
+// Keeps the positions of interleaved 8 float vertices and the indices on the CPU
+Occluder CreateOccluder(const GLfloat* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
 {
-	for (size_t i = 0; i < indexCount; i += 3)
+	Occluder occluder;
+	for (unsigned int i = 0; i < vertexCount; i++)
 	{
-		auto in0 = indices[i] * vLength;
-		auto in1 = indices[i + 1] * vLength;
-		auto in2 = indices[i + 2] * vLength;
-		glm::vec3 v1(vertices[in1] - vertices[in0], vertices[in1 + 1] - vertices[in0 + 1],
-		             vertices[in1 + 2] - vertices[in0 + 2]);
-		glm::vec3 v2(vertices[in2] - vertices[in0], vertices[in2 + 1] - vertices[in0 + 1],
-		             vertices[in2 + 2] - vertices[in0 + 2]);
-		glm::vec3 normal = glm::cross(v1, v2);
-		normal = glm::normalize(normal);
-
-		in0 += normalOffset;
-		in1 += normalOffset;
-		in2 += normalOffset;
-
-		vertices[in0] += normal.x;
-		vertices[in0 + 1] += normal.y;
-		vertices[in0 + 2] += normal.z;
-
-		vertices[in1] += normal.x;
-		vertices[in1 + 1] += normal.y;
-		vertices[in1 + 2] += normal.z;
-
-		vertices[in2] += normal.x;
-		vertices[in2 + 1] += normal.y;
-		vertices[in2 + 2] += normal.z;
-	}
-
-	// Normalize normals
-	for (size_t i = 0; i < vertexCount / vLength; i++)
-	{
-		unsigned int nOffset = i * vLength + normalOffset;
-		glm::vec3 vec(vertices[nOffset], vertices[nOffset + 1], vertices[nOffset + 2]);
-		vec = glm::normalize(vec);
-		vertices[nOffset] = vec.x;
-		vertices[nOffset + 1] = vec.y;
-		vertices[nOffset + 2] = vec.z;
+		const GLfloat *vertex = vertices + i * VertexLayout::FLOATS_PER_VERTEX;
+		occluder.positions.push_back(glm::vec3(vertex[0], vertex[1], vertex[2]));
 	}
+	occluder.indices.assign(indices, indices + indexCount);
+	return occluder;
 }
 
 void CreateObjects()
@@ -139,19 +201,19 @@ void CreateObjects()
 		10.0f, 0.0f, 10.0f,		10.0f, 10.0f,	0.0f, -1.0f, 0.0f
 	};
 
-	calculateNormals(indices, 12, vertices, 32, 8, 5);
+	GeometryUtils::CalculateNormals(indices, 12, vertices, 4, 8, 5, NormalWeighting::Face);
 
-	Mesh* obj1 = new Mesh();
-	obj1->CreateMesh(vertices, indices, 32, 12);
-	meshList.push_back(obj1);
+	// Every pyramid is an instance of the same mesh
+	Mesh* pyramid = new Mesh();
+	pyramid->CreateMesh(&geometryPool, vertices, indices, 32, 12);
+	meshList.push_back(pyramid);
 
-	Mesh* obj2 = new Mesh();
-	obj2->CreateMesh(vertices, indices, 32, 12);
-	meshList.push_back(obj2);
+	Mesh* floor = new Mesh();
+	floor->CreateMesh(&geometryPool, floorVertices, floorIndices, 32, 6);
+	meshList.push_back(floor);
 
-	Mesh* obj3 = new Mesh();
-	obj3->CreateMesh(floorVertices, floorIndices, 32, 6);
-	meshList.push_back(obj3);
+	pyramidOccluder = CreateOccluder(vertices, 4, indices, 12);
+	floorOccluder = CreateOccluder(floorVertices, 4, floorIndices, 6);
 }
 
 void CreateShaders()
@@ -167,142 +229,549 @@ void CreateShaders()
 	                                 "Shaders/omni_shadow_map.frag");
 }
 
-void RenderScene()
+// Culls the scene's objects against the volumes of the current pass through both spatial indices, leaving the mask
+// of volumes each object is in in staticMasks and dynamicMasks
+template<typename Volume>
+void QueryScene(const Volume* volumes, GLuint volumeCount)
+{
+	staticMasks.assign(staticObjects.GetObjectCount(), 0);
+	dynamicMasks.assign(dynamicObjects.GetObjectCount(), 0);
+
+	sceneHits.clear();
+	staticObjects.Query(volumes, volumeCount, sceneHits);
+	for (const VolumeHit &hit : sceneHits)
+	{
+		staticMasks[hit.object] = static_cast<GLint>(hit.volumeMask);
+	}
+
+	sceneHits.clear();
+	dynamicObjects.Query(volumes, volumeCount, sceneHits);
+	for (const VolumeHit &hit : sceneHits)
+	{
+		dynamicMasks[hit.object] = static_cast<GLint>(hit.volumeMask);
+	}
+}
+
+// Turns the light masks of a query with the ranges of the omni shadow lights into masks of the layer-faces of those
+// lights that each object is in
+void SelectOmniFaces(const BoundingVolumeHierarchy& index, const Frustum* frusta, GLuint lightCount, std::vector<GLint>& masks)
 {
-	glm::mat4 model(1.0f);
-
-	model = glm::translate(model, glm::vec3(0.0f, 0.0f, -2.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	brickTexture.UseTexture();
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[0]->RenderMesh();
-
-	model = glm::mat4(1.0f);
-	model = translate(model, glm::vec3(0.0f, 4.0f, -2.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dirtTexture.UseTexture();
-	dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[1]->RenderMesh();
-
-	model = glm::mat4(1.0f);
-	model = translate(model, glm::vec3(0.0f, -2.0f, 0.0f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dirtTexture.UseTexture();
-	dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[2]->RenderMesh();
+	for (GLuint object = 0; object < masks.size(); object++)
+	{
+		const GLint lightMask = masks[object];
+		GLint faceMask = 0;
+		for (GLuint light = 0; light < lightCount && lightMask != 0; light++)
+		{
+			if (!(lightMask & (1 << light)))
+			{
+				continue;
+			}
+
+			for (GLuint face = 0; face < 6; face++)
+			{
+				if (frusta[light * 6 + face].IntersectsBox(index.GetObjectBounds(object)))
+				{
+					faceMask |= 1 << (light * 6 + face);
+				}
+			}
+		}
+		masks[object] = faceMask;
+	}
+}
 
+// Keeps the model and normal matrices of the instances whose objects the pass's query found in visibleModels and
+// visibleNormals. faceMask gets the volumes of all of them, center the middle of the first one. drawCount is the
+// number of draws an instance takes, for the culling stats
+GLsizei GatherInstances(const BoundingVolumeHierarchy& index, const std::vector<GLint>& masks, GLuint firstObject,
+	const FrameTransforms& scene, GLuint firstNode, GLsizei instanceCount, GLuint drawCount, GLint& faceMask, glm::vec3& center)
+{
+	visibleModels.clear();
+	visibleNormals.clear();
+	faceMask = 0;
+
+	for (GLsizei i = 0; i < instanceCount; i++)
+	{
+		const GLint mask = masks[firstObject + i];
+		if (mask == 0)
+		{
+			cullingStats.culled += drawCount;
+			continue;
+		}
+
+		if (visibleModels.empty())
+		{
+			center = index.GetObjectBounds(firstObject + i).GetCenter();
+		}
+
+		cullingStats.submitted += drawCount;
+		faceMask |= mask;
+		visibleModels.push_back(scene.GetWorlds(firstNode)[i]);
+		visibleNormals.push_back(scene.GetNormals(firstNode)[i]);
+	}
+
+	return static_cast<GLsizei>(visibleModels.size());
+}
+
+// Queues the static objects from firstObject on, which are instances of mesh at the nodes from firstNode on
+void SubmitStaticInstances(GLuint firstObject, const Mesh* mesh, const FrameTransforms& scene, GLuint firstNode,
+	GLsizei instanceCount, Texture* texture, Material* material)
+{
+	GLint faceMask;
+	glm::vec3 center;
+	const GLsizei visibleCount = GatherInstances(staticObjects, staticMasks, firstObject, scene, firstNode, instanceCount, 1,
+		faceMask, center);
+
+	renderQueue.Submit(mesh, texture, material, visibleModels.data(), visibleNormals.data(), visibleCount, faceMask, center);
+}
+
+glm::mat4 GetLaptopPivot()
+{
+	const glm::mat4 pivot = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, -2.5f));
+	return glm::rotate(pivot, glm::radians(laptopAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// Builds the scene's hierarchy once the laptop is loaded, depth first
+void CreateScene()
+{
+	pyramidNodes = sceneHierarchy.AddNode(TransformHierarchy::NO_PARENT,
+		glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -2.5f)));
+	sceneHierarchy.AddNode(TransformHierarchy::NO_PARENT, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 4.0f, -2.5f)));
+	floorNode = sceneHierarchy.AddNode(TransformHierarchy::NO_PARENT, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -2.0f, 0.0f)));
+
+	// The laptop circles the pyramids, only the pivot changes from frame to frame
+	laptopPivotNode = sceneHierarchy.AddNode(TransformHierarchy::NO_PARENT, GetLaptopPivot());
+	const glm::mat4 offset = glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 0.5f, 0.0f));
+	laptopNode = sceneHierarchy.AddNode(static_cast<GLint>(laptopPivotNode),
+		glm::rotate(offset, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+	laptopModelNode = laptop.AddToHierarchy(&sceneHierarchy, static_cast<GLint>(laptopNode));
+
+	// Static objects are roots, so their local transforms are already their world transforms
+	AABB staticBounds[STATIC_OBJECT_COUNT];
+	staticBounds[STATIC_PYRAMIDS] = meshList[0]->GetBounds().Transform(sceneHierarchy.GetLocal(pyramidNodes));
+	staticBounds[STATIC_PYRAMIDS + 1] = meshList[0]->GetBounds().Transform(sceneHierarchy.GetLocal(pyramidNodes + 1));
+	staticBounds[STATIC_FLOOR] = meshList[1]->GetBounds().Transform(sceneHierarchy.GetLocal(floorNode));
+	staticObjects.Build(staticBounds, STATIC_OBJECT_COUNT);
+
+	// Refit with the real bounds every frame
+	const AABB dynamicBounds[DYNAMIC_OBJECT_COUNT];
+	dynamicObjects.Build(dynamicBounds, DYNAMIC_OBJECT_COUNT);
+}
+
+// Advances the animation and updates this frame's transforms, before any pass reads them
+void UpdateScene()
+{
 	laptopAngle += 0.1f;
 	if (laptopAngle > 360.0f)
 	{
 		laptopAngle = deltaTime * 0.1f;
 	}
+	sceneHierarchy.SetLocal(laptopPivotNode, GetLaptopPivot());
 
-	model = glm::mat4(1.0f);
-	model = translate(model, glm::vec3(0.0f, 1.0f, -2.5f));
-	model = glm::rotate(model, glm::radians(laptopAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-	model = translate(model, glm::vec3(4.0f, 0.5f, 0.0f));
-	model = glm::rotate(model, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	sceneHierarchy.Update();
+	frameTransforms.Update(sceneHierarchy);
 
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	laptop.RenderModel();
+	AABB dynamicBounds[DYNAMIC_OBJECT_COUNT];
+	dynamicBounds[DYNAMIC_LAPTOP] = laptop.GetBounds().Transform(*frameTransforms.GetWorlds(laptopNode));
+	dynamicObjects.Refit(dynamicBounds);
 }
 
-void DirectionalShadowMapPass(DirectionalLight* light)
+// Draws the occluders the main view's QueryScene found into the occlusion buffer, then clears the masks of the objects
+// hidden behind them. The occluders are tested too, one can hide behind another
+void CullOccluded(const glm::mat4& viewProjection, const FrameTransforms& scene)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	occlusionCuller.Begin(viewProjection);
+	for (GLuint i = 0; i < 2; i++)
+	{
+		if (staticMasks[STATIC_PYRAMIDS + i] != 0)
+		{
+			occlusionCuller.RasterizeOccluder(pyramidOccluder, scene.GetWorlds(pyramidNodes)[i]);
+		}
+	}
+	if (staticMasks[STATIC_FLOOR] != 0)
+	{
+		occlusionCuller.RasterizeOccluder(floorOccluder, *scene.GetWorlds(floorNode));
+	}
+	if (dynamicMasks[DYNAMIC_LAPTOP] != 0)
+	{
+		laptop.RasterizeOccluders(&occlusionCuller, scene, laptopModelNode);
+	}
+
+	for (GLuint object = 0; object < staticMasks.size(); object++)
+	{
+		if (staticMasks[object] != 0 && !occlusionCuller.IsVisible(staticObjects.GetObjectBounds(object)))
+		{
+			staticMasks[object] = 0;
+		}
+	}
+	for (GLuint object = 0; object < dynamicMasks.size(); object++)
+	{
+		if (dynamicMasks[object] != 0 && !occlusionCuller.IsVisible(dynamicObjects.GetObjectBounds(object)))
+		{
+			dynamicMasks[object] = 0;
+		}
+	}
+
+	occlusionTime += std::chrono::high_resolution_clock::now() - start;
+}
+
+// Queues what the pass's QueryScene found. Depth only passes get the shadow casters only, without textures or
+// materials
+void SubmitScene(const FrameTransforms& scene)
+{
+	const bool depthOnly = renderQueue.IsDepthOnly();
+
+	// One instanced draw per mesh and material, brick pyramid first
+	if (depthOnly)
+	{
+		// Only the material tells the pyramids apart, so for depth they are one draw
+		SubmitStaticInstances(STATIC_PYRAMIDS, meshList[0], scene, pyramidNodes, 2, nullptr, nullptr);
+	}
+	else
+	{
+		SubmitStaticInstances(STATIC_PYRAMIDS, meshList[0], scene, pyramidNodes, 1, &brickTexture, &shinyMaterial);
+		SubmitStaticInstances(STATIC_PYRAMIDS + 1, meshList[0], scene, pyramidNodes + 1, 1, &dirtTexture, &dullMaterial);
+	}
+
+	// Nothing is below the floor for it to shadow
+	if (!depthOnly)
+	{
+		SubmitStaticInstances(STATIC_FLOOR, meshList[1], scene, floorNode, 1, &dirtTexture, &dullMaterial);
+	}
+
+	GLint faceMask;
+	glm::vec3 center;
+	const GLsizei visibleCount = GatherInstances(dynamicObjects, dynamicMasks, DYNAMIC_LAPTOP, scene, laptopNode, 1,
+		static_cast<GLuint>(laptop.GetMeshCount()), faceMask, center);
+	if (visibleCount > 0)
+	{
+		laptop.SubmitModel(&renderQueue, &shinyMaterial, scene, laptopModelNode, faceMask, center);
+	}
+}
+
+void DirectionalShadowMapPass(DirectionalLight* light, const FrameTransforms& scene)
 {
 	directionalShadowShader.UseShader();
 
-	glViewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
+	GLState::Viewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
 
 	light->GetShadowMap()->Write();
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	uniformModel = directionalShadowShader.GetModelLocation();
 	auto lTransform = light->CalculateLightTransform();
 	directionalShadowShader.SetDirectionalLightTransform(&lTransform);
 
 	directionalShadowShader.Validate();
 
-	RenderScene();
-
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	const Frustum frustum(lTransform);
+	renderQueue.BeginPass(PASS_DIRECTIONAL_SHADOW, PassKind::DepthOnly, directionalShadowShader.GetProgramId(), -light->GetDirection(),
+		100.0f);
+	renderQueue.SetLodSelection(light->GetProjection(), static_cast<GLfloat>(light->GetShadowMap()->GetShadowHeight()),
+		LOD_PIXEL_ERROR * SHADOW_LOD_BIAS);
+	const glm::vec3 lightDirection = light->GetDirection();
+	renderQueue.SetMeshletCulling(&frustum, 1, &lightDirection, 1, true);
+	QueryScene(&frustum, 1);
+	SubmitScene(scene);
+	renderQueue.Flush(&frameData);
+
+	GLState::BindFramebuffer(mainWindow.getFramebuffer());
 }
 
-void OmniShadowMapPass(PointLight* light)
+void OmniShadowMapPass(const FrameTransforms& scene)
 {
 	omniShadowShader.UseShader();
 
-	glViewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
+	GLState::Viewport(0, 0, omniShadowMap.GetShadowWidth(), omniShadowMap.GetShadowHeight());
 
-	light->GetShadowMap()->Write();
+	omniShadowMap.Write();
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	uniformModel = omniShadowShader.GetModelLocation();
-	uniformOmniLightPos = omniShadowShader.GetOmniLightPosLocation();
-	uniformFarPlane = omniShadowShader.GetFarPlaneLocation();
+	omniShadowShader.Validate();
 
-	glUniform3f(uniformOmniLightPos, light->GetPosition().x, light->GetPosition().y, light->GetPosition().z);
-	glUniform1f(uniformFarPlane, light->GetFarPlane());
-	omniShadowShader.SetLightMatrices(light->CalculateLightTransform());
+	// One frustum per layer-face, objects are only emitted to the faces they can be seen from
+	Frustum frusta[MAX_OMNI_SHADOWS * 6];
+	const GLuint lightCount = std::min<GLuint>(omniShadowLights.size(), MAX_OMNI_SHADOWS);
+	for (GLuint i = 0; i < lightCount; i++)
+	{
+		const std::vector<glm::mat4> lightMatrices = omniShadowLights[i]->CalculateLightTransform();
+		for (GLuint face = 0; face < 6; face++)
+		{
+			frusta[i * 6 + face] = Frustum(lightMatrices[face]);
+		}
+	}
 
-	omniShadowShader.Validate();
+	const glm::vec3 eye = lightCount > 0 ? omniShadowLights[0]->GetPosition() : glm::vec3(0.0f);
+	const GLfloat farPlane = lightCount > 0 ? omniShadowLights[0]->GetFarPlane() : 1.0f;
+	renderQueue.BeginPass(PASS_OMNI_SHADOW, PassKind::DepthOnly, omniShadowShader.GetProgramId(), eye, farPlane);
+	glm::vec3 lightPositions[MAX_OMNI_SHADOWS];
+	for (GLuint i = 0; i < lightCount; i++)
+	{
+		lightPositions[i] = omniShadowLights[i]->GetPosition();
+	}
+	// Every face of every light has the same 90 degree projection, a draw goes to all of them at the level the
+	// nearest light needs
+	if (lightCount > 0)
+	{
+		renderQueue.SetLodSelection(omniShadowLights[0]->GetProjection(), static_cast<GLfloat>(omniShadowMap.GetShadowHeight()),
+			LOD_PIXEL_ERROR * SHADOW_LOD_BIAS, lightPositions, lightCount);
+	}
+	// A meshlet facing away from every light is skipped on all the cube faces, the others on the faces they are outside of
+	renderQueue.SetMeshletCulling(frusta, lightCount * 6, lightPositions, lightCount, false);
+	// Objects in range of a light first, then the faces of that light they are on
+	BoundingSphere ranges[MAX_OMNI_SHADOWS];
+	for (GLuint i = 0; i < lightCount; i++)
+	{
+		ranges[i].center = omniShadowLights[i]->GetPosition();
+		ranges[i].radius = omniShadowLights[i]->GetFarPlane();
+	}
+	QueryScene(ranges, lightCount);
+	SelectOmniFaces(staticObjects, frusta, lightCount, staticMasks);
+	SelectOmniFaces(dynamicObjects, frusta, lightCount, dynamicMasks);
+	SubmitScene(scene);
+	renderQueue.Flush(&frameData);
+
+	GLState::BindFramebuffer(mainWindow.getFramebuffer());
+}
+
+void SpotShadowMapPass(SpotLight* light, const FrameTransforms& scene)
+{
+	// Same depth-only shader as the directional light, only with a perspective light transform
+	directionalShadowShader.UseShader();
+
+	GLState::Viewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
+
+	light->GetShadowMap()->Write();
+	glClear(GL_DEPTH_BUFFER_BIT);
 
-	RenderScene();
+	auto lTransform = light->CalculateLightTransform();
+	directionalShadowShader.SetDirectionalLightTransform(&lTransform);
+
+	directionalShadowShader.Validate();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	const Frustum frustum(lTransform);
+	renderQueue.BeginPass(PASS_SPOT_SHADOW, PassKind::DepthOnly, directionalShadowShader.GetProgramId(), light->GetPosition(),
+		light->GetFarPlane());
+	renderQueue.SetLodSelection(light->GetProjection(), static_cast<GLfloat>(light->GetShadowMap()->GetShadowHeight()),
+		LOD_PIXEL_ERROR * SHADOW_LOD_BIAS);
+	const glm::vec3 lightPosition = light->GetPosition();
+	renderQueue.SetMeshletCulling(&frustum, 1, &lightPosition, 1, false);
+	// Nothing outside the cone is lit by the light, so nothing outside it casts a shadow anyone sees. The cone is
+	// as wide as the shadow map's frustum
+	const BoundingCone cone(light->GetPosition(), glm::normalize(light->GetDirection()), std::min(light->GetEdge() + 1.0f, 85.0f),
+		light->GetFarPlane());
+	QueryScene(&cone, 1);
+	SubmitScene(scene);
+	renderQueue.Flush(&frameData);
+
+	GLState::BindFramebuffer(mainWindow.getFramebuffer());
 }
 
-void RenderPass(glm::mat4 projection, glm::mat4 view)
+void RenderPass(glm::mat4 projection, glm::mat4 view, const FrameTransforms& scene)
 {
-	glViewport(0, 0, 1366, 768);
+	GLState::Viewport(0, 0, mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	skybox.DrawSkybox(view, projection);
+	skybox.DrawSkybox(&frameData);
 
 	shaderList[0].UseShader();
 
-	uniformModel = shaderList[0].GetModelLocation();
-	uniformProjection = shaderList[0].GetProjectionLocation();
-	uniformView = shaderList[0].GetViewLocation();
-	uniformEyePosition = shaderList[0].GetEyePositionLocation();
-	uniformSpecularIntensity = shaderList[0].GetSpecularIntensityLocation();
-	uniformShininess = shaderList[0].GetShininessLocation();
+	shaderList[0].SetLightClusters(&lightClusters);
+	shaderList[0].SetSpotShadowMaps(spotLights, spotLightCount, 4);
 
-	
+	mainLight.GetShadowMap()->Read(GL_TEXTURE2);
+	shaderList[0].SetTexture(1);
+	shaderList[0].SetDirectionalShadowMap(2);
+	omniShadowMap.Read(GL_TEXTURE3);
+	shaderList[0].SetOmniShadowMap(3);
 
-	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projection));
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(view));
-	glUniform3f(uniformEyePosition, camera.getCameraPosition().x, camera.getCameraPosition().y,
-	            camera.getCameraPosition().z);
+	shaderList[0].Validate();
 
-	shaderList[0].SetDirectionalLight(&mainLight);
-	shaderList[0].SetPointLights(pointLights, pointLightCount, 3, 0);
-	shaderList[0].SetSpotLights(spotLights, spotLightCount, 3 + pointLightCount, pointLightCount);
+	const Frustum frustum(projection * view);
+	renderQueue.BeginPass(PASS_MAIN, PassKind::Shaded, shaderList[0].GetProgramId(), camera.getCameraPosition(), 100.0f);
+	renderQueue.SetLodSelection(projection, static_cast<GLfloat>(mainWindow.getBufferHeight()), LOD_PIXEL_ERROR);
+	const glm::vec3 cameraPosition = camera.getCameraPosition();
+	renderQueue.SetMeshletCulling(&frustum, 1, &cameraPosition, 1, false);
+	QueryScene(&frustum, 1);
+	CullOccluded(projection * view, scene);
+	SubmitScene(scene);
+	renderQueue.Flush(&frameData);
+}
 
-	auto lTransform = mainLight.CalculateLightTransform();
-	shaderList[0].SetDirectionalLightTransform(&lTransform);
+// Writes the camera, light and shadow data of this frame into the ring buffer and binds it
+void UploadFrameData(glm::mat4 projection, glm::mat4 view)
+{
+	GLintptr offset;
 
-	mainLight.GetShadowMap()->Read(GL_TEXTURE2);
-	shaderList[0].SetTexture(1);
-	shaderList[0].SetDirectionalShadowMap(2);
+	CameraData *cameraData = static_cast<CameraData*>(frameData.Allocate(GL_UNIFORM_BUFFER, sizeof(CameraData), offset));
+	*cameraData = camera.getCameraData(projection);
+	frameData.BindRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, offset, sizeof(CameraData));
+
+	DirectionalLightData *lightData = static_cast<DirectionalLightData*>(
+		frameData.Allocate(GL_UNIFORM_BUFFER, sizeof(DirectionalLightData), offset));
+	*lightData = mainLight.GetLightData();
+	frameData.BindRange(GL_UNIFORM_BUFFER, DIRECTIONAL_LIGHT_BLOCK_BINDING, offset, sizeof(DirectionalLightData));
+
+	OmniShadowData *omniData = static_cast<OmniShadowData*>(frameData.Allocate(GL_UNIFORM_BUFFER, sizeof(OmniShadowData), offset));
+	PointLight::GetOmniShadowData(omniShadowLights, omniData);
+	frameData.BindRange(GL_UNIFORM_BUFFER, OMNI_SHADOW_BLOCK_BINDING, offset, sizeof(OmniShadowData));
+
+	lightClusters.Update(view, pointLights, pointLightCount, spotLights, spotLightCount, &frameData);
+}
+
+void RenderFrame(glm::mat4 projection)
+{
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClearDepth(1.0f);
 
+	// Move the flash light before the shadow passes so its shadow map matches this frame's camera
 	glm::vec3 flashLightPosition = camera.getCameraPosition();
 	flashLightPosition.y -= 0.3f;
 	spotLights[0].SetFlash(flashLightPosition, camera.getCameraDirection());
 
-	shaderList[0].Validate();
+	const glm::mat4 view = camera.calculateViewMatrix();
+
+	UpdateScene();
+
+	frameData.BeginFrame();
+	UploadFrameData(projection, view);
+
+	DirectionalShadowMapPass(&mainLight, frameTransforms);
+	OmniShadowMapPass(frameTransforms);
+	for (size_t i = 0; i < spotLightCount; i++)
+	{
+		if (spotLights[i].GetShadowIndex() >= 0)
+		{
+			SpotShadowMapPass(&spotLights[i], frameTransforms);
+		}
+	}
+	RenderPass(projection, view, frameTransforms);
+
+	frameData.EndFrame();
+}
+
+CameraPath CreateBenchmarkPath()
+{
+	// Circles the scene once, looking at the pyramids, the laptop and the floor from different heights
+	CameraPath path;
+	path.AddKeyframe(glm::vec3(0.0f, 0.0f, 6.0f), -90.0f, 0.0f);
+	path.AddKeyframe(glm::vec3(7.0f, 2.0f, 2.0f), -160.0f, -15.0f);
+	path.AddKeyframe(glm::vec3(5.0f, 4.0f, -8.0f), -230.0f, -25.0f);
+	path.AddKeyframe(glm::vec3(-5.0f, 1.0f, -8.0f), -310.0f, -5.0f);
+	path.AddKeyframe(glm::vec3(-7.0f, 3.0f, 2.0f), -380.0f, -20.0f);
+	path.AddKeyframe(glm::vec3(0.0f, 0.0f, 6.0f), -450.0f, 0.0f);
+	return path;
+}
+
+void RunBenchmark(glm::mat4 projection, unsigned frameCount)
+{
+	const CameraPath path = CreateBenchmarkPath();
 
-	RenderScene();
+	FrameTimer timer;
+	timer.Init();
+
+	deltaTime = BENCHMARK_TIME_STEP;
+
+	for (unsigned frame = 0; frame < BENCHMARK_WARMUP_FRAMES + frameCount; frame++)
+	{
+		const bool measured = frame >= BENCHMARK_WARMUP_FRAMES;
+		const GLfloat t = measured ? static_cast<GLfloat>(frame - BENCHMARK_WARMUP_FRAMES) / static_cast<GLfloat>(std::max(frameCount - 1, 1u)) : 0.0f;
+		path.Apply(&camera, t);
+
+		if (frame == BENCHMARK_WARMUP_FRAMES)
+		{
+			cullingStats = CullingStats();
+			renderQueue.ResetStats();
+			occlusionCuller.ResetStats();
+			occlusionTime = std::chrono::duration<double, std::milli>(0.0);
+			GLState::ResetCounters();
+		}
+
+		if (measured)
+		{
+			timer.BeginFrame();
+		}
+
+		RenderFrame(projection);
+
+		if (measured)
+		{
+			timer.EndFrame();
+		}
+
+		mainWindow.swapBuffers();
+	}
+
+	timer.Finish();
+	timer.PrintReport();
+
+	printf("Draws per frame: %.1f submitted, %.1f culled\n",
+		static_cast<double>(cullingStats.submitted) / frameCount, static_cast<double>(cullingStats.culled) / frameCount);
+
+	const OcclusionStats &occlusionStats = occlusionCuller.GetStats();
+	printf("Occlusion culling per frame: %.1f occluder triangles, %.1f of %.1f objects occluded, %.3f ms\n",
+		static_cast<double>(occlusionStats.occluderTriangles) / frameCount, static_cast<double>(occlusionStats.occluded) / frameCount,
+		static_cast<double>(occlusionStats.tested) / frameCount, occlusionTime.count() / frameCount);
+
+	const RenderQueueStats &queueStats = renderQueue.GetStats();
+	printf("State changes per frame: %.1f sorted, %.1f in submission order (%.1f saved) over %.1f draws\n",
+		static_cast<double>(queueStats.sortedStateChanges) / frameCount,
+		static_cast<double>(queueStats.unsortedStateChanges) / frameCount,
+		(static_cast<double>(queueStats.unsortedStateChanges) - static_cast<double>(queueStats.sortedStateChanges)) / frameCount,
+		static_cast<double>(queueStats.draws) / frameCount);
+	printf("Multi-draw calls per frame: %.1f\n", static_cast<double>(queueStats.multiDraws) / frameCount);
+	printf("Triangles per frame: %.1f\n", static_cast<double>(queueStats.triangles) / frameCount);
+	printf("Meshlets per frame: %.1f drawn, %.1f culled\n", static_cast<double>(queueStats.meshletsDrawn) / frameCount,
+		static_cast<double>(queueStats.meshletsCulled) / frameCount);
+
+	const GLStateCounters &stateCounters = GLState::GetCounters();
+	printf("GL state calls per frame: %.1f issued, %.1f elided\n",
+		static_cast<double>(stateCounters.issued) / frameCount, static_cast<double>(stateCounters.elided) / frameCount);
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	mainWindow = Window(1366, 768);
+	// --benchmark [frames]: render offscreen along a scripted camera path and print frame time statistics
+	// --cook <model>...: write the cooked files of the models and exit
+	unsigned benchmarkFrames = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--cook") == 0)
+		{
+			try
+			{
+				for (i++; i < argc; i++)
+				{
+					Model::CookModel(argv[i], GEOMETRY_FORMAT);
+					printf("Cooked %s\n", CookedModel::GetCookedFileName(argv[i]).c_str());
+				}
+			}
+			catch (const std::runtime_error& e)
+			{
+				printf("ERROR: %s\n", e.what());
+				return EXIT_FAILURE;
+			}
+			return EXIT_SUCCESS;
+		}
+
+		if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			benchmarkFrames = 1000;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+			{
+				benchmarkFrames = static_cast<unsigned>(atoi(argv[++i]));
+			}
+		}
+	}
+
+	mainWindow = Window(1366, 768, benchmarkFrames > 0);
 	try
 	{
 		mainWindow.initialize();
+		geometryPool.Init(GEOMETRY_FORMAT, 64 * 1024, 256 * 1024, true);
+		occlusionCuller.Init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
 		CreateObjects();
 		CreateShaders();
 
@@ -319,7 +788,17 @@ int main()
 		dullMaterial = Material(0.5f, 8);
 
 		laptop = Model();
-		laptop.LoadModel("Models/Lowpoly_Notebook_2.obj");
+		laptop.LoadModel("Models/Lowpoly_Notebook_2.obj", &geometryPool);
+		CreateScene();
+
+		// Room for the light clusters, the instance data and draw commands of every pass, plus the few uniform blocks
+		// and their alignment padding
+		frameData.Init(LightClusters::MAX_FRAME_DATA_SIZE +
+			MAX_INSTANCES_PER_FRAME * (sizeof(InstanceData) + sizeof(DrawElementsIndirectCommand)) + 64 * 1024);
+		lightClusters.BuildGrid(glm::radians(60.0f),
+		                        static_cast<GLfloat>(mainWindow.getBufferWidth()) / static_cast<GLfloat>(
+			                        mainWindow.getBufferHeight()), 0.1f, 100.0f,
+		                        mainWindow.getBufferWidth(), mainWindow.getBufferHeight());
 	}
 	catch (const std::runtime_error& e)
 	{
@@ -333,15 +812,13 @@ int main()
 	                             -9.0f, -12.0f, 18.5f);
 
 
-	pointLights[0] = PointLight(1024, 1024,
-	                            0.01f, 100.0f,
+	pointLights[0] = PointLight(0.01f, 100.0f,
 	                            0.0f, 0.0f, 1.0f,
 	                            0.0f, 1.0f,
 	                            1.0f, 2.0f, 0.0f,
 	                            0.3f, 0.2f, 0.1f);
 	pointLightCount++;
-	pointLights[1] = PointLight(1024, 1024,
-	                            0.01f, 100.0f,
+	pointLights[1] = PointLight(0.01f, 100.0f,
 	                            0.0f, 1.0f, 0.0f,
 	                            0.0f, 1.0f,
 	                            -4.0f, 3.0f, 0.0f,
@@ -349,7 +826,7 @@ int main()
 	pointLightCount++;
 
 
-	spotLights[0] = SpotLight(1024, 1024,
+	spotLights[0] = SpotLight(SPOT_SHADOW_SIZE,
 	                          0.01f, 100.0f,
 	                          1.0f, 1.0f, 1.0f,
 	                          0.1f, 1.0f,
@@ -359,7 +836,7 @@ int main()
 	                          20.0f);
 	spotLightCount++;
 
-	spotLights[1] = SpotLight(1024, 1024,
+	spotLights[1] = SpotLight(SPOT_SHADOW_SIZE,
 	                          0.01f, 100.0f,
 	                          1.0f, 1.0f, 1.0f,
 	                          0.0f, 2.0f,
@@ -369,6 +846,23 @@ int main()
 	                          20.0f);
 	spotLightCount++;
 
+	// Only the first few lights cast shadows, the shadow index picks their slot in the shadow maps
+	for (size_t i = 0; i < pointLightCount && i < MAX_OMNI_SHADOWS; i++)
+	{
+		pointLights[i].SetShadowIndex(i);
+		omniShadowLights.push_back(&pointLights[i]);
+	}
+	omniShadowMap.Init(1024, 1024, omniShadowLights.size());
+
+	GLint spotShadowCount = 0;
+	for (size_t i = 0; i < spotLightCount && spotShadowCount < MAX_SPOT_SHADOWS; i++)
+	{
+		if (spotLights[i].GetShadowMap() != nullptr)
+		{
+			spotLights[i].SetShadowIndex(spotShadowCount++);
+		}
+	}
+
 	std::vector<std::string> skyboxFaces;
 	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_rt.tga");
 	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_lf.tga");
@@ -377,12 +871,26 @@ int main()
 	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_bk.tga");
 	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_ft.tga");
 
-	skybox = Skybox(skyboxFaces);
+	skybox = Skybox(skyboxFaces, &geometryPool);
 
 	glm::mat4 projection = glm::perspective(glm::radians(60.0f),
 	                                        static_cast<GLfloat>(mainWindow.getBufferWidth()) / static_cast<GLfloat>(
 		                                        mainWindow.getBufferHeight()), 0.1f, 100.0f);
 
+	if (benchmarkFrames > 0)
+	{
+		try
+		{
+			RunBenchmark(projection, benchmarkFrames);
+		}
+		catch (const std::runtime_error& e)
+		{
+			printf("ERROR: %s\n", e.what());
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 	while (!mainWindow.getShouldClose())
 	{
 		GLfloat now = glfwGetTime();
@@ -400,23 +908,7 @@ int main()
 			mainWindow.getKeys()[GLFW_KEY_L] = false;
 		}
 
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClearDepth(1.0f);
-
-		DirectionalShadowMapPass(&mainLight);
-		// TODO: replace with only one OmniShadowPass using an array of cubemaps, one for each light
-		for (size_t i = 0; i < pointLightCount; i++)
-		{
-			OmniShadowMapPass(&pointLights[i]);
-		}
-		for (size_t i = 0; i < spotLightCount; i++)
-		{
-			OmniShadowMapPass(&spotLights[i]);
-		}
-		RenderPass(projection, camera.calculateViewMatrix());
-
-
-		glUseProgram(0);
+		RenderFrame(projection);
 
 		mainWindow.swapBuffers();
 	}